@@ -0,0 +1,130 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+/*
+ * Time the multi-threaded operations of libgit2pp for growing thread counts:
+ *
+ *   bench-parallel <directory> [count] [size]
+ *
+ * count random blobs of size bytes are hashed, written as loose objects,
+ * listed, looked up, and hashed again from files, with and without the
+ * filters of the repository. Everything is created
+ * in the directory, which must not exist yet.
+ */
+
+#include "database.hpp"
+#include "exception.hpp"
+#include "object.hpp"
+#include "repository.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace git2;
+
+static double measure(const std::function<void()>& operation)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	operation();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	if(argc<2)
+	{
+		fprintf(stderr, "usage: %s <directory> [count] [size]\n", argv[0]);
+		return 2;
+	}
+	std::string dir = argv[1];
+	size_t count = argc>2 ? strtoul(argv[2], NULL, 10) : 20000;
+	size_t size = argc>3 ? strtoul(argv[3], NULL, 10) : 4096;
+	if(::mkdir(dir.c_str(), 0777)!=0 || ::mkdir((dir + "/files").c_str(), 0777)!=0)
+	{
+		fprintf(stderr, "cannot create %s\n", dir.c_str());
+		return 1;
+	}
+	git_threads_init();
+
+	try
+	{
+		// Contents differ by their first bytes, the rest is shared noise.
+		std::mt19937 random(42);
+		std::string noise(size, '\0');
+		for(char& c : noise)
+			c = (char)random();
+		std::vector<std::string> contents(count, noise);
+		std::vector<ByteView> views;
+		std::vector<std::string> paths;
+		for(size_t n=0; n<count; ++n)
+		{
+			std::string prefix = std::to_string(n) + "\n";
+			contents[n].replace(0, std::min(prefix.size(), size), prefix, 0, size);
+			views.push_back(ByteView(contents[n].data(), contents[n].size()));
+			paths.push_back(dir + "/files/" + std::to_string(n));
+			std::ofstream(paths.back().c_str(), std::ios::binary) << contents[n];
+		}
+
+		unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		printf("%zu objects of %zu bytes\n", count, size);
+		printf("threads  hashMany  writeMany  foreach  lookupMany  hashFiles  filtered (ms)\n");
+		for(unsigned int threads=1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			// Each thread count writes in its own repository.
+			Repository repo = Repository::init(dir + "/repo" + std::to_string(threads), true);
+			Database db = repo.database();
+			std::vector<OId> oids;
+			std::atomic<size_t> listed(0);
+			std::vector<Object> objects;
+
+			double hashing = measure([&]{ Database::hashMany(views, GIT_OBJ_BLOB, threads); });
+			double writing = measure([&]{ oids = db.writeMany(views, GIT_OBJ_BLOB, threads); });
+			double listing = measure([&]{ db.foreachParallel([&](const OId&){ ++listed; return true; }, threads); });
+			double looking = measure([&]{ objects = repo.lookupMany(oids, threads); });
+			double files = measure([&]{ Database::hashFiles(paths, GIT_OBJ_BLOB, threads); });
+			double filtered = measure([&]{ repo.hashFiles(paths, GIT_OBJ_BLOB, threads); });
+			printf("%7u  %8.1f  %9.1f  %7.1f  %10.1f  %9.1f  %8.1f\n", threads, hashing, writing, listing, looking, files, filtered);
+			size_t found = std::count_if(objects.begin(), objects.end(), [](const Object& o){ return !o.isNull(); });
+			if(listed!=count || found!=count)
+			{
+				fprintf(stderr, "%zu objects listed, %zu found\n", (size_t)listed, found);
+				return 1;
+			}
+			if(threads==maxThreads)
+				break;
+		}
+	}
+	catch(const Exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
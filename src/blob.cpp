@@ -54,6 +54,11 @@ std::vector<unsigned char> Blob::content() const
     return std::vector<unsigned char>( static_cast<const char *>(rawContent()), static_cast<const char *>(rawContent())+rawSize() );
 }
 
+ByteView Blob::view() const
+{
+    return ByteView(rawContent(), (size_t)rawSize());
+}
+
 int64_t Blob::rawSize() const
 {
     return git_blob_rawsize(data());
@@ -23,6 +23,7 @@
 #include <git2.h>
 
 #include "object.hpp"
+#include "stringview.hpp"
 
 namespace git2
 {
@@ -74,6 +75,14 @@ public:
       */
     std::vector<unsigned char> content() const;
 
+    /**
+     * Get a view of the raw content of this blob, without copy.
+     *
+     * The view is valid as long as this blob.
+     * To read large blobs by chunks, see Database::openReadStream().
+     */
+    ByteView view() const;
+
     /**
      * Get the size in bytes of the contents of a blob
      *
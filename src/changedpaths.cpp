@@ -0,0 +1,559 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "changedpaths.hpp"
+
+#include "commit.hpp"
+#include "commitgraph.hpp"
+#include "exception.hpp"
+#include "oidmap.hpp"
+#include "repository.hpp"
+#include "tree.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace git2
+{
+
+//
+// Filters file format, all integers are big-endian:
+//   header    "G2CP", version, commit count (3 x 4 bytes)
+//   oids      commit count x 20 bytes, sorted
+//   ends      commit count x 4 bytes, end offset of each filter in data
+//   data      filters
+//
+// A filter has 10 bits per changed path, set by 7 hashes of the path.
+// An empty filter means no change, a single 0xFF byte matches any path.
+//
+
+static const char FiltersMagic[4] = {'G', '2', 'C', 'P'};
+static const uint32_t FiltersVersion = 1;
+static const size_t HeaderSize = 12;
+static const size_t BitsPerPath = 10;
+static const unsigned int Hashes = 7;
+
+static const char FiltersFile[] = "/info/git2pp-changed-paths";
+
+static uint32_t read_be32(const unsigned char* buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+static void write_be32(std::vector<unsigned char>& buffer, uint32_t value)
+{
+	buffer.push_back((unsigned char)(value >> 24));
+	buffer.push_back((unsigned char)(value >> 16));
+	buffer.push_back((unsigned char)(value >> 8));
+	buffer.push_back((unsigned char)value);
+}
+
+//
+// Bloom filters
+//
+
+// FNV-1a hash of a path, split in two halves for double hashing.
+static uint64_t path_hash(const std::string& path)
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for(unsigned char c : path)
+	{
+		hash ^= c;
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+static void bloom_add(std::vector<unsigned char>& filter, uint64_t hash)
+{
+	uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+	size_t bits = filter.size() * 8;
+	for(unsigned int n=0; n<Hashes; ++n)
+	{
+		size_t bit = (uint32_t)(h1 + n*h2) % bits;
+		filter[bit/8] |= (unsigned char)(1 << (bit%8));
+	}
+}
+
+static bool bloom_test(const unsigned char* filter, size_t size, uint64_t hash)
+{
+	if(size==0)
+		return false;
+	uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+	size_t bits = size * 8;
+	for(unsigned int n=0; n<Hashes; ++n)
+	{
+		size_t bit = (uint32_t)(h1 + n*h2) % bits;
+		if((filter[bit/8] & (1 << (bit%8)))==0)
+			return false;
+	}
+	return true;
+}
+
+static std::vector<std::string> split_path(const std::string& path)
+{
+	std::vector<std::string> components;
+	size_t begin = 0;
+	while(begin<=path.size())
+	{
+		size_t end = path.find('/', begin);
+		if(end==std::string::npos)
+			end = path.size();
+		if(end>begin)
+			components.push_back(path.substr(begin, end - begin));
+		begin = end + 1;
+	}
+	return components;
+}
+
+static std::string join_path(const std::vector<std::string>& components)
+{
+	std::string path;
+	for(const std::string& component : components)
+		path += (path.empty() ? "" : "/") + component;
+	return path;
+}
+
+//
+// Commits and trees
+//
+
+struct CommitInfo
+{
+	OId tree;
+	std::vector<OId> parents;
+	git_time_t time;
+};
+
+// Read a commit from the graph when it knows it, from the repository otherwise.
+static CommitInfo commit_info(const Repository& repository, const CommitGraph* graph, const OId& oid)
+{
+	CommitInfo info;
+	uint32_t pos = graph!=NULL ? graph->position(oid) : CommitGraph::NoPosition;
+	if(pos!=CommitGraph::NoPosition)
+	{
+		std::vector<uint32_t> parents;
+		graph->parents(pos, parents);
+		for(uint32_t parent : parents)
+			info.parents.push_back(graph->oid(parent));
+		info.tree = graph->treeId(pos);
+		info.time = graph->time(pos);
+	}
+	else
+	{
+		Commit commit = repository.lookupCommit(oid);
+		for(unsigned int n=0; n<git_commit_parentcount(commit.data()); ++n)
+			info.parents.push_back(OId(git_commit_parent_id(commit.data(), n)));
+		info.tree = OId(git_commit_tree_id(commit.data()));
+		info.time = git_commit_time(commit.data());
+	}
+	return info;
+}
+
+struct EntryState
+{
+	OId id;
+	git_otype type;
+	unsigned int mode;
+
+	bool operator==(const EntryState& other) const
+	{
+		return id==other.id && type==other.type && mode==other.mode;
+	}
+};
+
+typedef std::map<std::string, EntryState> TreeEntries;
+
+static void tree_entries(const Repository& repository, const OId& oid, TreeEntries& entries)
+{
+	entries.clear();
+	if(oid.isZero())
+		return;
+	Tree tree = repository.lookupTree(oid);
+	size_t count = git_tree_entrycount(tree.data());
+	for(size_t n=0; n<count; ++n)
+	{
+		const git_tree_entry* entry = git_tree_entry_byindex(tree.data(), n);
+		EntryState value = {OId(git_tree_entry_id(entry)), git_tree_entry_type(entry), (unsigned int)git_tree_entry_filemode(entry)};
+		entries[git_tree_entry_name(entry)] = value;
+	}
+}
+
+// Collect the paths changed between two trees, identical subtrees being
+// skipped. Returns false once more than MaxPaths paths are found.
+static bool diff_trees(const Repository& repository, const OId& from, const OId& to, const std::string& prefix, std::vector<std::string>& paths)
+{
+	TreeEntries a, b;
+	tree_entries(repository, from, a);
+	tree_entries(repository, to, b);
+	TreeEntries::const_iterator ia = a.begin(), ib = b.begin();
+	while(ia!=a.end() || ib!=b.end())
+	{
+		const TreeEntries::value_type* ea = NULL;
+		const TreeEntries::value_type* eb = NULL;
+		if(ib==b.end() || (ia!=a.end() && ia->first < ib->first))
+			ea = &*ia++;
+		else if(ia==a.end() || ib->first < ia->first)
+			eb = &*ib++;
+		else
+		{
+			ea = &*ia++;
+			eb = &*ib++;
+		}
+		if(ea!=NULL && eb!=NULL && ea->second==eb->second)
+			continue;
+
+		std::string path = prefix.empty() ? (ea!=NULL ? ea : eb)->first : prefix + "/" + (ea!=NULL ? ea : eb)->first;
+		paths.push_back(path);
+		if(paths.size() > ChangedPathFilters::MaxPaths)
+			return false;
+		OId treeA = ea!=NULL && ea->second.type==GIT_OBJ_TREE ? ea->second.id : OId();
+		OId treeB = eb!=NULL && eb->second.type==GIT_OBJ_TREE ? eb->second.id : OId();
+		if((!treeA.isZero() || !treeB.isZero()) && !diff_trees(repository, treeA, treeB, path, paths))
+			return false;
+	}
+	return true;
+}
+
+// Compare the entries (ids and modes) of a path in two trees, stopping
+// at the first identical subtree.
+static bool path_changed(const Repository& repository, OId a, OId b, const std::vector<std::string>& components)
+{
+	unsigned int modeA = 0, modeB = 0;
+	for(size_t n=0; n<components.size(); ++n)
+	{
+		if(a==b)
+			return false;
+		std::pair<OId*, unsigned int*> sides[2] = {std::make_pair(&a, &modeA), std::make_pair(&b, &modeB)};
+		for(const std::pair<OId*, unsigned int*>& side : sides)
+		{
+			if(side.first->isZero())
+				continue;
+			Tree tree = repository.lookupTree(*side.first);
+			const git_tree_entry* entry = git_tree_entry_byname(tree.data(), components[n].c_str());
+			// A file in the middle of the path hides it like a missing entry.
+			bool found = entry!=NULL && (n+1==components.size() || git_tree_entry_type(entry)==GIT_OBJ_TREE);
+			*side.first = found ? OId(git_tree_entry_id(entry)) : OId();
+			*side.second = found ? (unsigned int)git_tree_entry_filemode(entry) : 0;
+		}
+	}
+	return a!=b || modeA!=modeB;
+}
+
+
+//
+// ChangedPathFilters
+//
+
+ChangedPathFilters::ChangedPathFilters(const std::string& objectsDir):
+_objectsDir(objectsDir),
+_map(NULL),
+_mapSize(0),
+_count(0),
+_oids(NULL),
+_offsets(NULL),
+_data(NULL)
+{
+	while(_objectsDir.size()>1 && _objectsDir[_objectsDir.size()-1]=='/')
+		_objectsDir.erase(_objectsDir.size()-1);
+	load();
+}
+
+ChangedPathFilters::~ChangedPathFilters()
+{
+	if(_map!=NULL)
+		munmap(_map, _mapSize);
+}
+
+void ChangedPathFilters::load()
+{
+	int fd = open((_objectsDir + FiltersFile).c_str(), O_RDONLY);
+	if(fd<0)
+		return;
+	struct stat st;
+	if(fstat(fd, &st)!=0 || (size_t)st.st_size<HeaderSize)
+	{
+		close(fd);
+		return;
+	}
+	_mapSize = (size_t)st.st_size;
+	_map = mmap(NULL, _mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(_map==MAP_FAILED)
+	{
+		_map = NULL;
+		return;
+	}
+
+	const unsigned char* data = (const unsigned char*)_map;
+	uint32_t count = read_be32(data + 8);
+	size_t tables = HeaderSize + (size_t)count*(GIT_OID_RAWSZ + 4);
+	bool ok = std::memcmp(data, FiltersMagic, 4)==0 && read_be32(data + 4)==FiltersVersion && _mapSize>=tables;
+	const unsigned char* offsets = data + HeaderSize + (size_t)count*GIT_OID_RAWSZ;
+	for(uint32_t n=0, previous=0; ok && n<count; ++n)
+	{
+		uint32_t end = read_be32(offsets + n*4);
+		ok = end>=previous;
+		previous = end;
+	}
+	ok = ok && _mapSize - tables == (count>0 ? read_be32(offsets + (count-1)*4) : 0);
+	if(!ok)
+	{
+		munmap(_map, _mapSize);
+		_map = NULL;
+		return;
+	}
+
+	_count = count;
+	_oids = data + HeaderSize;
+	_offsets = offsets;
+	_data = data + tables;
+}
+
+const std::string& ChangedPathFilters::objectsDir() const
+{
+	return _objectsDir;
+}
+
+size_t ChangedPathFilters::size() const
+{
+	return _count;
+}
+
+bool ChangedPathFilters::empty() const
+{
+	return _count==0;
+}
+
+uint32_t ChangedPathFilters::position(const OId& commit) const
+{
+	uint32_t first = 0, last = _count;
+	while(first<last)
+	{
+		uint32_t middle = first + (last - first) / 2;
+		int cmp = std::memcmp(_oids + (size_t)middle*GIT_OID_RAWSZ, commit.raw(), GIT_OID_RAWSZ);
+		if(cmp==0)
+			return middle;
+		if(cmp<0)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	return CommitGraph::NoPosition;
+}
+
+void ChangedPathFilters::filter(uint32_t pos, const unsigned char*& data, size_t& size) const
+{
+	uint32_t begin = pos==0 ? 0 : read_be32(_offsets + (pos-1)*4);
+	data = _data + begin;
+	size = read_be32(_offsets + pos*4) - begin;
+}
+
+bool ChangedPathFilters::contains(const OId& commit) const
+{
+	return position(commit)!=CommitGraph::NoPosition;
+}
+
+bool ChangedPathFilters::mayChange(const OId& commit, const std::string& path) const
+{
+	std::string normalized = join_path(split_path(path));
+	uint32_t pos = position(commit);
+	if(pos==CommitGraph::NoPosition || normalized.empty())
+		return true;
+	const unsigned char* data;
+	size_t size;
+	filter(pos, data, size);
+	return bloom_test(data, size, path_hash(normalized));
+}
+
+size_t ChangedPathFilters::append(const Repository& repository, const std::vector<OId>& tips) const
+{
+	std::shared_ptr<const CommitGraph> graph = repository.commitGraph();
+
+	// Filters of the commits which have none, against their first parent.
+	std::vector<std::pair<OId, std::vector<unsigned char>>> filters;
+	OIdSet seen;
+	std::vector<OId> stack;
+	for(const OId& tip : tips)
+	{
+		if(!contains(tip) && seen.insert(tip))
+			stack.push_back(tip);
+	}
+	std::vector<std::string> paths;
+	while(!stack.empty())
+	{
+		OId oid = stack.back();
+		stack.pop_back();
+		CommitInfo info = commit_info(repository, graph.get(), oid);
+		OId parentTree = info.parents.empty() ? OId() : commit_info(repository, graph.get(), info.parents[0]).tree;
+
+		paths.clear();
+		std::vector<unsigned char> filter;
+		if(!diff_trees(repository, parentTree, info.tree, "", paths))
+			filter.assign(1, 0xFF);
+		else if(!paths.empty())
+		{
+			filter.assign((paths.size()*BitsPerPath + 7) / 8, 0);
+			for(const std::string& path : paths)
+				bloom_add(filter, path_hash(path));
+		}
+		filters.push_back(std::make_pair(oid, filter));
+
+		for(const OId& parent : info.parents)
+		{
+			if(!contains(parent) && seen.insert(parent))
+				stack.push_back(parent);
+		}
+	}
+	if(filters.empty())
+		return 0;
+	std::sort(filters.begin(), filters.end(),
+		[](const std::pair<OId, std::vector<unsigned char>>& a, const std::pair<OId, std::vector<unsigned char>>& b){return a.first < b.first;});
+
+	// Merge the new filters with the existing ones.
+	size_t count = _count + filters.size();
+	std::vector<unsigned char> oids, ends, data;
+	oids.reserve(count * GIT_OID_RAWSZ);
+	size_t n = 0;
+	uint32_t pos = 0;
+	while(n<filters.size() || pos<_count)
+	{
+		const unsigned char* filter;
+		size_t size;
+		if(pos<_count && (n==filters.size() || std::memcmp(_oids + (size_t)pos*GIT_OID_RAWSZ, filters[n].first.raw(), GIT_OID_RAWSZ)<0))
+		{
+			oids.insert(oids.end(), _oids + (size_t)pos*GIT_OID_RAWSZ, _oids + (size_t)(pos+1)*GIT_OID_RAWSZ);
+			this->filter(pos++, filter, size);
+		}
+		else
+		{
+			oids.insert(oids.end(), filters[n].first.raw(), filters[n].first.raw() + GIT_OID_RAWSZ);
+			filter = filters[n].second.data();
+			size = filters[n++].second.size();
+		}
+		data.insert(data.end(), filter, filter + size);
+		write_be32(ends, (uint32_t)data.size());
+	}
+
+	std::vector<unsigned char> buffer(FiltersMagic, FiltersMagic + 4);
+	write_be32(buffer, FiltersVersion);
+	write_be32(buffer, (uint32_t)count);
+	buffer.insert(buffer.end(), oids.begin(), oids.end());
+	buffer.insert(buffer.end(), ends.begin(), ends.end());
+	buffer.insert(buffer.end(), data.begin(), data.end());
+
+	// Write under a temporary name then move it in place.
+	std::string path = _objectsDir + FiltersFile, tmp = path + ".lock";
+	std::FILE* file = std::fopen(tmp.c_str(), "wb");
+	bool ok = file!=NULL && std::fwrite(buffer.data(), 1, buffer.size(), file)==buffer.size();
+	if(file!=NULL)
+		ok = (std::fclose(file)==0) && ok;
+	if(!ok || std::rename(tmp.c_str(), path.c_str())!=0)
+	{
+		std::remove(tmp.c_str());
+		giterr_set_str(GITERR_OS, ("Unable to write changed path filters file " + path).c_str());
+		throw Exception(GIT_ERROR);
+	}
+	return filters.size();
+}
+
+std::vector<OId> ChangedPathFilters::history(const Repository& repository, const std::string& path, const std::vector<OId>& from, size_t limit) const
+{
+	std::shared_ptr<const CommitGraph> graph = repository.commitGraph();
+	std::vector<std::string> components = split_path(path);
+	std::string normalized = join_path(components);
+
+	// Commits by decreasing time, then in the order they were queued.
+	typedef std::pair<git_time_t, size_t> Key;
+	std::priority_queue<std::pair<Key, OId>, std::vector<std::pair<Key, OId>>,
+		std::function<bool(const std::pair<Key, OId>&, const std::pair<Key, OId>&)>> queue(
+		[](const std::pair<Key, OId>& a, const std::pair<Key, OId>& b)
+		{
+			return a.first.first < b.first.first || (a.first.first==b.first.first && a.first.second > b.first.second);
+		});
+	// References into infos are only valid until the next insertion.
+	OIdMap<CommitInfo> infos;
+	auto info_of = [&](const OId& oid)->const CommitInfo&
+	{
+		CommitInfo* info = infos.find(oid);
+		if(info==nullptr)
+		{
+			CommitInfo read = commit_info(repository, graph.get(), oid);
+			info = &infos[oid];
+			*info = std::move(read);
+		}
+		return *info;
+	};
+	OIdSet seen;
+	size_t order = 0;
+	for(const OId& tip : from)
+	{
+		if(seen.insert(tip))
+			queue.push(std::make_pair(Key(info_of(tip).time, order++), tip));
+	}
+
+	std::vector<OId> commits;
+	while(!queue.empty() && (limit==0 || commits.size()<limit))
+	{
+		OId oid = queue.top().second;
+		queue.pop();
+		CommitInfo info = info_of(oid);
+		infos.erase(oid);
+
+		bool changed;
+		std::vector<OId> follow;
+		if(info.parents.empty())
+			changed = path_changed(repository, OId(), info.tree, components);
+		else
+		{
+			// A parent leaving the path untouched is the only one followed.
+			for(size_t n=0; n<info.parents.size() && follow.empty(); ++n)
+			{
+				bool same = (n==0 && !normalized.empty() && !mayChange(oid, normalized))
+					|| !path_changed(repository, info_of(info.parents[n]).tree, info.tree, components);
+				if(same)
+					follow.push_back(info.parents[n]);
+			}
+			changed = follow.empty();
+			if(changed)
+				follow = info.parents;
+		}
+		if(changed)
+			commits.push_back(oid);
+
+		for(const OId& parent : follow)
+		{
+			if(seen.insert(parent))
+				queue.push(std::make_pair(Key(info_of(parent).time, order++), parent));
+		}
+	}
+	return commits;
+}
+
+} // namespace git2
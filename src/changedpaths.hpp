@@ -0,0 +1,146 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_CHANGEDPATHS_HPP_
+#define _GIT2PP_CHANGEDPATHS_HPP_
+
+#include <git2.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "oid.hpp"
+
+namespace git2
+{
+
+class Repository;
+
+/**
+ * Memory-mapped changed-path Bloom filters of the commits of a repository.
+ *
+ * Each commit with a filter has a Bloom filter of the paths it changes
+ * compared to its first parent, leading directories included. A negative
+ * answer is certain, so path-limited walks skip the tree comparison of
+ * most commits.
+ *
+ * Filters are stored in the "info/git2pp-changed-paths" file of the
+ * objects directory. append() only computes the filters of the commits
+ * which have none yet.
+ *
+ * An instance is a read-only snapshot and is safe to share between threads.
+ */
+class ChangedPathFilters
+{
+public:
+	/** Changed paths above which a commit gets a filter matching all paths. */
+	static const size_t MaxPaths = 512;
+
+	/**
+	 * Open the filters of an objects directory.
+	 * There is no filter if none was written yet.
+	 *
+	 * @param objectsDir path to the "objects" directory.
+	 */
+	ChangedPathFilters(const std::string& objectsDir);
+
+	~ChangedPathFilters();
+
+	/**
+	 * Objects directory of these filters.
+	 */
+	const std::string& objectsDir() const;
+
+	/**
+	 * Number of commits with a filter.
+	 */
+	size_t size() const;
+
+	/**
+	 * Check if no commit has a filter.
+	 */
+	bool empty() const;
+
+	/**
+	 * Check if a commit has a filter.
+	 */
+	bool contains(const OId& commit) const;
+
+	/**
+	 * Check if a commit may change a path compared to its first parent.
+	 *
+	 * @param commit full-length commit id.
+	 * @param path path of a file or directory, relative to the root tree.
+	 * @return False if the path is certainly unchanged, true if it may
+	 * be changed or if the commit has no filter.
+	 */
+	bool mayChange(const OId& commit, const std::string& path) const;
+
+	/**
+	 * Compute the filters of the commits reachable from some tips and
+	 * write them with the existing ones.
+	 *
+	 * Only commits which have no filter are read and diffed. This
+	 * instance is not modified, open the filters again to see new ones.
+	 *
+	 * @param repository repository to read commits from.
+	 * @param tips full-length ids of the commits to start from.
+	 * @return Number of added filters.
+	 * @throws Exception
+	 */
+	size_t append(const Repository& repository, const std::vector<OId>& tips) const;
+
+	/**
+	 * List the commits changing a path, like `git log -- path`.
+	 *
+	 * Commits come by decreasing commit time. A merge which leaves the
+	 * path as in one of its parents is not listed and only that parent is
+	 * followed. Filters rule out most unchanged commits; other ones are
+	 * checked by comparing the trees along the path, stopping at the first
+	 * identical subtree.
+	 *
+	 * @param repository repository to read commits from.
+	 * @param path path of a file or directory, relative to the root tree.
+	 * @param from full-length ids of the commits to start from.
+	 * @param limit maximum number of commits to list, 0 for all.
+	 * @return Ids of the commits.
+	 * @throws Exception
+	 */
+	std::vector<OId> history(const Repository& repository, const std::string& path, const std::vector<OId>& from, size_t limit = 0) const;
+
+private:
+	ChangedPathFilters(const ChangedPathFilters&) = delete;
+	ChangedPathFilters& operator=(const ChangedPathFilters&) = delete;
+
+	void load();
+	uint32_t position(const OId& commit) const;
+	void filter(uint32_t pos, const unsigned char*& data, size_t& size) const;
+
+	std::string _objectsDir;
+	void* _map;
+	size_t _mapSize;
+	uint32_t _count;
+	const unsigned char* _oids;
+	const unsigned char* _offsets;
+	const unsigned char* _data;
+};
+
+} // namespace git2
+#endif // _GIT2PP_CHANGEDPATHS_HPP_
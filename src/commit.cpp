@@ -24,6 +24,7 @@
 #include "signature.hpp"
 #include "tree.hpp"
 
+#include <cstring>
 #include <string>
 #include <regex>
 
@@ -57,16 +58,55 @@ std::string Commit::message() const
 
 std::string Commit::shortMessage(size_t maxLen) const
 {
-	std::string msg = message().substr(0, maxLen);
-	size_t idx = msg.find_first_of("\r\n");
-	if(idx!=std::string::npos)
-	{
-		return msg.substr(0, idx);
-	}
-	else
+	return shortMessageView(maxLen).str();
+}
+
+StringView Commit::messageView() const
+{
+	return StringView(git_commit_message(data()));
+}
+
+StringView Commit::shortMessageView(size_t maxLen) const
+{
+	StringView msg = messageView().substr(0, maxLen);
+	return msg.substr(0, msg.find_first_of("\r\n"));
+}
+
+StringView Commit::summary() const
+{
+	return summary(messageView());
+}
+
+StringView Commit::summary(StringView message)
+{
+	static const char blanks[] = " \t\r";
+	size_t begin = 0, end = 0, pos = 0;
+	bool started = false;
+	while(pos<message.size())
 	{
-		return msg;
+		size_t eol = message.find('\n', pos);
+		size_t next = eol==StringView::npos ? message.size() : eol + 1;
+		size_t last = eol==StringView::npos ? message.size() : eol;
+		// Right trim the line.
+		while(last>pos && std::strchr(blanks, message[last-1])!=NULL)
+			--last;
+		bool blank = true;
+		for(size_t n=pos; n<last && blank; ++n)
+			blank = std::strchr(blanks, message[n])!=NULL;
+		if(!blank)
+		{
+			if(!started)
+			{
+				begin = pos;
+				started = true;
+			}
+			end = last;
+		}
+		else if(started)
+			break;
+		pos = next;
 	}
+	return message.substr(begin, end - begin);
 }
 
 std::string Commit::messageEncoding() const
@@ -24,6 +24,7 @@
 
 #include "common.hpp"
 #include "object.hpp"
+#include "stringview.hpp"
 
 namespace git2
 {
@@ -85,6 +86,36 @@ public:
      */
     std::string shortMessage(size_t maxLen = 80) const;
 
+	/**
+	 * Get a view of the full message of a commit.
+	 * The view is valid as long as this commit.
+	 */
+	StringView messageView() const;
+
+	/**
+	 * Get a view of the short commit message, without copy.
+	 * @see shortMessage()
+	 */
+	StringView shortMessageView(size_t maxLen = 80) const;
+
+	/**
+	 * Get a view of the summary of the commit message.
+	 * @see summary(StringView)
+	 */
+	StringView summary() const;
+
+	/**
+	 * Extract the summary of a commit message.
+	 *
+	 * The summary is the first paragraph of the message, leading blank
+	 * lines and trailing whitespaces excluded. Unlike git, line breaks
+	 * inside the paragraph are kept, as the view is not copied.
+	 *
+	 * @param message commit message.
+	 * @return View over the summary, inside message.
+	 */
+	static StringView summary(StringView message);
+
 	/**
 	 * Get the encoding for the message of a commit,
 	 * as a string representing a standard encoding name.
@@ -0,0 +1,619 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "commitgraph.hpp"
+
+#include "commit.hpp"
+#include "exception.hpp"
+#include "oidmap.hpp"
+#include "repository.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace git2
+{
+
+//
+// Layer file format, all integers are big-endian:
+//   header    "G2CG", version, commit count, extra parent count (4 x 4 bytes)
+//   fanout    256 x 4 bytes, number of commits with a first byte lower or equal
+//   oids      commit count x 20 bytes, sorted
+//   records   commit count x 40 bytes: tree id (20), first parent (4),
+//             second parent (4), generation (4), commit time (8)
+//   extra     extra parent count x 4 bytes
+//
+// Parents are graph positions. A second parent with the ExtraEdge bit set
+// is an index in the extra table, where the parents of octopus merges
+// from the second one are listed, the last one having the ExtraEdge bit.
+//
+
+static const char GraphMagic[4] = {'G', '2', 'C', 'G'};
+static const uint32_t GraphVersion = 1;
+static const size_t HeaderSize = 16;
+static const size_t FanoutSize = 256 * 4;
+static const size_t RecordSize = 40;
+static const uint32_t ParentNone = 0x70000000;
+static const uint32_t ExtraEdge = 0x80000000;
+
+static const char GraphDir[] = "/info/git2pp-graphs";
+static const char ChainFile[] = "/graph-chain";
+
+static uint32_t read_be32(const unsigned char* buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+static uint64_t read_be64(const unsigned char* buffer)
+{
+	return ((uint64_t)read_be32(buffer) << 32) | read_be32(buffer + 4);
+}
+
+static void write_be32(std::vector<unsigned char>& buffer, uint32_t value)
+{
+	buffer.push_back((unsigned char)(value >> 24));
+	buffer.push_back((unsigned char)(value >> 16));
+	buffer.push_back((unsigned char)(value >> 8));
+	buffer.push_back((unsigned char)value);
+}
+
+static void write_be64(std::vector<unsigned char>& buffer, uint64_t value)
+{
+	write_be32(buffer, (uint32_t)(value >> 32));
+	write_be32(buffer, (uint32_t)value);
+}
+
+// Write a file under a temporary name then move it in place.
+static void write_file(const std::string& path, const void* data, size_t size)
+{
+	std::string tmp = path + ".lock";
+	std::FILE* file = std::fopen(tmp.c_str(), "wb");
+	bool ok = file!=NULL && std::fwrite(data, 1, size, file)==size;
+	if(file!=NULL)
+		ok = (std::fclose(file)==0) && ok;
+	if(!ok || std::rename(tmp.c_str(), path.c_str())!=0)
+	{
+		std::remove(tmp.c_str());
+		giterr_set_str(GITERR_OS, ("Unable to write commit graph file " + path).c_str());
+		throw Exception(GIT_ERROR);
+	}
+}
+
+
+CommitGraph::CommitGraph(const std::string& objectsDir):
+_objectsDir(objectsDir),
+_size(0)
+{
+	while(_objectsDir.size()>1 && _objectsDir[_objectsDir.size()-1]=='/')
+		_objectsDir.erase(_objectsDir.size()-1);
+	load();
+}
+
+CommitGraph::~CommitGraph()
+{
+	for(Layer& layer : _layers)
+		munmap(layer.map, layer.mapSize);
+}
+
+const std::string& CommitGraph::objectsDir() const
+{
+	return _objectsDir;
+}
+
+size_t CommitGraph::size() const
+{
+	return _size;
+}
+
+bool CommitGraph::empty() const
+{
+	return _size==0;
+}
+
+void CommitGraph::load()
+{
+	std::ifstream chain((_objectsDir + GraphDir + ChainFile).c_str());
+	std::string name;
+	while(std::getline(chain, name))
+	{
+		if(name.empty())
+			continue;
+		Layer layer;
+		layer.name = name;
+		layer.base = (uint32_t)_size;
+		// Next layers refer to this one, they are unusable without it.
+		if(!mapLayer(layer))
+			break;
+		_layers.push_back(layer);
+		_size += layer.count;
+	}
+}
+
+bool CommitGraph::mapLayer(Layer& layer)
+{
+	int fd = open((_objectsDir + GraphDir + "/" + layer.name).c_str(), O_RDONLY);
+	if(fd<0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st)!=0 || (size_t)st.st_size<HeaderSize+FanoutSize)
+	{
+		close(fd);
+		return false;
+	}
+	layer.mapSize = (size_t)st.st_size;
+	layer.map = mmap(NULL, layer.mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(layer.map==MAP_FAILED)
+		return false;
+
+	const unsigned char* data = (const unsigned char*)layer.map;
+	layer.count = read_be32(data + 8);
+	layer.extraCount = read_be32(data + 12);
+	layer.fanout = data + HeaderSize;
+	layer.oids = layer.fanout + FanoutSize;
+	layer.records = layer.oids + (size_t)layer.count * GIT_OID_RAWSZ;
+	layer.extra = layer.records + (size_t)layer.count * RecordSize;
+	if(std::memcmp(data, GraphMagic, 4)!=0 || read_be32(data + 4)!=GraphVersion
+		|| layer.mapSize!=HeaderSize + FanoutSize + (size_t)layer.count*(GIT_OID_RAWSZ + RecordSize) + (size_t)layer.extraCount*4
+		|| read_be32(layer.fanout + 255*4)!=layer.count)
+	{
+		munmap(layer.map, layer.mapSize);
+		return false;
+	}
+	return true;
+}
+
+const CommitGraph::Layer& CommitGraph::layerOf(uint32_t pos) const
+{
+	size_t n = _layers.size() - 1;
+	while(_layers[n].base > pos)
+		--n;
+	return _layers[n];
+}
+
+const unsigned char* CommitGraph::record(uint32_t pos) const
+{
+	const Layer& layer = layerOf(pos);
+	return layer.records + (size_t)(pos - layer.base) * RecordSize;
+}
+
+uint32_t CommitGraph::position(const OId& oid) const
+{
+	const unsigned char* key = oid.raw();
+	for(const Layer& layer : _layers)
+	{
+		uint32_t first = key[0]==0 ? 0 : read_be32(layer.fanout + (key[0]-1)*4);
+		uint32_t last = read_be32(layer.fanout + key[0]*4);
+		while(first<last)
+		{
+			uint32_t middle = first + (last - first) / 2;
+			int cmp = std::memcmp(layer.oids + (size_t)middle*GIT_OID_RAWSZ, key, GIT_OID_RAWSZ);
+			if(cmp==0)
+				return layer.base + middle;
+			if(cmp<0)
+				first = middle + 1;
+			else
+				last = middle;
+		}
+	}
+	return NoPosition;
+}
+
+OId CommitGraph::oid(uint32_t pos) const
+{
+	const Layer& layer = layerOf(pos);
+	return OId(reinterpret_cast<const git_oid*>(layer.oids + (size_t)(pos - layer.base) * GIT_OID_RAWSZ));
+}
+
+OId CommitGraph::treeId(uint32_t pos) const
+{
+	return OId(reinterpret_cast<const git_oid*>(record(pos)));
+}
+
+git_time_t CommitGraph::time(uint32_t pos) const
+{
+	return (git_time_t)read_be64(record(pos) + 32);
+}
+
+uint32_t CommitGraph::generation(uint32_t pos) const
+{
+	return read_be32(record(pos) + 28);
+}
+
+void CommitGraph::parents(uint32_t pos, std::vector<uint32_t>& parents) const
+{
+	parents.clear();
+	const Layer& layer = layerOf(pos);
+	const unsigned char* rec = layer.records + (size_t)(pos - layer.base) * RecordSize;
+	uint32_t first = read_be32(rec + 20), second = read_be32(rec + 24);
+	if(first==ParentNone)
+		return;
+	parents.push_back(first);
+	if(second==ParentNone)
+		return;
+	if((second & ExtraEdge)==0)
+	{
+		parents.push_back(second);
+		return;
+	}
+	for(uint32_t n = second & ~ExtraEdge; n<layer.extraCount; ++n)
+	{
+		uint32_t edge = read_be32(layer.extra + (size_t)n*4);
+		parents.push_back(edge & ~ExtraEdge);
+		if(edge & ExtraEdge)
+			break;
+	}
+}
+
+template<typename Visitor>
+void CommitGraph::paint(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second, Visitor visit) const
+{
+	enum { First = 1, Second = 2, Both = 3, Queued = 4 };
+
+	// Parents always have a lower generation than their children, so a
+	// commit popped by decreasing generation has received the flags of
+	// all its descendants. The walk stops once only commits reachable
+	// from both sets remain queued.
+	std::unordered_map<uint32_t, unsigned char> state;
+	std::priority_queue<std::pair<uint32_t, uint32_t>> queue;
+	size_t interesting = 0;
+
+	auto add = [&](uint32_t pos, unsigned char flags)
+	{
+		unsigned char& s = state[pos];
+		unsigned char old = s;
+		s |= flags;
+		if((old & Queued)==0)
+		{
+			if(old!=0)
+				return; // Already visited.
+			s |= Queued;
+			queue.push(std::make_pair(generation(pos), pos));
+			if((s & Both)!=Both)
+				++interesting;
+		}
+		else if((old & Both)!=Both && (s & Both)==Both)
+			--interesting;
+	};
+
+	for(uint32_t pos : first)
+		add(pos, First);
+	for(uint32_t pos : second)
+		add(pos, Second);
+
+	std::vector<uint32_t> parents;
+	while(interesting>0)
+	{
+		uint32_t pos = queue.top().second;
+		queue.pop();
+		unsigned char& s = state[pos];
+		s &= ~Queued;
+		unsigned char flags = s & Both;
+		if(flags!=Both)
+		{
+			--interesting;
+			visit(pos, flags);
+		}
+		this->parents(pos, parents);
+		for(uint32_t parent : parents)
+			add(parent, flags);
+	}
+}
+
+std::pair<size_t, size_t> CommitGraph::aheadBehind(uint32_t local, uint32_t upstream) const
+{
+	std::pair<size_t, size_t> res(0, 0);
+	paint(std::vector<uint32_t>(1, local), std::vector<uint32_t>(1, upstream), [&](uint32_t, unsigned char flags)
+	{
+		if(flags==1)
+			++res.first;
+		else
+			++res.second;
+	});
+	return res;
+}
+
+std::vector<uint32_t> CommitGraph::mergeBases(uint32_t one, const std::vector<uint32_t>& others) const
+{
+	enum { First = 1, Second = 2, Both = 3, Stale = 4, Queued = 8 };
+
+	std::vector<uint32_t> bases;
+	if(std::find(others.begin(), others.end(), one)!=others.end())
+	{
+		bases.push_back(one);
+		return bases;
+	}
+
+	// A commit is popped after all its descendants, with all their flags.
+	// The first commits reached from both sides are the merge bases, their
+	// ancestors are stale and the walk stops when only stale ones remain.
+	std::unordered_map<uint32_t, unsigned char> state;
+	std::priority_queue<std::pair<uint32_t, uint32_t>> queue;
+	size_t active = 0;
+
+	auto add = [&](uint32_t pos, unsigned char flags)
+	{
+		unsigned char& s = state[pos];
+		if((s & flags)==flags)
+			return;
+		bool wasActive = (s & (Queued|Stale))==Queued;
+		if(s==0)
+		{
+			s |= Queued;
+			queue.push(std::make_pair(generation(pos), pos));
+		}
+		s |= flags;
+		bool isActive = (s & (Queued|Stale))==Queued;
+		active += (size_t)isActive - (size_t)wasActive;
+	};
+
+	add(one, First);
+	for(uint32_t pos : others)
+		add(pos, Second);
+
+	std::vector<uint32_t> parents;
+	while(active>0)
+	{
+		uint32_t pos = queue.top().second;
+		queue.pop();
+		unsigned char& s = state[pos];
+		if((s & Stale)==0)
+			--active;
+		s &= ~Queued;
+		unsigned char flags = s & (Both|Stale);
+		if(flags==Both)
+		{
+			bases.push_back(pos);
+			flags |= Stale;
+		}
+		this->parents(pos, parents);
+		for(uint32_t parent : parents)
+			add(parent, flags);
+	}
+	return bases;
+}
+
+std::vector<uint32_t> CommitGraph::walk(const std::vector<uint32_t>& pushed, const std::vector<uint32_t>& hidden, unsigned int sorting) const
+{
+	std::vector<uint32_t> commits;
+	paint(pushed, hidden, [&](uint32_t pos, unsigned char flags)
+	{
+		if(flags==1)
+			commits.push_back(pos);
+	});
+
+	if((sorting & GIT_SORT_TIME) && (sorting & GIT_SORT_TOPOLOGICAL))
+	{
+		// Newest commit first among the ones whose children are all out.
+		std::unordered_map<uint32_t, uint32_t> children;
+		std::vector<uint32_t> parents;
+		for(uint32_t pos : commits)
+			children[pos];
+		for(uint32_t pos : commits)
+		{
+			this->parents(pos, parents);
+			for(uint32_t parent : parents)
+			{
+				std::unordered_map<uint32_t, uint32_t>::iterator it = children.find(parent);
+				if(it!=children.end())
+					++it->second;
+			}
+		}
+		std::priority_queue<std::pair<git_time_t, uint32_t>> ready;
+		for(uint32_t pos : commits)
+		{
+			if(children[pos]==0)
+				ready.push(std::make_pair(time(pos), pos));
+		}
+		commits.clear();
+		while(!ready.empty())
+		{
+			uint32_t pos = ready.top().second;
+			ready.pop();
+			commits.push_back(pos);
+			this->parents(pos, parents);
+			for(uint32_t parent : parents)
+			{
+				std::unordered_map<uint32_t, uint32_t>::iterator it = children.find(parent);
+				if(it!=children.end() && --it->second==0)
+					ready.push(std::make_pair(time(parent), parent));
+			}
+		}
+	}
+	else if(sorting & GIT_SORT_TIME)
+	{
+		std::stable_sort(commits.begin(), commits.end(), [this](uint32_t a, uint32_t b)
+		{
+			return time(a) > time(b);
+		});
+	}
+
+	if(sorting & GIT_SORT_REVERSE)
+		std::reverse(commits.begin(), commits.end());
+	return commits;
+}
+
+size_t CommitGraph::append(const Repository& repository, const std::vector<OId>& tips) const
+{
+	struct NewCommit
+	{
+		git_oid oid;
+		git_oid tree;
+		git_time_t time;
+		std::vector<OId> parents;
+	};
+
+	// Read the missing commits, a generation of parents at a time.
+	std::vector<NewCommit> commits;
+	OIdSet seen;
+	std::vector<OId> frontier;
+	for(const OId& tip : tips)
+	{
+		if(position(tip)==NoPosition && seen.insert(tip))
+			frontier.push_back(tip);
+	}
+	while(!frontier.empty())
+	{
+		std::vector<Commit> found = repository.lookupCommits(frontier);
+		std::vector<OId> next;
+		for(size_t n=0; n<found.size(); ++n)
+		{
+			if(found[n].isNull())
+			{
+				giterr_set_str(GITERR_ODB, ("Commit " + frontier[n].format() + " not found while writing the commit graph").c_str());
+				throw Exception(GIT_ENOTFOUND);
+			}
+			const git_commit* commit = found[n].data();
+			NewCommit c;
+			c.oid = *frontier[n].constData();
+			c.tree = *git_commit_tree_id(commit);
+			c.time = git_commit_time(commit);
+			unsigned int count = git_commit_parentcount(commit);
+			for(unsigned int p=0; p<count; ++p)
+			{
+				OId parent(git_commit_parent_id(commit, p));
+				c.parents.push_back(parent);
+				if(position(parent)==NoPosition && seen.insert(parent))
+					next.push_back(parent);
+			}
+			commits.push_back(c);
+		}
+		frontier.swap(next);
+	}
+	if(commits.empty())
+		return 0;
+
+	std::sort(commits.begin(), commits.end(), [](const NewCommit& a, const NewCommit& b)
+	{
+		return std::memcmp(a.oid.id, b.oid.id, GIT_OID_RAWSZ) < 0;
+	});
+	OIdMap<uint32_t> index;
+	index.reserve(commits.size());
+	for(size_t n=0; n<commits.size(); ++n)
+		index.insert(OId(&commits[n].oid), (uint32_t)(_size + n));
+
+	// Parent positions, and generations computed parents first.
+	std::vector<std::vector<uint32_t>> parents(commits.size());
+	for(size_t n=0; n<commits.size(); ++n)
+	{
+		for(const OId& parent : commits[n].parents)
+		{
+			const uint32_t* pos = index.find(parent);
+			parents[n].push_back(pos!=nullptr ? *pos : position(parent));
+		}
+	}
+	std::vector<uint32_t> generations(commits.size(), 0);
+	std::vector<size_t> stack;
+	for(size_t n=0; n<commits.size(); ++n)
+	{
+		if(generations[n]!=0)
+			continue;
+		stack.push_back(n);
+		while(!stack.empty())
+		{
+			size_t current = stack.back();
+			uint32_t generation = 1;
+			bool ready = true;
+			for(uint32_t parent : parents[current])
+			{
+				if(parent < _size)
+					generation = std::max(generation, this->generation(parent) + 1);
+				else if(generations[parent - _size]!=0)
+					generation = std::max(generation, generations[parent - _size] + 1);
+				else
+				{
+					stack.push_back(parent - _size);
+					ready = false;
+				}
+			}
+			if(ready)
+			{
+				generations[current] = generation;
+				stack.pop_back();
+			}
+		}
+	}
+
+	// Serialize the layer.
+	std::vector<unsigned char> buffer(GraphMagic, GraphMagic + 4);
+	std::vector<unsigned char> extra;
+	uint32_t extraCount = 0;
+	write_be32(buffer, GraphVersion);
+	write_be32(buffer, (uint32_t)commits.size());
+	write_be32(buffer, 0); // Extra count, patched below.
+	size_t pos = 0;
+	for(unsigned int b=0; b<256; ++b)
+	{
+		while(pos<commits.size() && commits[pos].oid.id[0]==b)
+			++pos;
+		write_be32(buffer, (uint32_t)pos);
+	}
+	for(const NewCommit& c : commits)
+		buffer.insert(buffer.end(), c.oid.id, c.oid.id + GIT_OID_RAWSZ);
+	for(size_t n=0; n<commits.size(); ++n)
+	{
+		const std::vector<uint32_t>& p = parents[n];
+		buffer.insert(buffer.end(), commits[n].tree.id, commits[n].tree.id + GIT_OID_RAWSZ);
+		write_be32(buffer, p.empty() ? ParentNone : p[0]);
+		if(p.size()<=2)
+			write_be32(buffer, p.size()<2 ? ParentNone : p[1]);
+		else
+		{
+			write_be32(buffer, ExtraEdge | extraCount);
+			for(size_t e=1; e<p.size(); ++e, ++extraCount)
+				write_be32(extra, p[e] | (e+1==p.size() ? ExtraEdge : 0));
+		}
+		write_be32(buffer, generations[n]);
+		write_be64(buffer, (uint64_t)commits[n].time);
+	}
+	buffer.insert(buffer.end(), extra.begin(), extra.end());
+	buffer[12] = (unsigned char)(extraCount >> 24);
+	buffer[13] = (unsigned char)(extraCount >> 16);
+	buffer[14] = (unsigned char)(extraCount >> 8);
+	buffer[15] = (unsigned char)extraCount;
+
+	// Layers are named after their content, then chained after the layers
+	// of this snapshot, which its positions refer to.
+	git_oid hash;
+	Exception::git2_assert(git_odb_hash(&hash, &buffer[0], buffer.size(), GIT_OBJ_BLOB));
+	std::string dir = _objectsDir + GraphDir;
+	mkdir((_objectsDir + "/info").c_str(), 0777);
+	mkdir(dir.c_str(), 0777);
+	std::string name = "graph-" + OId(&hash).format() + ".g2cg";
+	write_file(dir + "/" + name, &buffer[0], buffer.size());
+
+	std::string chain;
+	for(const Layer& layer : _layers)
+		chain += layer.name + "\n";
+	chain += name + "\n";
+	write_file(dir + ChainFile, chain.data(), chain.size());
+
+	return commits.size();
+}
+
+} // namespace git2
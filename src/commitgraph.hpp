@@ -0,0 +1,210 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_COMMITGRAPH_HPP_
+#define _GIT2PP_COMMITGRAPH_HPP_
+
+#include <git2.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "oid.hpp"
+
+namespace git2
+{
+
+class Repository;
+
+/**
+ * Memory-mapped commit graph of a repository.
+ *
+ * The graph stores, for each commit, its parents as dense positions, its
+ * root tree id, its commit time and its generation number (one more than
+ * the highest generation of its parents, 1 for root commits).
+ * Walking the graph does not need to inflate nor parse commit objects.
+ *
+ * The graph is made of a chain of immutable layer files, stored in the
+ * "info/git2pp-graphs" directory of the objects directory. Each layer
+ * holds commits sorted by id and only refers to commits of its own layer
+ * or of previous ones. append() writes a new layer with the commits which
+ * are not in the graph yet, positions of existing commits never change.
+ *
+ * An instance is a read-only snapshot and is safe to share between threads.
+ */
+class CommitGraph
+{
+public:
+	/** Position returned for commits which are not in the graph. */
+	static const uint32_t NoPosition = 0xFFFFFFFF;
+
+	/**
+	 * Open the graph of an objects directory.
+	 * The graph is empty if no graph was written yet.
+	 *
+	 * @param objectsDir path to the "objects" directory.
+	 */
+	CommitGraph(const std::string& objectsDir);
+
+	~CommitGraph();
+
+	/**
+	 * Objects directory of this graph.
+	 */
+	const std::string& objectsDir() const;
+
+	/**
+	 * Number of commits in the graph.
+	 */
+	size_t size() const;
+
+	/**
+	 * Check if the graph has no commit.
+	 */
+	bool empty() const;
+
+	/**
+	 * Get the position of a commit.
+	 *
+	 * @param oid full-length commit id.
+	 * @return Position of the commit, NoPosition if not in the graph.
+	 */
+	uint32_t position(const OId& oid) const;
+
+	/**
+	 * Id of the commit at a position.
+	 */
+	OId oid(uint32_t pos) const;
+
+	/**
+	 * Id of the root tree of the commit at a position.
+	 */
+	OId treeId(uint32_t pos) const;
+
+	/**
+	 * Commit time of the commit at a position.
+	 */
+	git_time_t time(uint32_t pos) const;
+
+	/**
+	 * Generation number of the commit at a position.
+	 */
+	uint32_t generation(uint32_t pos) const;
+
+	/**
+	 * Get the parent positions of the commit at a position.
+	 *
+	 * @param pos position of the commit.
+	 * @param parents filled with the parent positions, in commit order.
+	 */
+	void parents(uint32_t pos, std::vector<uint32_t>& parents) const;
+
+	/**
+	 * Count the commits reachable from a commit but not from another one.
+	 *
+	 * @param local position of the local commit.
+	 * @param upstream position of the upstream commit.
+	 * @return Number of commits only reachable from local, and only from upstream.
+	 */
+	std::pair<size_t, size_t> aheadBehind(uint32_t local, uint32_t upstream) const;
+
+	/**
+	 * Find the best common ancestors of a commit and of a set of commits,
+	 * like `git merge-base --all one others...`.
+	 *
+	 * Commits are painted down by decreasing generation number, so a
+	 * common ancestor is only reported when no descendant of it is, and
+	 * the walk stops once every queued commit is below a reported one.
+	 *
+	 * @param one position of the first commit.
+	 * @param others positions of the other commits.
+	 * @return Positions of the merge bases, by decreasing generation number.
+	 */
+	std::vector<uint32_t> mergeBases(uint32_t one, const std::vector<uint32_t>& others) const;
+
+	/**
+	 * List the commits reachable from some commits but not from others.
+	 *
+	 * Without sorting, or with topological sorting only, commits come by
+	 * decreasing generation number, parents after all their children.
+	 *
+	 * @param pushed positions of the commits to start from.
+	 * @param hidden positions of the commits to hide with their ancestors.
+	 * @param sorting combination of git_sort_t flags.
+	 * @return Positions of the walked commits.
+	 */
+	std::vector<uint32_t> walk(const std::vector<uint32_t>& pushed, const std::vector<uint32_t>& hidden, unsigned int sorting) const;
+
+	/**
+	 * Append the commits reachable from some tips as a new layer.
+	 *
+	 * Only commits which are not in this graph are read and written.
+	 * This instance is not modified, open the graph again to see the new
+	 * layer.
+	 *
+	 * @param repository repository to read commits from.
+	 * @param tips full-length ids of the commits to start from.
+	 * @return Number of appended commits.
+	 * @throws Exception
+	 */
+	size_t append(const Repository& repository, const std::vector<OId>& tips) const;
+
+private:
+	CommitGraph(const CommitGraph&) = delete;
+	CommitGraph& operator=(const CommitGraph&) = delete;
+
+	/**
+	 * A mapped layer file.
+	 */
+	struct Layer
+	{
+		std::string name;
+		void* map;
+		size_t mapSize;
+		uint32_t base;
+		uint32_t count;
+		uint32_t extraCount;
+		const unsigned char* fanout;
+		const unsigned char* oids;
+		const unsigned char* records;
+		const unsigned char* extra;
+	};
+
+	void load();
+	bool mapLayer(Layer& layer);
+	const Layer& layerOf(uint32_t pos) const;
+	const unsigned char* record(uint32_t pos) const;
+
+	/**
+	 * Visit the ancestors of two sets of commits by decreasing generation,
+	 * calling visit(pos, flags) for each commit reachable from only one of
+	 * them, flags being 1 for the first set and 2 for the second one.
+	 */
+	template<typename Visitor>
+	void paint(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second, Visitor visit) const;
+
+	std::string _objectsDir;
+	std::vector<Layer> _layers;
+	size_t _size;
+};
+
+} // namespace git2
+#endif // _GIT2PP_COMMITGRAPH_HPP_
@@ -64,6 +64,7 @@ public:
 
 	Git2PtrWrapper(){}
 	Git2PtrWrapper(_Type* ptr):_ptr(ptr, _Deleter){} // Todo protect deleter from null pointer
+	Git2PtrWrapper(const _PtrType& ptr):_ptr(ptr){}
 	Git2PtrWrapper(const _Class& other):_ptr(other._ptr){}
 	~Git2PtrWrapper(){}
 
@@ -22,6 +22,24 @@
 #include <git2/odb_backend.h>
 
 #include "exception.hpp"
+#include "looseobject.hpp"
+#include "oidindex.hpp"
+#include "parallel.hpp"
+#include "sha1.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <new>
+
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace git2
 {
@@ -36,7 +54,8 @@ _dbb(dbb)
 {
 }
 
-DatabaseBackend::DatabaseBackend(const DatabaseBackend&)
+DatabaseBackend::DatabaseBackend(const DatabaseBackend& other):
+_dbb(other._dbb)
 {
 }
 
@@ -76,6 +95,258 @@ const git_odb_backend* DatabaseBackend::constData() const
     return _dbb;
 }
 
+//
+// DatabaseBackendObject
+//
+
+DatabaseBackendObject::DatabaseBackendObject(git_odb_backend* backend):
+_backend(backend),
+_data(NULL),
+_size(0),
+_type(GIT_OBJ_BAD)
+{
+}
+
+DatabaseBackendObject::~DatabaseBackendObject()
+{
+	// Memory from git_odb_backend_malloc is released with free().
+	std::free(_data);
+}
+
+void* DatabaseBackendObject::allocate(git_otype type, size_t size)
+{
+	std::free(_data);
+	// Allocate at least one byte, empty objects are valid.
+	_data = git_odb_backend_malloc(_backend, size>0 ? size : 1);
+	if(_data==NULL)
+		throw Exception(GIT_ERROR);
+	_size = size;
+	_type = type;
+	return _data;
+}
+
+void DatabaseBackendObject::assign(git_otype type, const void* data, size_t size)
+{
+	std::memcpy(allocate(type, size), data, size);
+}
+
+git_otype DatabaseBackendObject::type() const
+{
+	return _type;
+}
+
+size_t DatabaseBackendObject::size() const
+{
+	return _size;
+}
+
+const void* DatabaseBackendObject::data() const
+{
+	return _data;
+}
+
+void* DatabaseBackendObject::release()
+{
+	void* data = _data;
+	_data = NULL;
+	return data;
+}
+
+//
+// CustomDatabaseBackend
+//
+
+namespace helper
+{
+
+/**
+ * C backend structure forwarding the libgit2 calls to a CustomDatabaseBackend.
+ */
+struct CustomBackendTrampoline
+{
+	git_odb_backend parent;
+	CustomDatabaseBackend* self;
+
+	static CustomDatabaseBackend* get(git_odb_backend* backend)
+	{
+		return reinterpret_cast<CustomBackendTrampoline*>(backend)->self;
+	}
+
+	// Run an operation, translating exceptions into libgit2 errors.
+	template<typename Operation>
+	static int guard(Operation operation)
+	{
+		try
+		{
+			return operation();
+		}
+		catch(const Exception& e)
+		{
+			giterr_set_str(GITERR_ODB, *e.what() ? e.what() : "Error in custom object database backend");
+			return e.err()<0 ? e.err() : GIT_ERROR;
+		}
+		catch(const std::bad_alloc&)
+		{
+			giterr_set_oom();
+			return GIT_ERROR;
+		}
+		catch(const std::exception& e)
+		{
+			giterr_set_str(GITERR_ODB, e.what());
+			return GIT_ERROR;
+		}
+		catch(...)
+		{
+			giterr_set_str(GITERR_ODB, "Unknown error in custom object database backend");
+			return GIT_ERROR;
+		}
+	}
+
+	static int read(void **buffer_p, size_t *len_p, git_otype *type_p, git_odb_backend *backend, const git_oid *oid)
+	{
+		return guard([&]()->int{
+			DatabaseBackendObject object(backend);
+			if(!get(backend)->read(OId(oid), object))
+				return GIT_ENOTFOUND;
+			*len_p = object.size();
+			*type_p = object.type();
+			*buffer_p = object.release();
+			return GIT_OK;
+		});
+	}
+
+	static int read_prefix(git_oid *out_oid, void **buffer_p, size_t *len_p, git_otype *type_p, git_odb_backend *backend, const git_oid *short_oid, size_t len)
+	{
+		return guard([&]()->int{
+			DatabaseBackendObject object(backend);
+			OId oid, prefix = OId::stringToOid(OId(short_oid).format().substr(0, len));
+			if(!get(backend)->readPrefix(prefix, oid, object))
+				return GIT_ENOTFOUND;
+			git_oid_cpy(out_oid, oid.constData());
+			*len_p = object.size();
+			*type_p = object.type();
+			*buffer_p = object.release();
+			return GIT_OK;
+		});
+	}
+
+	static int read_header(size_t *len_p, git_otype *type_p, git_odb_backend *backend, const git_oid *oid)
+	{
+		return guard([&]()->int{
+			ObjectHeader header;
+			if(!get(backend)->readHeader(OId(oid), header))
+				return GIT_ENOTFOUND;
+			*len_p = header.size();
+			*type_p = header.type();
+			return GIT_OK;
+		});
+	}
+
+	static int write(git_oid *oid, git_odb_backend *backend, const void *data, size_t len, git_otype type)
+	{
+		return guard([&]()->int{
+			Exception::git2_assert(git_odb_hash(oid, data, len, type));
+			get(backend)->write(OId(oid), data, len, type);
+			return GIT_OK;
+		});
+	}
+
+	static int exists(git_odb_backend *backend, const git_oid *oid)
+	{
+		int res = guard([&]()->int{
+			return get(backend)->exists(OId(oid)) ? 1 : 0;
+		});
+		return res>0 ? 1 : 0;
+	}
+
+	static int refresh(git_odb_backend *backend)
+	{
+		return guard([&]()->int{
+			get(backend)->refresh();
+			return GIT_OK;
+		});
+	}
+
+	static int foreach(git_odb_backend *backend, git_odb_foreach_cb cb, void *payload)
+	{
+		return guard([&]()->int{
+			bool stopped = get(backend)->foreach([&](const OId& oid)->bool{
+				return cb(oid.constData(), payload)==0;
+			});
+			return stopped ? GIT_EUSER : GIT_OK;
+		});
+	}
+
+	static void free(git_odb_backend *backend)
+	{
+		delete get(backend);
+	}
+};
+
+} // namespace helper
+
+static git_odb_backend* new_custom_backend(CustomDatabaseBackend* self)
+{
+	helper::CustomBackendTrampoline* trampoline = new helper::CustomBackendTrampoline;
+	std::memset(&trampoline->parent, 0, sizeof(trampoline->parent));
+	trampoline->parent.version = GIT_ODB_BACKEND_VERSION;
+	trampoline->parent.read = &helper::CustomBackendTrampoline::read;
+	trampoline->parent.read_prefix = &helper::CustomBackendTrampoline::read_prefix;
+	trampoline->parent.read_header = &helper::CustomBackendTrampoline::read_header;
+	trampoline->parent.write = &helper::CustomBackendTrampoline::write;
+	trampoline->parent.exists = &helper::CustomBackendTrampoline::exists;
+	trampoline->parent.refresh = &helper::CustomBackendTrampoline::refresh;
+	trampoline->parent.foreach = &helper::CustomBackendTrampoline::foreach;
+	trampoline->parent.free = &helper::CustomBackendTrampoline::free;
+	trampoline->self = self;
+	return &trampoline->parent;
+}
+
+CustomDatabaseBackend::CustomDatabaseBackend():
+DatabaseBackend(new_custom_backend(this))
+{
+}
+
+CustomDatabaseBackend::~CustomDatabaseBackend()
+{
+	delete reinterpret_cast<helper::CustomBackendTrampoline*>(data());
+}
+
+bool CustomDatabaseBackend::readPrefix(const OId&, OId&, DatabaseBackendObject&)
+{
+	return false;
+}
+
+bool CustomDatabaseBackend::readHeader(const OId& oid, ObjectHeader& header)
+{
+	DatabaseBackendObject object(data());
+	if(!read(oid, object))
+		return false;
+	header = ObjectHeader(object.type(), object.size());
+	return true;
+}
+
+void CustomDatabaseBackend::write(const OId&, const void*, size_t, git_otype)
+{
+	giterr_set_str(GITERR_ODB, "Object database backend is read-only");
+	throw Exception(GIT_ERROR);
+}
+
+bool CustomDatabaseBackend::exists(const OId& oid)
+{
+	ObjectHeader header;
+	return readHeader(oid, header);
+}
+
+bool CustomDatabaseBackend::foreach(std::function<bool(const OId&)>)
+{
+	return false;
+}
+
+void CustomDatabaseBackend::refresh()
+{
+}
+
 //
 // DatabaseObject
 //
@@ -126,9 +397,16 @@ _db(odb)
 {
 }
 
+Database::Database(git_odb *odb, const std::shared_ptr<ObjectIdIndex>& index):
+_db(odb),
+_index(index)
+{
+}
+
 Database::Database( const Database& db )
 {
     _db = db._db;
+    _index = db._index;
 }
 
 Database::~Database()
@@ -139,7 +417,7 @@ Database Database::open(const std::string& objectsDir)
 {
 	git_odb *db;
     Exception::git2_assert( git_odb_open(&db, objectsDir.c_str()) );
-    return Database(db);
+    return Database(db, std::make_shared<ObjectIdIndex>(objectsDir));
 }
 
 void Database::close()
@@ -150,21 +428,29 @@ void Database::close()
 void Database::refresh()
 {
 	Exception::git2_assert( git_odb_refresh(data()) );
+	if(_index)
+		_index->refresh();
 }
 
 void Database::addBackend(DatabaseBackend *backend, int priority)
 {
-    Exception::git2_assert( git_odb_add_backend(_db, (git_odb_backend *)backend, priority) );
+    Exception::git2_assert( git_odb_add_backend(_db, backend->data(), priority) );
+    if(_index)
+        _index->setPartial();
 }
 
 void Database::addAlternate(DatabaseBackend *backend, int priority)
 {
-    Exception::git2_assert( git_odb_add_alternate(_db, (git_odb_backend *)backend, priority) );
+    Exception::git2_assert( git_odb_add_alternate(_db, backend->data(), priority) );
+    if(_index)
+        _index->setPartial();
 }
 
 void Database::addDiskAlternate(const std::string& path)
 {
     Exception::git2_assert( git_odb_add_disk_alternate(_db, path.c_str()) );
+    if(_index)
+        _index->setPartial();
 }
 
 int Database::exists(const OId& id)
@@ -172,6 +458,93 @@ int Database::exists(const OId& id)
     return git_odb_exists(_db, id.constData());
 }
 
+std::vector<bool> Database::existsMany(const std::vector<OId>& oids) const
+{
+	if(_index)
+	{
+		std::vector<bool> found = _index->containsMany(oids);
+		// Added backends may have the objects missing from the directory.
+		if(_index->partial())
+		{
+			for(size_t n=0; n<oids.size(); ++n)
+			{
+				if(!found[n])
+					found[n] = git_odb_exists(_db, oids[n].constData())!=0;
+			}
+		}
+		return found;
+	}
+	std::vector<bool> found(oids.size(), false);
+	for(size_t n=0; n<oids.size(); ++n)
+		found[n] = git_odb_exists(_db, oids[n].constData())!=0;
+	return found;
+}
+
+bool Database::foreach(std::function<bool(const OId&)> callback) const
+{
+	int res = git_odb_foreach(_db, [](const git_oid* oid, void* payload)->int{
+			std::function<bool(const OId&)>& callback = *(std::function<bool(const OId&)>*)payload;
+			return callback(OId(oid)) ? 0 : 1;
+		}, (void*)&callback);
+	if(res==GIT_EUSER)
+		return true;
+	Exception::git2_assert(res);
+	return false;
+}
+
+bool Database::foreachParallel(std::function<bool(const OId&)> callback, unsigned int threadCount) const
+{
+	// Without a snapshot covering all the backends, ids are gathered by
+	// bucket first.
+	bool snapshot = _index && !_index->partial();
+	std::vector<std::vector<OId>> buckets;
+	if(snapshot)
+		_index->refresh();
+	else
+	{
+		buckets.resize(256);
+		foreach([&](const OId& oid){
+			buckets[oid.constData()->id[0]].push_back(oid);
+			return true;
+		});
+	}
+
+	std::atomic<bool> stopped(false);
+	helper::parallel_for(256, threadCount, [&](size_t first, unsigned int)
+		{
+			if(stopped)
+				return;
+			std::vector<OId> ids;
+			if(snapshot)
+				ids = _index->ids((unsigned char)first);
+			else
+			{
+				// Objects of several backends are listed once.
+				ids.swap(buckets[first]);
+				std::sort(ids.begin(), ids.end());
+				ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+			}
+			for(const OId& oid : ids)
+			{
+				if(stopped)
+					break;
+				if(!callback(oid))
+					stopped = true;
+			}
+		});
+	return stopped;
+}
+
+std::vector<int> Database::abbreviate(const std::vector<OId>& oids, int minLength)
+{
+	if(!_index)
+	{
+		giterr_set_str(GITERR_ODB, "Object database has no known objects directory to abbreviate ids");
+		throw Exception(GIT_ERROR);
+	}
+	return _index->abbreviate(oids, minLength);
+}
+
 size_t Database::getNumBackends()
 {
 	return git_odb_num_backends(data());
@@ -198,6 +571,129 @@ OId Database::hashFile(const std::string& path, git_otype type)
 	return OId(&oid);
 }
 
+// Deflate a buffer into out, zlib counts being 32-bit: input and output
+// are given by chunks. Returns false if zlib fails or out is too small.
+static bool deflate_buffer(z_stream& zs, const void* data, size_t size, bool finish, Bytef*& out, size_t& outLeft)
+{
+	static const size_t chunkSize = 0x40000000;
+	const Bytef* in = (const Bytef*)data;
+	for(;;)
+	{
+		size_t chunk = std::min(size, chunkSize);
+		uInt avail = (uInt)std::min(outLeft, chunkSize);
+		zs.next_in = (Bytef*)in;
+		zs.avail_in = (uInt)chunk;
+		zs.next_out = out;
+		zs.avail_out = avail;
+		int res = deflate(&zs, finish && chunk==size ? Z_FINISH : Z_NO_FLUSH);
+		size_t consumed = chunk - zs.avail_in, produced = avail - zs.avail_out;
+		in += consumed;
+		size -= consumed;
+		out += produced;
+		outLeft -= produced;
+		if(res==Z_STREAM_END)
+			return true;
+		if(res!=Z_OK && res!=Z_BUF_ERROR)
+			return false;
+		if(!finish && size==0)
+			return true;
+		if(consumed==0 && produced==0)
+			return false;
+	}
+}
+
+// Deflate streams of the threads of writeMany, created on first use.
+struct Deflaters
+{
+	Deflaters(unsigned int threads):
+	streams(threads),
+	ready(threads, 0),
+	buffers(threads)
+	{
+	}
+
+	~Deflaters()
+	{
+		for(size_t n=0; n<streams.size(); ++n)
+			if(ready[n])
+				deflateEnd(&streams[n]);
+	}
+
+	z_stream& stream(unsigned int worker)
+	{
+		z_stream& zs = streams[worker];
+		if(ready[worker])
+			deflateReset(&zs);
+		else if(deflateInit(&zs, Z_BEST_SPEED)==Z_OK)
+			ready[worker] = 1;
+		else
+		{
+			giterr_set_str(GITERR_ZLIB, "Failed to initialize compression");
+			throw Exception(GIT_ERROR);
+		}
+		return zs;
+	}
+
+	std::vector<z_stream> streams;
+	std::vector<char> ready;
+	std::vector<std::vector<unsigned char>> buffers;
+};
+
+std::vector<OId> Database::hashMany(const std::vector<ByteView>& contents, git_otype type, unsigned int threadCount)
+{
+	std::vector<OId> oids(contents.size());
+	helper::parallel_for(contents.size(), threadCount, [&](size_t n, unsigned int)
+		{
+			helper::Sha1 sha1;
+			sha1.updateObjectHeader(type, contents[n].size());
+			sha1.update(contents[n].data(), contents[n].size());
+			git_oid oid;
+			sha1.final(oid);
+			oids[n] = OId(&oid);
+		});
+	return oids;
+}
+
+std::vector<OId> Database::hashFiles(const std::vector<std::string>& paths, git_otype type, unsigned int threadCount)
+{
+	std::vector<OId> oids(paths.size());
+	helper::parallel_for(paths.size(), threadCount, [&](size_t n, unsigned int)
+		{
+			const std::string& path = paths[n];
+			int fd = ::open(path.c_str(), O_RDONLY);
+			struct stat st;
+			if(fd<0 || ::fstat(fd, &st)!=0)
+			{
+				if(fd>=0)
+					::close(fd);
+				giterr_set_str(GITERR_OS, ("Failed to open '" + path + "' for hashing").c_str());
+				throw Exception(GIT_ERROR);
+			}
+
+			helper::Sha1 sha1;
+			sha1.updateObjectHeader(type, (size_t)st.st_size);
+			unsigned char buffer[64*1024];
+			size_t total = 0;
+			ssize_t len;
+			while((len = ::read(fd, buffer, sizeof(buffer))) > 0)
+			{
+				sha1.update(buffer, (size_t)len);
+				total += (size_t)len;
+			}
+			::close(fd);
+			if(len<0 || total!=(size_t)st.st_size)
+			{
+				giterr_set_str(GITERR_OS, ("Failed to read '" + path + "' for hashing").c_str());
+				throw Exception(GIT_ERROR);
+			}
+
+			git_oid oid;
+			sha1.final(oid);
+			oids[n] = OId(&oid);
+		});
+	return oids;
+}
+
 DatabaseObject Database::read(OId oid)
 {
 	git_odb_object *obj;
@@ -205,6 +701,57 @@ DatabaseObject Database::read(OId oid)
 	return DatabaseObject(obj);
 }
 
+ObjectHeader Database::readHeader(const OId& oid) const
+{
+	size_t size = 0;
+	git_otype type = GIT_OBJ_BAD;
+	Exception::git2_assert(git_odb_read_header(&size, &type, data(), oid.constData()));
+	return ObjectHeader(type, size);
+}
+
+std::vector<ObjectHeader> Database::readHeaders(const std::vector<OId>& oids) const
+{
+	std::vector<ObjectHeader> headers(oids.size());
+	for(size_t n=0; n<oids.size(); ++n)
+	{
+		size_t size = 0;
+		git_otype type = GIT_OBJ_BAD;
+		if(git_odb_read_header(&size, &type, data(), oids[n].constData())==GIT_OK)
+			headers[n] = ObjectHeader(type, size);
+	}
+	giterr_clear();
+	return headers;
+}
+
+ObjectReadStream Database::openReadStream(const OId& oid) const
+{
+	return ObjectReadStream(*this, oid);
+}
+
+ObjectWriteStream Database::openWriteStream(size_t size, git_otype type) const
+{
+	return ObjectWriteStream(*this, size, type);
+}
+
+size_t Database::readInto(const OId& oid, void* buffer, size_t capacity) const
+{
+	ObjectReadStream stream(*this, oid);
+	if(stream.size()>capacity)
+	{
+		giterr_set_str(GITERR_INVALID, "Buffer is too small for the object content");
+		throw Exception(GIT_ERROR);
+	}
+	size_t len = 0;
+	while(size_t n = stream.read((char*)buffer + len, capacity - len))
+		len += n;
+	return len;
+}
+
+std::string Database::objectsDir() const
+{
+	return _index ? _index->objectsDir() : std::string();
+}
+
 OId Database::write(const void* data, size_t len, git_otype type)
 {
 	git_oid oid;
@@ -212,6 +759,61 @@ OId Database::write(const void* data, size_t len, git_otype type)
 	return OId(&oid);
 }
 
+std::vector<OId> Database::writeMany(const std::vector<ByteView>& contents, git_otype type, unsigned int threadCount, bool sync)
+{
+	std::string dir = objectsDir();
+	if(!isDirectoryOnly())
+	{
+		std::vector<OId> oids(contents.size());
+		for(size_t n=0; n<contents.size(); ++n)
+			oids[n] = write(contents[n].data(), contents[n].size(), type);
+		return oids;
+	}
+
+	// Objects the database already has, loose or packed, are not written again.
+	std::vector<OId> oids = hashMany(contents, type, threadCount);
+	std::vector<bool> present = existsMany(oids);
+
+	size_t missing = std::count(present.begin(), present.end(), false);
+	if(missing==0)
+		return oids;
+	unsigned int threads = helper::parallel_threads(missing, threadCount);
+	Deflaters deflaters(threads);
+	helper::parallel_for(contents.size(), threads, [&](size_t n, unsigned int worker)
+		{
+			if(present[n])
+				return;
+			const ByteView& content = contents[n];
+			char header[32];
+			size_t headerLen = helper::Sha1::formatObjectHeader(header, type, content.size());
+
+			z_stream& zs = deflaters.stream(worker);
+			std::vector<unsigned char>& deflated = deflaters.buffers[worker];
+			deflated.resize(deflateBound(&zs, headerLen + content.size()));
+			Bytef* out = deflated.data();
+			size_t outLeft = deflated.size();
+			if(!deflate_buffer(zs, header, headerLen, false, out, outLeft)
+				|| !deflate_buffer(zs, content.data(), content.size(), true, out, outLeft))
+			{
+				giterr_set_str(GITERR_ZLIB, "Failed to compress object");
+				throw Exception(GIT_ERROR);
+			}
+
+			helper::LooseObjectFile file(dir);
+			file.write(deflated.data(), out - deflated.data());
+			file.commit(*oids[n].constData());
+		});
+
+	if(sync)
+		helper::LooseObjectFile::sync(dir);
+	return oids;
+}
+
+
+bool Database::isDirectoryOnly() const
+{
+	return _index && !_index->partial();
+}
 
 git_odb* Database::data() const
 {
@@ -27,14 +27,21 @@
 
 #include "oid.hpp"
 #include "object.hpp"
+#include "objectstream.hpp"
+#include "stringview.hpp"
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace git2
 {
 
 class DatabaseBackend;
 class Database;
+class ObjectIdIndex;
 
 /**
  * Represents a Git object database backend.
@@ -45,7 +52,7 @@ public:
 	DatabaseBackend(git_odb_backend *dbb = NULL);
 	DatabaseBackend( const DatabaseBackend& dbb );
 
-	~DatabaseBackend();
+	virtual ~DatabaseBackend();
 
 	/**
 	 * Create a backend for loose objects.
@@ -119,6 +126,168 @@ public:
 
 };
 
+/**
+ * Type and size of an object, packed in 8 bytes.
+ */
+class ObjectHeader
+{
+public:
+	/**
+	 * Create an invalid header, for objects which were not found.
+	 */
+	ObjectHeader():_bits(0){}
+
+	ObjectHeader(git_otype type, size_t size):
+	_bits(((uint64_t)size & SizeMask) | ((uint64_t)(type>0 ? type : 0) << SizeBits)){}
+
+	/**
+	 * Check if the header was read.
+	 */
+	bool isValid() const {return _bits>>SizeBits != 0;}
+
+	/**
+	 * Type of the object, GIT_OBJ_BAD if not found.
+	 */
+	git_otype type() const {return isValid() ? (git_otype)(_bits>>SizeBits) : GIT_OBJ_BAD;}
+
+	/**
+	 * Size of the object content.
+	 */
+	size_t size() const {return (size_t)(_bits & SizeMask);}
+
+private:
+	static const int SizeBits = 60;
+	static const uint64_t SizeMask = ((uint64_t)1 << SizeBits) - 1;
+	uint64_t _bits;
+};
+
+/**
+ * Object content produced by a CustomDatabaseBackend read.
+ *
+ * The content is stored in memory allocated for libgit2, which takes it
+ * over once the read succeeded.
+ */
+class DatabaseBackendObject
+{
+public:
+	DatabaseBackendObject(git_odb_backend* backend);
+	~DatabaseBackendObject();
+
+	/**
+	 * Allocate the content of the object, to be filled by the caller.
+	 *
+	 * @param type type of the object.
+	 * @param size size of the content.
+	 * @return Buffer of size bytes.
+	 * @throws Exception
+	 */
+	void* allocate(git_otype type, size_t size);
+
+	/**
+	 * Copy the content of the object.
+	 * @throws Exception
+	 */
+	void assign(git_otype type, const void* data, size_t size);
+
+	git_otype type() const;
+	size_t size() const;
+	const void* data() const;
+
+	/**
+	 * Give up the ownership of the content.
+	 */
+	void* release();
+
+private:
+	DatabaseBackendObject(const DatabaseBackendObject&) = delete;
+	DatabaseBackendObject& operator=(const DatabaseBackendObject&) = delete;
+
+	git_odb_backend* _backend;
+	void* _data;
+	size_t _size;
+	git_otype _type;
+};
+
+/**
+ * Base class of object database backends implemented in C++.
+ *
+ * Subclasses implement read() and override the other operations they
+ * support. Exceptions thrown by the implementations are reported to
+ * libgit2 as errors: Exception with their code, others as GIT_ERROR.
+ *
+ * Once added to a Database with addBackend() or addAlternate(), the
+ * backend is owned by the database, which deletes it when freed, so it
+ * must be allocated with new.
+ */
+class CustomDatabaseBackend : public DatabaseBackend
+{
+public:
+	CustomDatabaseBackend();
+	virtual ~CustomDatabaseBackend();
+
+	/**
+	 * Read an object.
+	 *
+	 * @param oid full-length id of the object.
+	 * @param object where to store the object type and content.
+	 * @return False if the object is not in this backend.
+	 */
+	virtual bool read(const OId& oid, DatabaseBackendObject& object) = 0;
+
+	/**
+	 * Read an object from a shortened id.
+	 * Default implementation finds nothing.
+	 *
+	 * @param prefix shortened id of the object.
+	 * @param oid where to store the full-length id of the object.
+	 * @param object where to store the object type and content.
+	 * @return False if the object is not in this backend.
+	 * @throws Exception with GIT_EAMBIGUOUS if several objects match.
+	 */
+	virtual bool readPrefix(const OId& prefix, OId& oid, DatabaseBackendObject& object);
+
+	/**
+	 * Read the type and size of an object.
+	 * Default implementation reads the whole object.
+	 *
+	 * @return False if the object is not in this backend.
+	 */
+	virtual bool readHeader(const OId& oid, ObjectHeader& header);
+
+	/**
+	 * Store an object.
+	 * Default implementation throws, making the backend read-only.
+	 *
+	 * @param oid id of the object, already computed from its content.
+	 */
+	virtual void write(const OId& oid, const void* data, size_t size, git_otype type);
+
+	/**
+	 * Check if an object is in this backend.
+	 * Default implementation uses readHeader().
+	 */
+	virtual bool exists(const OId& oid);
+
+	/**
+	 * Call a function with the id of each object of this backend.
+	 * Default implementation lists nothing.
+	 *
+	 * @param callback returns false to stop iterating.
+	 * @return True if the iteration was stopped by the callback.
+	 */
+	virtual bool foreach(std::function<bool(const OId&)> callback);
+
+	/**
+	 * Reload the backend content, for newly added objects.
+	 * Default implementation does nothing.
+	 */
+	virtual void refresh();
+
+private:
+	CustomDatabaseBackend(const CustomDatabaseBackend&) = delete;
+	CustomDatabaseBackend& operator=(const CustomDatabaseBackend&) = delete;
+};
+
 /**
  * Represents a Git object database containing unique sha1 object ids.
  */
@@ -136,6 +305,14 @@ public:
     
     Database( git_odb *odb);
 
+    /**
+     * Wrap an object database with the id snapshot of its objects directory.
+     *
+     * @param odb the wrapped object database.
+     * @param index snapshot used by abbreviate(), shared with the caller.
+     */
+    Database( git_odb *odb, const std::shared_ptr<ObjectIdIndex>& index);
+
     Database( const Database& db );
 
     ~Database();
@@ -162,6 +339,9 @@ public:
     
     /**
      * Refresh the object database to load newly added files.
+     *
+     * The id snapshot used by abbreviate(), if any, is refreshed too:
+     * new packs are loaded and loose objects are rescanned.
      */
     void refresh();
 
@@ -169,8 +349,10 @@ public:
      * Add a custom backend to an existing Object DB
      *
      * Read <odb_backends.h> for more information.
+     * The database takes the ownership of the backend.
      *
-     * @param backend pointer to a databaseBackend instance
+     * @param backend pointer to a databaseBackend instance,
+     * or to a CustomDatabaseBackend subclass.
      */
     void addBackend(DatabaseBackend *backend, int priority);
 
@@ -214,7 +396,74 @@ public:
      */
     int exists(const OId& id);
 
-	// TODO implement foreach functions (git_odb_foreach)
+	/**
+	 * Determine which objects of a batch can be found in the object database.
+	 *
+	 * Databases opened from a directory or obtained from a Repository
+	 * answer from the objects directory and its alternates: ids are sorted
+	 * and merge-joined with the ids of the pack indexes, then the remaining
+	 * ones are looked for with one listing per loose fan-out directory.
+	 * Once a backend was added to one of these databases, with addBackend()
+	 * or an alternate, the ids not found on disk are checked with exists().
+	 * Other databases check each id with exists().
+	 *
+	 * @param oids full-length ids to search for.
+	 * @return One flag per id, in input order.
+	 */
+	std::vector<bool> existsMany(const std::vector<OId>& oids) const;
+
+	/**
+	 * Call a function with the id of each object of the database.
+	 *
+	 * Ids come from all the backends, an object stored by several of them
+	 * (both loose and packed for example) can be listed more than once.
+	 * Object contents are not read.
+	 *
+	 * @param callback returns false to stop iterating.
+	 * @return True if the iteration was stopped by the callback.
+	 * @throws Exception
+	 */
+	bool foreach(std::function<bool(const OId&)> callback) const;
+
+	/**
+	 * Call a function with the id of each object of the database, from
+	 * several threads.
+	 *
+	 * The id space is split in the 256 buckets of the first id byte, which
+	 * are spread over the threads. All the ids of a bucket are given by the
+	 * same thread, so callers can fill per-bucket results indexed by
+	 * `oid.constData()->id[0]` without locking. Other shared state must be
+	 * protected by the callback.
+	 *
+	 * Databases opened from a directory or obtained from a Repository list
+	 * the refreshed id snapshot of their objects directory (see
+	 * abbreviate()). Other databases, and these ones once a backend was
+	 * added to them (see existsMany()), gather the ids of their backends
+	 * on the calling thread first. Each object is listed once.
+	 * Object contents are not read.
+	 *
+	 * @param callback called concurrently, returns false to stop all threads.
+	 * @param threadCount number of threads, 0 for the number of cores.
+	 * @return True if the iteration was stopped by the callback.
+	 * @throws Exception, or the first exception thrown by the callback.
+	 */
+	bool foreachParallel(std::function<bool(const OId&)> callback, unsigned int threadCount = 0) const;
+
+	/**
+	 * Compute the minimal unique abbreviation lengths of a batch of ids.
+	 *
+	 * Lengths are computed against a sorted snapshot of all the object ids
+	 * of the database objects directory (packs and loose objects), which
+	 * is built on first call and updated by refresh().
+	 * Only available for databases opened from a directory or obtained
+	 * from a Repository.
+	 *
+	 * @param oids full-length ids to abbreviate.
+	 * @param minLength minimal length to return, at least GIT_OID_MINPREFIXLEN.
+	 * @return Lengths in hexadecimal digits, in input order.
+	 * @throws Exception
+	 */
+	std::vector<int> abbreviate(const std::vector<OId>& oids, int minLength = 7);
 	
 	/**
 	 * Get the number of ODB backend objects
@@ -253,6 +502,34 @@ public:
 	 * @param type the type of the object that will be hashed
 	 */
 	static OId hashFile(const std::string& path, git_otype type);
+
+	/**
+	 * Determine the object ids of many data buffers at once.
+	 *
+	 * Buffers are spread over several threads, each one hashed with the
+	 * processor SHA extensions when available. Ids are the ones hash()
+	 * gives.
+	 *
+	 * @param contents data to hash.
+	 * @param type type of the objects.
+	 * @param threadCount number of threads, 0 for the number of cores.
+	 * @return Ids of the objects, in input order.
+	 */
+	static std::vector<OId> hashMany(const std::vector<ByteView>& contents, git_otype type, unsigned int threadCount = 0);
+
+	/**
+	 * Determine the object ids of many files at once, without filters.
+	 *
+	 * Files are read and hashed by several threads, like hashMany().
+	 * Ids are the ones hashFile() gives.
+	 *
+	 * @param paths files to read.
+	 * @param type type of the objects.
+	 * @param threadCount number of threads, 0 for the number of cores.
+	 * @return Ids of the objects, in input order.
+	 * @throws Exception if a file cannot be read.
+	 */
+	static std::vector<OId> hashFiles(const std::vector<std::string>& paths, git_otype type, unsigned int threadCount = 0);
 	
 	
 
@@ -272,6 +549,79 @@ public:
 	 */
 	DatabaseObject read(OId oid);
 
+	/**
+	 * Read the type and size of an object without reading its content.
+	 *
+	 * Only the loose object prefix or the pack entry header (and the
+	 * headers of its delta bases) are parsed.
+	 *
+	 * @param oid identity of the object.
+	 * @return Header of the object.
+	 * @throws Exception if the object cannot be found.
+	 */
+	ObjectHeader readHeader(const OId& oid) const;
+
+	/**
+	 * Read the type and size of a batch of objects.
+	 *
+	 * @param oids identities of the objects.
+	 * @return Headers, in input order. Objects which cannot be found have
+	 * an invalid header instead of raising an exception.
+	 */
+	std::vector<ObjectHeader> readHeaders(const std::vector<OId>& oids) const;
+
+	/**
+	 * Open a sequential reader on the content of an object.
+	 *
+	 * Large objects can be read by chunks without being fully loaded.
+	 * @see ObjectReadStream
+	 *
+	 * @param oid full-length id of the object to read.
+	 * @throws Exception
+	 */
+	ObjectReadStream openReadStream(const OId& oid) const;
+
+	/**
+	 * Read the content of an object into a caller-provided buffer.
+	 *
+	 * Loose objects and packed objects stored without delta are inflated
+	 * directly into the buffer, without intermediate copy.
+	 *
+	 * @param oid full-length id of the object to read.
+	 * @param buffer where to store the content.
+	 * @param capacity size of the buffer, which must hold the whole content.
+	 * @return Size of the content.
+	 * @throws Exception if the object cannot be read or is larger than the buffer.
+	 */
+	size_t readInto(const OId& oid, void* buffer, size_t capacity) const;
+
+	/**
+	 * Open a sequential writer of a new object.
+	 *
+	 * Large objects are written by chunks without being fully loaded.
+	 * @see ObjectWriteStream
+	 *
+	 * @param size exact size of the object content.
+	 * @param type type of the object.
+	 * @throws Exception
+	 */
+	ObjectWriteStream openWriteStream(size_t size, git_otype type) const;
+
+	/**
+	 * Objects directory of this database.
+	 *
+	 * @return The directory, empty if the database was not opened from
+	 * a directory nor obtained from a Repository.
+	 */
+	std::string objectsDir() const;
+
+	/**
+	 * Check if the objects directory holds all the objects of this
+	 * database, which can then be written there directly: the database
+	 * has one and no backend was added to it (see existsMany()).
+	 */
+	bool isDirectoryOnly() const;
+
 	
 	/**
 	 * Write an object directly into the ODB
@@ -291,9 +641,30 @@ public:
 	 */
 	OId write(const void* data, size_t len, git_otype type);
 
+	/**
+	 * Write many objects of a same type at once.
+	 *
+	 * For databases with an objects directory and no added backend (see
+	 * isDirectoryOnly()), objects are hashed by several threads, checked
+	 * at once with existsMany(), then the missing ones are deflated and
+	 * written as loose object files by several threads. Other databases
+	 * write them one after the other with write(), which lets their
+	 * backends store them.
+	 *
+	 * @param contents contents of the objects.
+	 * @param type type of the objects.
+	 * @param threadCount number of threads, 0 for the number of cores.
+	 * @param sync flush the written files to the disk once, after the
+	 * last object, instead of after each object.
+	 * @return Ids of the objects, in input order.
+	 * @throws Exception
+	 */
+	std::vector<OId> writeMany(const std::vector<ByteView>& contents, git_otype type, unsigned int threadCount = 0, bool sync = false);
+
     git_odb* data() const;
 private:
     git_odb *_db;
+    std::shared_ptr<ObjectIdIndex> _index;
 };
 
 
@@ -26,20 +26,33 @@
 
 #include "git2pp/blob.hpp"
 #include "git2pp/branch.hpp"
+#include "git2pp/changedpaths.hpp"
 #include "git2pp/commit.hpp"
+#include "git2pp/commitgraph.hpp"
 #include "git2pp/config.hpp"
 #include "git2pp/database.hpp"
 #include "git2pp/diff.hpp"
 #include "git2pp/exception.hpp"
 #include "git2pp/index.hpp"
+#include "git2pp/looseobject.hpp"
+#include "git2pp/memorybackend.hpp"
 #include "git2pp/object.hpp"
+#include "git2pp/objectcache.hpp"
+#include "git2pp/objectstream.hpp"
 #include "git2pp/oid.hpp"
+#include "git2pp/oidindex.hpp"
+#include "git2pp/oidmap.hpp"
+#include "git2pp/packwriter.hpp"
+#include "git2pp/reachabilityindex.hpp"
 #include "git2pp/ref.hpp"
 #include "git2pp/remote.hpp"
 #include "git2pp/repository.hpp"
 #include "git2pp/revwalk.hpp"
+#include "git2pp/sha1.hpp"
+#include "git2pp/sharedobjectcache.hpp"
 #include "git2pp/signature.hpp"
 #include "git2pp/status.hpp"
+#include "git2pp/stringview.hpp"
 #include "git2pp/tag.hpp"
 #include "git2pp/tree.hpp"
 
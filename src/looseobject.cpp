@@ -0,0 +1,143 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "looseobject.hpp"
+
+#include "exception.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace git2
+{
+namespace helper
+{
+
+static void throw_os_error(const std::string& msg)
+{
+	giterr_set_str(GITERR_OS, msg.c_str());
+	throw Exception(GIT_ERROR);
+}
+
+static std::string object_path(const std::string& objectsDir, const git_oid& oid, std::string* dir = NULL)
+{
+	char hex[GIT_OID_HEXSZ];
+	git_oid_fmt(hex, &oid);
+	std::string fanout = objectsDir + "/" + std::string(hex, 2);
+	if(dir!=NULL)
+		*dir = fanout;
+	return fanout + "/" + std::string(hex + 2, GIT_OID_HEXSZ - 2);
+}
+
+LooseObjectFile::LooseObjectFile(const std::string& objectsDir):
+_objectsDir(objectsDir),
+_path(objectsDir + "/tmp_object_git2pp_XXXXXX"),
+_fd(-1)
+{
+	_fd = ::mkstemp(&_path[0]);
+	if(_fd<0)
+		throw_os_error("Failed to create temporary object file '" + _path + "'");
+}
+
+LooseObjectFile::~LooseObjectFile()
+{
+	if(_fd>=0)
+	{
+		::close(_fd);
+		::unlink(_path.c_str());
+	}
+}
+
+const std::string& LooseObjectFile::path() const
+{
+	return _path;
+}
+
+void LooseObjectFile::write(const void* data, size_t len)
+{
+	const char* bytes = (const char*)data;
+	while(len>0)
+	{
+		ssize_t n = ::write(_fd, bytes, len);
+		if(n<0 && errno==EINTR)
+			continue;
+		if(n<=0)
+			throw_os_error("Failed to write temporary object file '" + _path + "'");
+		bytes += n;
+		len -= n;
+	}
+}
+
+void LooseObjectFile::commit(const git_oid& oid)
+{
+	int fd = _fd;
+	_fd = -1;
+	if(::close(fd)!=0)
+	{
+		::unlink(_path.c_str());
+		throw_os_error("Failed to close temporary object file '" + _path + "'");
+	}
+
+	// An object with the same id is the same object, the new copy is dropped.
+	std::string dir, path = object_path(_objectsDir, oid, &dir);
+	if(::mkdir(dir.c_str(), 0777)!=0 && errno!=EEXIST)
+	{
+		::unlink(_path.c_str());
+		throw_os_error("Failed to create object directory '" + dir + "'");
+	}
+	if(::access(path.c_str(), F_OK)==0)
+	{
+		::unlink(_path.c_str());
+		return;
+	}
+	::chmod(_path.c_str(), 0444);
+	if(::rename(_path.c_str(), path.c_str())!=0)
+	{
+		::unlink(_path.c_str());
+		throw_os_error("Failed to move object file to '" + path + "'");
+	}
+}
+
+bool LooseObjectFile::exists(const std::string& objectsDir, const git_oid& oid)
+{
+	return ::access(object_path(objectsDir, oid).c_str(), F_OK)==0;
+}
+
+void LooseObjectFile::sync(const std::string& objectsDir)
+{
+#ifdef __linux__
+	// One call flushes the whole file system holding the objects.
+	int fd = ::open(objectsDir.c_str(), O_RDONLY);
+	if(fd<0)
+		throw_os_error("Failed to open objects directory '" + objectsDir + "'");
+	int res = ::syncfs(fd);
+	::close(fd);
+	if(res!=0)
+		throw_os_error("Failed to flush objects directory '" + objectsDir + "'");
+#else
+	::sync();
+#endif
+}
+
+} // namespace helper
+} // namespace git2
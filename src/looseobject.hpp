@@ -0,0 +1,89 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_LOOSEOBJECT_HPP_
+#define _GIT2PP_LOOSEOBJECT_HPP_
+
+#include <git2.h>
+
+#include <string>
+
+namespace git2
+{
+namespace helper
+{
+
+/**
+ * Temporary file of an objects directory, which becomes a loose object
+ * file once its content is written and its id known.
+ *
+ * The content must be the deflated object, header included.
+ * A file which is not committed is removed on destruction.
+ */
+class LooseObjectFile
+{
+public:
+	/**
+	 * Create the temporary file.
+	 * @throws Exception
+	 */
+	LooseObjectFile(const std::string& objectsDir);
+	~LooseObjectFile();
+
+	/**
+	 * Path of the temporary file.
+	 */
+	const std::string& path() const;
+
+	/**
+	 * Append bytes to the file.
+	 * @throws Exception
+	 */
+	void write(const void* data, size_t len);
+
+	/**
+	 * Close the file and move it to the path of its object.
+	 * The file is dropped if the object already exists.
+	 * @throws Exception
+	 */
+	void commit(const git_oid& oid);
+
+	/**
+	 * Check if a loose object exists in an objects directory.
+	 */
+	static bool exists(const std::string& objectsDir, const git_oid& oid);
+
+	/**
+	 * Flush the written files of an objects directory to the disk.
+	 * @throws Exception
+	 */
+	static void sync(const std::string& objectsDir);
+
+private:
+	LooseObjectFile(const LooseObjectFile&) = delete;
+	LooseObjectFile& operator=(const LooseObjectFile&) = delete;
+
+	std::string _objectsDir;
+	std::string _path;
+	int _fd;
+};
+
+} // namespace helper
+} // namespace git2
+#endif // _GIT2PP_LOOSEOBJECT_HPP_
@@ -0,0 +1,251 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "memorybackend.hpp"
+
+#include <git2/odb_backend.h>
+
+#include <cstring>
+
+#include "exception.hpp"
+#include "repository.hpp"
+
+namespace git2
+{
+
+namespace
+{
+
+/**
+ * Forward the chunks of a pack being built to a pack writer.
+ */
+struct PackWriting
+{
+	git_odb_writepack* writepack;
+	git_transfer_progress stats;
+};
+
+int add_to_pack(void* buf, size_t size, void* payload)
+{
+	PackWriting* writing = static_cast<PackWriting*>(payload);
+	return writing->writepack->add(writing->writepack, buf, size, &writing->stats);
+}
+
+void free_writepack(git_odb_writepack* writepack)
+{
+	writepack->free(writepack);
+}
+
+} // namespace
+
+MemoryDatabaseBackend::MemoryDatabaseBackend(size_t maxBytes, size_t blockSize):
+_cursor(nullptr),
+_available(0),
+_blockSize(blockSize>0 ? blockSize : 1),
+_bytes(0),
+_maxBytes(maxBytes)
+{
+}
+
+MemoryDatabaseBackend::~MemoryDatabaseBackend()
+{
+}
+
+unsigned char* MemoryDatabaseBackend::allocate(size_t size)
+{
+	// Big objects get their own block, the current one is kept for the next small ones.
+	if(size > _blockSize/4)
+	{
+		_blocks.push_back(std::unique_ptr<unsigned char[]>(new unsigned char[size>0 ? size : 1]));
+		return _blocks.back().get();
+	}
+
+	if(size > _available)
+	{
+		_blocks.push_back(std::unique_ptr<unsigned char[]>(new unsigned char[_blockSize]));
+		_cursor = _blocks.back().get();
+		_available = _blockSize;
+	}
+
+	unsigned char* ptr = _cursor;
+	_cursor += size;
+	_available -= size;
+	return ptr;
+}
+
+void MemoryDatabaseBackend::release()
+{
+	_entries.clear();
+	_blocks.clear();
+	_cursor = nullptr;
+	_available = 0;
+	_bytes = 0;
+}
+
+bool MemoryDatabaseBackend::read(const OId& oid, DatabaseBackendObject& object)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Entry* entry = _entries.find(oid);
+	if(entry==nullptr)
+		return false;
+	object.assign(entry->type, entry->data, entry->size);
+	return true;
+}
+
+bool MemoryDatabaseBackend::readPrefix(const OId& prefix, OId& oid, DatabaseBackendObject& object)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Entry* found = nullptr;
+	for(const OIdMap<Entry>::Entry& entry : _entries)
+	{
+		if(git_oid_ncmp(&entry.key, prefix.constData(), prefix.length())!=0)
+			continue;
+		if(found!=nullptr)
+		{
+			giterr_set_str(GITERR_ODB, "Ambiguous short object id in memory backend");
+			throw Exception(GIT_EAMBIGUOUS);
+		}
+		found = &entry.value;
+		oid = entry.oid();
+	}
+	if(found==nullptr)
+		return false;
+	object.assign(found->type, found->data, found->size);
+	return true;
+}
+
+bool MemoryDatabaseBackend::readHeader(const OId& oid, ObjectHeader& header)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Entry* entry = _entries.find(oid);
+	if(entry==nullptr)
+		return false;
+	header = ObjectHeader(entry->type, entry->size);
+	return true;
+}
+
+void MemoryDatabaseBackend::write(const OId& oid, const void* data, size_t size, git_otype type)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_entries.contains(oid))
+		return;
+	if(_maxBytes>0 && size > _maxBytes - _bytes)
+	{
+		giterr_set_str(GITERR_ODB, "Memory object database backend is full");
+		throw Exception(GIT_ERROR);
+	}
+
+	Entry entry;
+	unsigned char* content = allocate(size);
+	std::memcpy(content, data, size);
+	entry.data = content;
+	entry.size = size;
+	entry.type = type;
+	_entries.insert(oid, entry);
+	_bytes += size;
+}
+
+bool MemoryDatabaseBackend::exists(const OId& oid)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries.contains(oid);
+}
+
+bool MemoryDatabaseBackend::foreach(std::function<bool(const OId&)> callback)
+{
+	// Ids are copied first so the callback can read or write objects.
+	std::vector<OId> oids;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		oids.reserve(_entries.size());
+		for(const OIdMap<Entry>::Entry& entry : _entries)
+			oids.push_back(entry.oid());
+	}
+	for(const OId& oid : oids)
+	{
+		if(!callback(oid))
+			return true;
+	}
+	return false;
+}
+
+size_t MemoryDatabaseBackend::count() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries.size();
+}
+
+size_t MemoryDatabaseBackend::bytes() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _bytes;
+}
+
+size_t MemoryDatabaseBackend::maxBytes() const
+{
+	return _maxBytes;
+}
+
+size_t MemoryDatabaseBackend::flush(const Repository& repository)
+{
+	std::vector<OId> oids;
+	foreach([&](const OId& oid){
+		oids.push_back(oid);
+		return true;
+	});
+	if(oids.empty())
+		return 0;
+
+	// The pack builder reads the objects back through the repository database, so this backend.
+	git_packbuilder* pb;
+	Exception::git2_assert(git_packbuilder_new(&pb, repository.data()));
+	std::unique_ptr<git_packbuilder, void(*)(git_packbuilder*)> builder(pb, &git_packbuilder_free);
+	for(const OId& oid : oids)
+		Exception::git2_assert(git_packbuilder_insert(pb, oid.constData(), NULL));
+
+	PackWriting writing;
+	std::memset(&writing.stats, 0, sizeof(writing.stats));
+	Exception::git2_assert(git_odb_write_pack(&writing.writepack, repository.database().data(), NULL, NULL));
+	std::unique_ptr<git_odb_writepack, void(*)(git_odb_writepack*)> writepack(writing.writepack, &free_writepack);
+	Exception::git2_assert(git_packbuilder_foreach(pb, &add_to_pack, &writing));
+	Exception::git2_assert(writing.writepack->commit(writing.writepack, &writing.stats));
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	for(const OId& oid : oids)
+	{
+		const Entry* entry = _entries.find(oid);
+		if(entry!=nullptr)
+		{
+			_bytes -= entry->size;
+			_entries.erase(oid);
+		}
+	}
+	// Memory can only be released when no object is left in the blocks.
+	if(_entries.size()==0)
+		release();
+	return oids.size();
+}
+
+void MemoryDatabaseBackend::discard()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	release();
+}
+
+} // namespace git2
@@ -0,0 +1,140 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_MEMORYBACKEND_HPP_
+#define _GIT2PP_MEMORYBACKEND_HPP_
+
+#include <git2.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "database.hpp"
+#include "oidmap.hpp"
+
+namespace git2
+{
+
+class Repository;
+
+/**
+ * Object database backend keeping its objects in memory.
+ *
+ * Object contents are copied into large blocks allocated one after the
+ * other and only released all together, so writing an object costs a
+ * copy and an index insertion, without file nor fsync.
+ * It is meant for short-lived objects: merge results, previews, fixtures.
+ * Kept objects are either written to a pack with flush(), or dropped
+ * with discard().
+ *
+ * Add it with Database::addBackend() and a priority higher than the
+ * on-disk backends, like Priority, so new objects are written to it:
+ *
+ *     MemoryDatabaseBackend* memory = new MemoryDatabaseBackend();
+ *     repo.database().addBackend(memory, MemoryDatabaseBackend::Priority);
+ *
+ * When a size limit is set, writes going over it fail, and libgit2 then
+ * writes the object to the next backend (the loose one).
+ *
+ * All the operations are thread-safe.
+ */
+class MemoryDatabaseBackend : public CustomDatabaseBackend
+{
+public:
+	/** Priority above the default loose (2) and pack (1) backends. */
+	static const int Priority = 10;
+
+	/**
+	 * Create an empty backend.
+	 *
+	 * @param maxBytes maximal size of the kept object contents, 0 for no limit.
+	 * @param blockSize size of the allocated blocks, bigger objects get their own block.
+	 */
+	MemoryDatabaseBackend(size_t maxBytes = 0, size_t blockSize = 1024*1024);
+	virtual ~MemoryDatabaseBackend();
+
+	virtual bool read(const OId& oid, DatabaseBackendObject& object);
+	virtual bool readPrefix(const OId& prefix, OId& oid, DatabaseBackendObject& object);
+	virtual bool readHeader(const OId& oid, ObjectHeader& header);
+	virtual void write(const OId& oid, const void* data, size_t size, git_otype type);
+	virtual bool exists(const OId& oid);
+	virtual bool foreach(std::function<bool(const OId&)> callback);
+
+	/**
+	 * Number of kept objects.
+	 */
+	size_t count() const;
+
+	/**
+	 * Size of the kept object contents.
+	 */
+	size_t bytes() const;
+
+	/**
+	 * Size limit of the kept object contents, 0 for no limit.
+	 */
+	size_t maxBytes() const;
+
+	/**
+	 * Write the kept objects to a new pack of a repository then drop them.
+	 *
+	 * This backend must be one of the backends of the repository database,
+	 * as objects are read back through it to build the pack.
+	 * Objects written while flushing are kept.
+	 *
+	 * @param repository repository whose database holds this backend.
+	 * @return Number of written objects.
+	 * @throws Exception
+	 */
+	size_t flush(const Repository& repository);
+
+	/**
+	 * Drop all the kept objects and release their memory.
+	 */
+	void discard();
+
+private:
+	/**
+	 * Location of a kept object.
+	 */
+	struct Entry
+	{
+		const unsigned char* data;
+		size_t size;
+		git_otype type;
+
+		Entry():data(nullptr), size(0), type(GIT_OBJ_BAD){}
+	};
+
+	unsigned char* allocate(size_t size);
+	void release();
+
+	mutable std::mutex _mutex;
+	OIdMap<Entry> _entries;
+	std::vector<std::unique_ptr<unsigned char[]>> _blocks;
+	unsigned char* _cursor;
+	size_t _available;
+	size_t _blockSize;
+	size_t _bytes;
+	size_t _maxBytes;
+};
+
+} // namespace git2
+#endif // _GIT2PP_MEMORYBACKEND_HPP_
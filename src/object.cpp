@@ -41,6 +41,11 @@ _Class(object)
 {
 }
 
+Object::Object(const std::shared_ptr<git_object>& object):
+_Class(object)
+{
+}
+
 Object::Object(const Object& other):
 _Class(other)
 {
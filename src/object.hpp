@@ -55,6 +55,12 @@ public:
      * Object, and is automatically freed when no more referenced.
      */
     explicit Object(git_object *object = NULL);
+
+    /**
+     * Create an Object sharing an already managed git_object, whose
+     * deleter may hold other resources than the object itself.
+     */
+    explicit Object(const std::shared_ptr<git_object>& object);
 		
     /**
      * Copy constructor.
@@ -0,0 +1,193 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "objectcache.hpp"
+
+#include <cstring>
+
+namespace git2
+{
+
+ObjectCache::ObjectCache(size_t commitBytes, size_t treeBytes, size_t tagBytes, size_t shardCount)
+{
+	size_t count = 1;
+	while(count < shardCount)
+		count *= 2;
+
+	_budget[TypeCommit] = commitBytes;
+	_budget[TypeTree] = treeBytes;
+	_budget[TypeTag] = tagBytes;
+
+	for(size_t n=0; n<count; ++n)
+	{
+		_shards.push_back(std::unique_ptr<Shard>(new Shard));
+		std::memset(_shards.back()->stats, 0, sizeof(_shards.back()->stats));
+	}
+}
+
+int ObjectCache::typeIndex(git_otype type)
+{
+	switch(type)
+	{
+	case GIT_OBJ_COMMIT:
+		return TypeCommit;
+	case GIT_OBJ_TREE:
+		return TypeTree;
+	case GIT_OBJ_TAG:
+		return TypeTag;
+	default:
+		return -1;
+	}
+}
+
+ObjectCache::Shard& ObjectCache::shard(const OId& oid)
+{
+	return *_shards[oid.raw()[0] & (_shards.size() - 1)];
+}
+
+size_t ObjectCache::cost(const Object& object)
+{
+	switch(object.getType())
+	{
+	case GIT_OBJ_COMMIT:
+	{
+		const git_commit* commit = reinterpret_cast<const git_commit*>(object.data());
+		return 256 + std::strlen(git_commit_message(commit))
+			+ git_commit_parentcount(commit) * sizeof(git_oid);
+	}
+	case GIT_OBJ_TREE:
+	{
+		git_tree* tree = reinterpret_cast<git_tree*>(object.data());
+		size_t size = 64, count = git_tree_entrycount(tree);
+		for(size_t n=0; n<count; ++n)
+			size += 48 + std::strlen(git_tree_entry_name(git_tree_entry_byindex(tree, n)));
+		return size;
+	}
+	case GIT_OBJ_TAG:
+	{
+		const git_tag* tag = reinterpret_cast<const git_tag*>(object.data());
+		const char* message = git_tag_message(tag);
+		return 192 + std::strlen(git_tag_name(tag)) + (message!=NULL ? std::strlen(message) : 0);
+	}
+	default:
+		return 0;
+	}
+}
+
+Object ObjectCache::find(const OId& oid, git_otype type)
+{
+	int first = 0, last = TypeCount - 1;
+	if(type!=GIT_OBJ_ANY)
+	{
+		first = last = typeIndex(type);
+		if(first<0)
+			return Object();
+	}
+
+	Shard& s = shard(oid);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	for(int t=first; t<=last; ++t)
+	{
+		std::list<Entry>::iterator* it = s.entries[t].find(oid);
+		if(it!=nullptr)
+		{
+			s.lru[t].splice(s.lru[t].begin(), s.lru[t], *it);
+			++s.stats[t].hits;
+			return (*it)->object;
+		}
+	}
+	if(type!=GIT_OBJ_ANY)
+		++s.stats[first].misses;
+	return Object();
+}
+
+void ObjectCache::insert(const Object& object)
+{
+	if(object.isNull())
+		return;
+	int t = typeIndex(object.getType());
+	if(t<0)
+		return;
+
+	OId oid = object.oid();
+	Entry entry = {oid, object, cost(object)};
+	size_t budget = _budget[t] / _shards.size();
+	if(entry.cost > budget)
+		return;
+
+	Shard& s = shard(oid);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if(s.entries[t].contains(oid))
+		return;
+	s.lru[t].push_front(entry);
+	s.entries[t][oid] = s.lru[t].begin();
+	s.stats[t].bytes += entry.cost;
+	++s.stats[t].count;
+
+	while(s.stats[t].bytes > budget)
+	{
+		Entry& victim = s.lru[t].back();
+		s.entries[t].erase(victim.oid);
+		s.stats[t].bytes -= victim.cost;
+		--s.stats[t].count;
+		++s.stats[t].evictions;
+		s.lru[t].pop_back();
+	}
+}
+
+void ObjectCache::clear()
+{
+	for(std::unique_ptr<Shard>& s : _shards)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		for(int t=0; t<TypeCount; ++t)
+		{
+			s->lru[t].clear();
+			s->entries[t].clear();
+			s->stats[t].bytes = 0;
+			s->stats[t].count = 0;
+		}
+	}
+}
+
+ObjectCacheStats ObjectCache::stats(git_otype type) const
+{
+	ObjectCacheStats res = {0, 0, 0, 0, 0};
+	int t = typeIndex(type);
+	if(t<0)
+		return res;
+	for(const std::unique_ptr<Shard>& s : _shards)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		res.hits += s->stats[t].hits;
+		res.misses += s->stats[t].misses;
+		res.evictions += s->stats[t].evictions;
+		res.count += s->stats[t].count;
+		res.bytes += s->stats[t].bytes;
+	}
+	return res;
+}
+
+size_t ObjectCache::budget(git_otype type) const
+{
+	int t = typeIndex(type);
+	return t<0 ? 0 : _budget[t];
+}
+
+} // namespace git2
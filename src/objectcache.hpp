@@ -0,0 +1,137 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_OBJECTCACHE_HPP_
+#define _GIT2PP_OBJECTCACHE_HPP_
+
+#include <git2.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "object.hpp"
+#include "oid.hpp"
+#include "oidmap.hpp"
+
+namespace git2
+{
+
+/**
+ * Counters of an ObjectCache, for one object type.
+ */
+struct ObjectCacheStats
+{
+	size_t hits;      //!< Lookups served from the cache.
+	size_t misses;    //!< Lookups not found in the cache.
+	size_t evictions; //!< Objects dropped to respect the byte budget.
+	size_t count;     //!< Objects currently cached.
+	size_t bytes;     //!< Estimated size of cached objects.
+};
+
+/**
+ * Sharded LRU cache of commit, tree and tag wrappers.
+ *
+ * Each object type has its own byte budget, evaluated from an estimation
+ * of the parsed object size, evenly split between the shards. Objects are
+ * dispatched to shards by id, each shard having its own lock, and are
+ * evicted in least recently used order within their type.
+ *
+ * A cached Object keeps the underlying libgit2 object alive.
+ */
+class ObjectCache
+{
+public:
+	/**
+	 * Create a cache.
+	 *
+	 * @param commitBytes byte budget for commits.
+	 * @param treeBytes byte budget for trees.
+	 * @param tagBytes byte budget for tags.
+	 * @param shardCount number of shards, rounded up to a power of two.
+	 */
+	ObjectCache(size_t commitBytes, size_t treeBytes, size_t tagBytes, size_t shardCount = 16);
+
+	/**
+	 * Find an object in the cache.
+	 *
+	 * @param oid full-length id of the object.
+	 * @param type expected type, or GIT_OBJ_ANY.
+	 * @return The cached object, a null Object if not found.
+	 */
+	Object find(const OId& oid, git_otype type);
+
+	/**
+	 * Insert an object in the cache.
+	 * Blobs and null objects are ignored.
+	 */
+	void insert(const Object& object);
+
+	/**
+	 * Drop all cached objects, counters are kept.
+	 */
+	void clear();
+
+	/**
+	 * Get the counters of an object type.
+	 *
+	 * Lookups by GIT_OBJ_ANY which are not found are not counted as misses.
+	 *
+	 * @param type GIT_OBJ_COMMIT, GIT_OBJ_TREE or GIT_OBJ_TAG.
+	 */
+	ObjectCacheStats stats(git_otype type) const;
+
+	/**
+	 * Get the byte budget of an object type.
+	 */
+	size_t budget(git_otype type) const;
+
+	/**
+	 * Estimate the memory used by a parsed object.
+	 */
+	static size_t cost(const Object& object);
+
+private:
+	enum { TypeCommit = 0, TypeTree = 1, TypeTag = 2, TypeCount = 3 };
+
+	struct Entry
+	{
+		OId oid;
+		Object object;
+		size_t cost;
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::list<Entry> lru[TypeCount];
+		OIdMap<std::list<Entry>::iterator> entries[TypeCount];
+		ObjectCacheStats stats[TypeCount];
+	};
+
+	static int typeIndex(git_otype type);
+	Shard& shard(const OId& oid);
+
+	size_t _budget[TypeCount];
+	std::vector<std::unique_ptr<Shard>> _shards;
+};
+
+} // namespace git2
+#endif // _GIT2PP_OBJECTCACHE_HPP_
@@ -0,0 +1,838 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "objectstream.hpp"
+
+#include <git2/odb_backend.h>
+
+#include "database.hpp"
+#include "exception.hpp"
+#include "looseobject.hpp"
+#include "sha1.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <zlib.h>
+
+namespace git2
+{
+
+static void throw_stream_error(int klass, const std::string& msg)
+{
+	giterr_set_str(klass, msg.c_str());
+	throw Exception(GIT_ERROR);
+}
+
+static uint32_t read_be32(const unsigned char* buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+// Find the offset of an object in a pack, from its index file (version 1 or 2).
+static bool find_in_pack_index(const std::string& path, const git_oid& oid, uint64_t& offset)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	unsigned char header[8];
+	if(!file.read((char*)header, sizeof(header)))
+		return false;
+	bool v2 = header[0]==0xFF && header[1]=='t' && header[2]=='O' && header[3]=='c';
+	if(v2 && read_be32(header+4)!=2)
+		return false;
+
+	unsigned char fanout[256*4];
+	std::streamoff fanoutPos = v2 ? 8 : 0;
+	file.seekg(fanoutPos);
+	if(!file.read((char*)fanout, sizeof(fanout)))
+		return false;
+	uint32_t count = read_be32(fanout + 255*4);
+	uint32_t first = oid.id[0]==0 ? 0 : read_be32(fanout + (oid.id[0]-1)*4);
+	uint32_t last = read_be32(fanout + oid.id[0]*4);
+
+	// Version 1 entries are the 4-byte offset followed by the name.
+	std::streamoff namesPos = fanoutPos + sizeof(fanout);
+	std::streamoff entrySize = v2 ? GIT_OID_RAWSZ : 4 + GIT_OID_RAWSZ;
+	std::streamoff nameShift = v2 ? 0 : 4;
+	unsigned char name[GIT_OID_RAWSZ];
+	while(first<last)
+	{
+		uint32_t middle = first + (last - first) / 2;
+		file.seekg(namesPos + middle*entrySize + nameShift);
+		if(!file.read((char*)name, sizeof(name)))
+			return false;
+		int cmp = std::memcmp(name, oid.id, GIT_OID_RAWSZ);
+		if(cmp<0)
+		{
+			first = middle + 1;
+			continue;
+		}
+		if(cmp>0)
+		{
+			last = middle;
+			continue;
+		}
+
+		unsigned char buffer[8];
+		if(!v2)
+		{
+			file.seekg(namesPos + middle*entrySize);
+			if(!file.read((char*)buffer, 4))
+				return false;
+			offset = read_be32(buffer);
+			return true;
+		}
+		// Names, CRCs, then 4-byte offsets, the high bit indexing the 8-byte offset table.
+		std::streamoff offsetsPos = namesPos + (std::streamoff)count*(GIT_OID_RAWSZ + 4);
+		file.seekg(offsetsPos + (std::streamoff)middle*4);
+		if(!file.read((char*)buffer, 4))
+			return false;
+		uint32_t small = read_be32(buffer);
+		if((small & 0x80000000)==0)
+		{
+			offset = small;
+			return true;
+		}
+		file.seekg(offsetsPos + (std::streamoff)count*4 + (std::streamoff)(small & 0x7FFFFFFF)*8);
+		if(!file.read((char*)buffer, 8))
+			return false;
+		offset = ((uint64_t)read_be32(buffer) << 32) | read_be32(buffer + 4);
+		return true;
+	}
+	return false;
+}
+
+
+//
+// Sources
+//
+
+class ObjectReadStream::Source
+{
+public:
+	Source():type(GIT_OBJ_BAD), size(0), offset(0){}
+	virtual ~Source(){}
+
+	/** Read raw bytes, 0 at the end. */
+	virtual size_t read(void* buffer, size_t len) = 0;
+
+	git_otype type;
+	size_t size;
+	size_t offset;
+};
+
+/**
+ * Inflate a zlib stream from a file, a loose object or a pack entry.
+ */
+class ObjectReadStream::InflateSource : public ObjectReadStream::Source
+{
+public:
+	InflateSource(std::FILE* file):
+	_file(file, std::fclose),
+	_input(64*1024),
+	_ended(false),
+	_pendingPos(0)
+	{
+		std::memset(&_zstream, 0, sizeof(_zstream));
+		if(inflateInit(&_zstream)!=Z_OK)
+			throw_stream_error(GITERR_ZLIB, "Unable to initialize object inflater");
+	}
+
+	~InflateSource()
+	{
+		inflateEnd(&_zstream);
+	}
+
+	/**
+	 * Read the "<type> <size>\0" header of a loose object.
+	 */
+	void readLooseHeader()
+	{
+		char header[64];
+		size_t len = 0;
+		const void* end = NULL;
+		while(end==NULL && len<sizeof(header))
+		{
+			size_t n = inflateSome(header + len, sizeof(header) - len);
+			if(n==0)
+				break;
+			len += n;
+			end = std::memchr(header, 0, len);
+		}
+		const char* space = end!=NULL ? (const char*)std::memchr(header, ' ', (const char*)end - header) : NULL;
+		if(space==NULL)
+			throw_stream_error(GITERR_OBJECT, "Corrupted loose object header");
+
+		type = git_object_string2type(std::string((const char*)header, space).c_str());
+		size = (size_t)std::strtoull(space + 1, NULL, 10);
+		_pending.assign((const char*)end + 1, (const char*)header + len);
+	}
+
+	size_t read(void* buffer, size_t len)
+	{
+		if(_pendingPos<_pending.size())
+		{
+			size_t n = std::min(len, _pending.size() - _pendingPos);
+			std::memcpy(buffer, &_pending[_pendingPos], n);
+			_pendingPos += n;
+			return n;
+		}
+		return inflateSome(buffer, len);
+	}
+
+private:
+	size_t inflateSome(void* buffer, size_t len)
+	{
+		uInt wanted = (uInt)std::min(len, (size_t)0x40000000);
+		_zstream.next_out = (Bytef*)buffer;
+		_zstream.avail_out = wanted;
+		while(!_ended && _zstream.avail_out==wanted)
+		{
+			if(_zstream.avail_in==0)
+			{
+				size_t n = std::fread(&_input[0], 1, _input.size(), _file.get());
+				if(n==0)
+					throw_stream_error(GITERR_ZLIB, "Truncated object data");
+				_zstream.next_in = &_input[0];
+				_zstream.avail_in = (uInt)n;
+			}
+			int res = inflate(&_zstream, Z_NO_FLUSH);
+			if(res==Z_STREAM_END)
+				_ended = true;
+			else if(res!=Z_OK)
+				throw_stream_error(GITERR_ZLIB, "Corrupted object data");
+		}
+		return wanted - _zstream.avail_out;
+	}
+
+	std::unique_ptr<std::FILE, int(*)(std::FILE*)> _file;
+	std::vector<Bytef> _input;
+	z_stream _zstream;
+	bool _ended;
+	std::vector<char> _pending;
+	size_t _pendingPos;
+};
+
+/**
+ * Read stream of a custom database backend.
+ */
+class ObjectReadStream::BackendSource : public ObjectReadStream::Source
+{
+public:
+	BackendSource(git_odb_stream* stream):_stream(stream){}
+
+	~BackendSource()
+	{
+		_stream->free(_stream);
+	}
+
+	size_t read(void* buffer, size_t len)
+	{
+		int res = _stream->read(_stream, (char*)buffer, len);
+		Exception::git2_assert(res<0 ? res : GIT_OK);
+		return (size_t)res;
+	}
+
+private:
+	git_odb_stream* _stream;
+};
+
+/**
+ * Object fully read in memory.
+ */
+class ObjectReadStream::MemorySource : public ObjectReadStream::Source
+{
+public:
+	MemorySource(git_odb_object* object):_object(object, git_odb_object_free){}
+
+	size_t read(void* buffer, size_t len)
+	{
+		size_t n = std::min(len, size - offset);
+		std::memcpy(buffer, (const char*)git_odb_object_data(_object.get()) + offset, n);
+		return n;
+	}
+
+private:
+	std::unique_ptr<git_odb_object, void(*)(git_odb_object*)> _object;
+};
+
+
+//
+// ObjectReadStream
+//
+
+ObjectReadStream::ObjectReadStream()
+{
+}
+
+ObjectReadStream::ObjectReadStream(const Database& db, const OId& oid)
+{
+	std::string objectsDir = db.objectsDir();
+	if(!objectsDir.empty())
+	{
+		std::string hex = oid.format();
+
+		std::FILE* file = std::fopen((objectsDir + "/" + hex.substr(0, 2) + "/" + hex.substr(2)).c_str(), "rb");
+		if(file!=NULL)
+		{
+			std::shared_ptr<InflateSource> source = std::make_shared<InflateSource>(file);
+			source->readLooseHeader();
+			_source = source;
+			return;
+		}
+
+		std::string packDir = objectsDir + "/pack";
+		if(DIR* dir = opendir(packDir.c_str()))
+		{
+			uint64_t offset = 0;
+			std::string pack;
+			while(struct dirent* entry = readdir(dir))
+			{
+				std::string name = entry->d_name;
+				if(name.size()>4 && name.compare(name.size()-4, 4, ".idx")==0
+					&& find_in_pack_index(packDir + "/" + name, *oid.constData(), offset))
+				{
+					pack = packDir + "/" + name.substr(0, name.size()-4) + ".pack";
+					break;
+				}
+			}
+			closedir(dir);
+
+			file = pack.empty() ? NULL : std::fopen(pack.c_str(), "rb");
+			if(file!=NULL)
+			{
+				// Entry header: type in bits 4-6 of the first byte, then
+				// the size as a little-endian base-128 varint.
+				unsigned char c = 0;
+				size_t size = 0;
+				int shift = 4;
+				bool ok = fseeko(file, (off_t)offset, SEEK_SET)==0 && std::fread(&c, 1, 1, file)==1;
+				int type = (c >> 4) & 7;
+				size = c & 15;
+				while(ok && (c & 0x80))
+				{
+					ok = std::fread(&c, 1, 1, file)==1;
+					size |= (size_t)(c & 0x7F) << shift;
+					shift += 7;
+				}
+				// Deltified entries need their base, they are read by libgit2.
+				if(ok && type>=GIT_OBJ_COMMIT && type<=GIT_OBJ_TAG)
+				{
+					std::shared_ptr<InflateSource> source = std::make_shared<InflateSource>(file);
+					source->type = (git_otype)type;
+					source->size = size;
+					_source = source;
+					return;
+				}
+				std::fclose(file);
+			}
+		}
+	}
+
+	// A backend passing on the stream leaves it null, the object is read whole.
+	git_odb_stream* stream = NULL;
+	size_t size = 0;
+	git_otype type = GIT_OBJ_BAD;
+	if(git_odb_read_header(&size, &type, db.data(), oid.constData())==GIT_OK
+		&& git_odb_open_rstream(&stream, db.data(), oid.constData())==GIT_OK
+		&& stream!=NULL)
+	{
+		_source = std::make_shared<BackendSource>(stream);
+	}
+	else
+	{
+		giterr_clear();
+		git_odb_object* object = NULL;
+		Exception::git2_assert(git_odb_read(&object, db.data(), oid.constData()));
+		_source = std::make_shared<MemorySource>(object);
+		size = git_odb_object_size(object);
+		type = git_odb_object_type(object);
+	}
+	_source->type = type;
+	_source->size = size;
+}
+
+bool ObjectReadStream::isOpen() const
+{
+	return (bool)_source;
+}
+
+git_otype ObjectReadStream::type() const
+{
+	return _source ? _source->type : GIT_OBJ_BAD;
+}
+
+size_t ObjectReadStream::size() const
+{
+	return _source ? _source->size : 0;
+}
+
+size_t ObjectReadStream::offset() const
+{
+	return _source ? _source->offset : 0;
+}
+
+bool ObjectReadStream::atEnd() const
+{
+	return !_source || _source->offset>=_source->size;
+}
+
+size_t ObjectReadStream::read(void* buffer, size_t len)
+{
+	if(atEnd() || len==0)
+		return 0;
+	size_t n = _source->read(buffer, std::min(len, _source->size - _source->offset));
+	if(n==0)
+		throw_stream_error(GITERR_ODB, "Object content is shorter than its declared size");
+	_source->offset += n;
+	return n;
+}
+
+size_t ObjectReadStream::pipe(std::function<bool(const void*, size_t)> sink, size_t chunkSize)
+{
+	std::vector<char> buffer(std::max(chunkSize, (size_t)1));
+	size_t total = 0;
+	while(size_t n = read(&buffer[0], buffer.size()))
+	{
+		total += n;
+		if(!sink(&buffer[0], n))
+			break;
+	}
+	return total;
+}
+
+
+//
+// Sinks
+//
+
+class ObjectWriteStream::Sink
+{
+public:
+	Sink(git_otype type, size_t size):type(type), size(size), offset(0){}
+	virtual ~Sink(){}
+
+	/** Write raw bytes. */
+	virtual void write(const void* data, size_t len) = 0;
+
+	/** Finish the object once all bytes are written. */
+	virtual OId finalize() = 0;
+
+	git_otype type;
+	size_t size;
+	size_t offset;
+};
+
+/**
+ * Write through a backend write stream.
+ */
+class ObjectWriteStream::BackendSink : public ObjectWriteStream::Sink
+{
+public:
+	BackendSink(git_odb_stream* stream, git_otype type, size_t size):Sink(type, size), _stream(stream){}
+
+	~BackendSink()
+	{
+		_stream->free(_stream);
+	}
+
+	void write(const void* data, size_t len)
+	{
+		Exception::git2_assert(_stream->write(_stream, (const char*)data, len));
+	}
+
+	OId finalize()
+	{
+		OId oid;
+		Exception::git2_assert(_stream->finalize_write(oid.data(), _stream));
+		return oid;
+	}
+
+private:
+	git_odb_stream* _stream;
+};
+
+/**
+ * Write a loose object file, hashing, deflating and writing on three threads.
+ * The file is dropped if the database already has the object.
+ */
+class ObjectWriteStream::PipelineSink : public ObjectWriteStream::Sink
+{
+public:
+	/** Below this size, starting threads costs more than it saves. */
+	static const size_t MinSize = 1024*1024;
+
+	PipelineSink(git_odb* odb, const std::string& objectsDir, git_otype type, size_t size);
+	~PipelineSink();
+
+	void write(const void* data, size_t len);
+	OId finalize();
+
+private:
+	typedef std::shared_ptr<std::vector<unsigned char>> Chunk;
+
+	static const size_t ChunkSize = 256*1024;
+
+	/**
+	 * Bounded queue of chunks between two stages.
+	 * Stages always drain their input, so pushing never blocks forever.
+	 */
+	class Queue
+	{
+	public:
+		Queue(size_t capacity):_capacity(capacity), _closed(false){}
+
+		void push(const Chunk& chunk)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_notFull.wait(lock, [&]{return _chunks.size()<_capacity;});
+			_chunks.push_back(chunk);
+			_notEmpty.notify_one();
+		}
+
+		bool pop(Chunk& chunk)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_notEmpty.wait(lock, [&]{return !_chunks.empty() || _closed;});
+			if(_chunks.empty())
+				return false;
+			chunk = _chunks.front();
+			_chunks.pop_front();
+			_notFull.notify_one();
+			return true;
+		}
+
+		void close()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+			_notEmpty.notify_all();
+		}
+
+	private:
+		std::mutex _mutex;
+		std::condition_variable _notEmpty, _notFull;
+		std::deque<Chunk> _chunks;
+		size_t _capacity;
+		bool _closed;
+	};
+
+	void hashStage();
+	void deflateStage();
+	void writeStage();
+	void fail(const std::string& msg);
+	bool failed();
+	void join();
+
+	git_odb* _odb;
+	helper::LooseObjectFile _file;
+	Chunk _current;
+	Queue _toHash, _toDeflate, _toWrite;
+	helper::Sha1 _sha1;
+	std::thread _hasher, _deflater, _writer;
+	std::mutex _errorMutex;
+	std::string _error;
+	bool _joined;
+};
+
+const size_t ObjectWriteStream::PipelineSink::MinSize;
+const size_t ObjectWriteStream::PipelineSink::ChunkSize;
+
+ObjectWriteStream::PipelineSink::PipelineSink(git_odb* odb, const std::string& objectsDir, git_otype type, size_t size):
+Sink(type, size),
+_odb(odb),
+_file(objectsDir),
+_toHash(4),
+_toDeflate(4),
+_toWrite(4),
+_joined(true)
+{
+	// The object header starts both the hashed and the deflated data.
+	char header[32];
+	size_t len = helper::Sha1::formatObjectHeader(header, type, size);
+	_current = std::make_shared<std::vector<unsigned char>>();
+	_current->reserve(ChunkSize);
+	_current->insert(_current->end(), header, header + len);
+
+	_joined = false;
+	try
+	{
+		_hasher = std::thread(&PipelineSink::hashStage, this);
+		_deflater = std::thread(&PipelineSink::deflateStage, this);
+		_writer = std::thread(&PipelineSink::writeStage, this);
+	}
+	catch(...)
+	{
+		join();
+		throw;
+	}
+}
+
+ObjectWriteStream::PipelineSink::~PipelineSink()
+{
+	if(!_joined)
+		join();
+}
+
+void ObjectWriteStream::PipelineSink::fail(const std::string& msg)
+{
+	std::lock_guard<std::mutex> lock(_errorMutex);
+	if(_error.empty())
+		_error = msg;
+}
+
+bool ObjectWriteStream::PipelineSink::failed()
+{
+	std::lock_guard<std::mutex> lock(_errorMutex);
+	return !_error.empty();
+}
+
+void ObjectWriteStream::PipelineSink::join()
+{
+	_toHash.close();
+	_toDeflate.close();
+	if(_hasher.joinable())
+		_hasher.join();
+	if(_deflater.joinable())
+		_deflater.join();
+	// The deflate stage closes the write queue, unless it never started.
+	_toWrite.close();
+	if(_writer.joinable())
+		_writer.join();
+	_joined = true;
+}
+
+void ObjectWriteStream::PipelineSink::hashStage()
+{
+	Chunk chunk;
+	while(_toHash.pop(chunk))
+		_sha1.update(chunk->data(), chunk->size());
+}
+
+void ObjectWriteStream::PipelineSink::deflateStage()
+{
+	z_stream zs;
+	std::memset(&zs, 0, sizeof(zs));
+	bool ok = deflateInit(&zs, Z_BEST_SPEED)==Z_OK;
+	if(!ok)
+		fail("Failed to initialize object compression");
+
+	Chunk chunk, out;
+	bool more = true;
+	while(more)
+	{
+		more = _toDeflate.pop(chunk);
+		if(!ok || failed())
+			continue;
+		zs.next_in = more ? chunk->data() : Z_NULL;
+		zs.avail_in = more ? (uInt)chunk->size() : 0;
+		int flush = more ? Z_NO_FLUSH : Z_FINISH;
+		int res;
+		do
+		{
+			if(!out)
+			{
+				out = std::make_shared<std::vector<unsigned char>>(ChunkSize);
+				zs.next_out = out->data();
+				zs.avail_out = (uInt)ChunkSize;
+			}
+			res = deflate(&zs, flush);
+			if(res==Z_STREAM_ERROR)
+			{
+				fail("Failed to compress object");
+				break;
+			}
+			if(zs.avail_out==0 || res==Z_STREAM_END)
+			{
+				out->resize(ChunkSize - zs.avail_out);
+				_toWrite.push(out);
+				out.reset();
+			}
+		}
+		while(flush==Z_FINISH ? res!=Z_STREAM_END : zs.avail_in>0);
+	}
+	if(ok)
+		deflateEnd(&zs);
+	_toWrite.close();
+}
+
+void ObjectWriteStream::PipelineSink::writeStage()
+{
+	Chunk chunk;
+	while(_toWrite.pop(chunk))
+	{
+		if(failed())
+			continue;
+		try
+		{
+			_file.write(chunk->data(), chunk->size());
+		}
+		catch(const Exception& e)
+		{
+			fail(e.message());
+		}
+	}
+}
+
+void ObjectWriteStream::PipelineSink::write(const void* data, size_t len)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	while(len>0)
+	{
+		size_t n = std::min(len, ChunkSize - _current->size());
+		_current->insert(_current->end(), bytes, bytes + n);
+		bytes += n;
+		len -= n;
+		if(_current->size()==ChunkSize)
+		{
+			_toHash.push(_current);
+			_toDeflate.push(_current);
+			_current = std::make_shared<std::vector<unsigned char>>();
+			_current->reserve(ChunkSize);
+		}
+	}
+}
+
+OId ObjectWriteStream::PipelineSink::finalize()
+{
+	if(!_current->empty())
+	{
+		_toHash.push(_current);
+		_toDeflate.push(_current);
+		_current = std::make_shared<std::vector<unsigned char>>();
+	}
+	join();
+
+	if(failed())
+		throw_stream_error(GITERR_ODB, _error);
+
+	git_oid oid;
+	_sha1.final(oid);
+	// Not committed, the temporary file is removed with the sink.
+	if(!git_odb_exists(_odb, &oid))
+		_file.commit(oid);
+	return OId(&oid);
+}
+
+
+//
+// ObjectWriteStream
+//
+
+ObjectWriteStream::ObjectWriteStream()
+{
+}
+
+ObjectWriteStream::ObjectWriteStream(const Database& db, size_t size, git_otype type)
+{
+	if(size>=PipelineSink::MinSize && db.isDirectoryOnly())
+	{
+		_sink = std::make_shared<PipelineSink>(db.data(), db.objectsDir(), type, size);
+		return;
+	}
+
+	git_odb_stream* stream = NULL;
+	Exception::git2_assert(git_odb_open_wstream(&stream, db.data(), size, type));
+	_sink = std::make_shared<BackendSink>(stream, type, size);
+}
+
+bool ObjectWriteStream::isOpen() const
+{
+	return (bool)_sink;
+}
+
+git_otype ObjectWriteStream::type() const
+{
+	return _sink ? _sink->type : GIT_OBJ_BAD;
+}
+
+size_t ObjectWriteStream::size() const
+{
+	return _sink ? _sink->size : 0;
+}
+
+size_t ObjectWriteStream::offset() const
+{
+	return _sink ? _sink->offset : 0;
+}
+
+void ObjectWriteStream::write(const void* data, size_t len)
+{
+	if(!_sink)
+		throw_stream_error(GITERR_INVALID, "Object write stream is not open");
+	if(len > _sink->size - _sink->offset)
+		throw_stream_error(GITERR_ODB, "Object content is longer than its declared size");
+	if(len==0)
+		return;
+	_sink->write(data, len);
+	_sink->offset += len;
+}
+
+size_t ObjectWriteStream::write(std::istream& stream)
+{
+	std::vector<char> buffer(64*1024);
+	size_t total = 0;
+	while(_sink && _sink->offset < _sink->size)
+	{
+		stream.read(&buffer[0], std::min(buffer.size(), _sink->size - _sink->offset));
+		size_t n = (size_t)stream.gcount();
+		if(n==0)
+			break;
+		write(&buffer[0], n);
+		total += n;
+	}
+	return total;
+}
+
+size_t ObjectWriteStream::write(std::function<size_t(void*, size_t)> source, size_t chunkSize)
+{
+	std::vector<char> buffer(std::max(chunkSize, (size_t)1));
+	size_t total = 0;
+	while(_sink && _sink->offset < _sink->size)
+	{
+		size_t n = source(&buffer[0], std::min(buffer.size(), _sink->size - _sink->offset));
+		if(n==0)
+			break;
+		write(&buffer[0], n);
+		total += n;
+	}
+	return total;
+}
+
+OId ObjectWriteStream::finalize()
+{
+	if(!_sink)
+		throw_stream_error(GITERR_INVALID, "Object write stream is not open");
+	if(_sink->offset != _sink->size)
+		throw_stream_error(GITERR_ODB, "Object content is shorter than its declared size");
+	std::shared_ptr<Sink> sink;
+	sink.swap(_sink);
+	return sink->finalize();
+}
+
+} // namespace git2
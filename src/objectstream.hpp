@@ -0,0 +1,214 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_OBJECTSTREAM_HPP_
+#define _GIT2PP_OBJECTSTREAM_HPP_
+
+#include <git2.h>
+
+#include <functional>
+#include <istream>
+#include <memory>
+
+#include "oid.hpp"
+
+namespace git2
+{
+
+class Database;
+
+/**
+ * Sequential reader of the content of an object.
+ *
+ * Loose objects, and packed objects stored without delta, are inflated
+ * straight from their file into the buffers given to read(), so only
+ * a small input buffer is resident whatever the object size.
+ * Objects only reachable through a custom backend are read with the
+ * backend read stream when it provides one, other objects (deltified
+ * ones for example) are fully read first then served by chunks.
+ *
+ * Copies share the same read position.
+ */
+class ObjectReadStream
+{
+public:
+	/**
+	 * Create a closed stream.
+	 */
+	ObjectReadStream();
+
+	/**
+	 * Open a stream on an object of a database.
+	 *
+	 * @param db database to read from.
+	 * @param oid full-length id of the object.
+	 * @throws Exception
+	 */
+	ObjectReadStream(const Database& db, const OId& oid);
+
+	/**
+	 * Check if the stream is opened.
+	 */
+	bool isOpen() const;
+
+	/**
+	 * Type of the object.
+	 */
+	git_otype type() const;
+
+	/**
+	 * Size of the object content.
+	 */
+	size_t size() const;
+
+	/**
+	 * Number of bytes already read.
+	 */
+	size_t offset() const;
+
+	/**
+	 * Check if all the content was read.
+	 */
+	bool atEnd() const;
+
+	/**
+	 * Read the next bytes of the content.
+	 *
+	 * @param buffer where to store the bytes.
+	 * @param len maximal number of bytes to read.
+	 * @return Number of bytes read, 0 at the end of the content.
+	 * @throws Exception
+	 */
+	size_t read(void* buffer, size_t len);
+
+	/**
+	 * Read the remaining content by chunks.
+	 *
+	 * @param sink called with each chunk, returning false stops the reading.
+	 * @param chunkSize maximal size of chunks.
+	 * @return Number of bytes given to the sink.
+	 * @throws Exception
+	 */
+	size_t pipe(std::function<bool(const void*, size_t)> sink, size_t chunkSize = 64*1024);
+
+private:
+	class Source;
+	class InflateSource;
+	class BackendSource;
+	class MemorySource;
+
+	std::shared_ptr<Source> _source;
+};
+
+/**
+ * Sequential writer of a new object, whose size is known beforehand.
+ *
+ * Big objects written to a database with an objects directory and no
+ * added backend (see Database::isDirectoryOnly()) are written there as
+ * loose objects by a pipeline: the chunks given to write() are hashed,
+ * deflated and written to the file by three threads, so the calling
+ * thread only copies them. The file is not installed if the database
+ * already has the object. Other objects are written
+ * with the database write stream (git_odb_open_wstream).
+ *
+ * Copies share the same stream. A stream destroyed without being
+ * finalized writes nothing.
+ */
+class ObjectWriteStream
+{
+public:
+	/**
+	 * Create a closed stream.
+	 */
+	ObjectWriteStream();
+
+	/**
+	 * Open a stream writing an object to a database.
+	 *
+	 * @param db database to write to.
+	 * @param size exact size of the object content.
+	 * @param type type of the object.
+	 * @throws Exception
+	 */
+	ObjectWriteStream(const Database& db, size_t size, git_otype type);
+
+	/**
+	 * Check if the stream is opened.
+	 */
+	bool isOpen() const;
+
+	/**
+	 * Type of the object.
+	 */
+	git_otype type() const;
+
+	/**
+	 * Size of the object content.
+	 */
+	size_t size() const;
+
+	/**
+	 * Number of bytes already written.
+	 */
+	size_t offset() const;
+
+	/**
+	 * Write the next bytes of the content.
+	 *
+	 * @throws Exception if the content gets longer than the object size.
+	 */
+	void write(const void* data, size_t len);
+
+	/**
+	 * Write the content read from a stream, until its end or the object size.
+	 *
+	 * @return Number of bytes written.
+	 * @throws Exception
+	 */
+	size_t write(std::istream& stream);
+
+	/**
+	 * Write the content produced by a function, until it returns 0 or the
+	 * object size is reached.
+	 *
+	 * @param source fills a buffer of the given size, returns the number of bytes put.
+	 * @param chunkSize maximal size of chunks.
+	 * @return Number of bytes written.
+	 * @throws Exception
+	 */
+	size_t write(std::function<size_t(void*, size_t)> source, size_t chunkSize = 64*1024);
+
+	/**
+	 * Finish writing the object and close the stream.
+	 *
+	 * @return Id of the written object.
+	 * @throws Exception if the content is shorter than the object size.
+	 */
+	OId finalize();
+
+private:
+	class Sink;
+	class BackendSink;
+	class PipelineSink;
+
+	std::shared_ptr<Sink> _sink;
+};
+
+} // namespace git2
+#endif // _GIT2PP_OBJECTSTREAM_HPP_
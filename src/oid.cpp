@@ -21,62 +21,66 @@
 
 #include "exception.hpp"
 
-namespace git2
-{
+#include <algorithm>
+#include <type_traits>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GIT2PP_OID_HEX_X86 1
+#include <immintrin.h>
+#endif
 
-OId::OId(const git_oid *oid):
-_oid((size_t)GIT_OID_RAWSZ, (unsigned char)0)
+namespace git2
 {
-	if(oid!=NULL)
-	{
-		_oid.assign((unsigned char*)oid, (unsigned char*)oid+GIT_OID_RAWSZ);
-	}
-}
 
+static_assert(std::is_trivially_copyable<OId>::value, "OId must stay a trivially copyable value type");
 
-OId::OId(const OId& oid):
-_oid(oid._oid)
-{
-}
 
-OId::~OId()
+OId::OId(const git_oid *oid):
+_len(GIT_OID_HEXSZ)
 {
+	if(oid!=NULL)
+		_oid = *oid;
+	else
+		std::memset(_oid.id, 0, GIT_OID_RAWSZ);
 }
 
 bool OId::isValid() const
 {
-	return ( !_oid.empty() &&
-	         (_oid.size() <= GIT_OID_RAWSZ) &&
-	         (_oid != std::vector<unsigned char>((size_t)GIT_OID_RAWSZ, (unsigned char)0))
-	         );
+	return _len>0 && !isZero();
 }
 
 void OId::fromHex(const std::vector<char>& hex)
 {
 	size_t len = std::min(hex.size(), (size_t)GIT_OID_HEXSZ);
-	 Exception::git2_assert(git_oid_fromstrn(data(), &hex.front(), len));
-	_oid.resize(len / 2);
+	std::memset(_oid.id, 0, GIT_OID_RAWSZ);
+	Exception::git2_assert(git_oid_fromstrn(data(), hex.data(), len));
+	_len = len;
 }
 
 void OId::fromString(const std::string& str)
 {
 	size_t len = std::min(str.size(), (size_t)GIT_OID_HEXSZ);
-	 Exception::git2_assert(git_oid_fromstrn(data(), str.c_str(), len));
-	_oid.resize(len / 2);
+	std::memset(_oid.id, 0, GIT_OID_RAWSZ);
+	Exception::git2_assert(git_oid_fromstrn(data(), str.data(), len));
+	_len = len;
 }
 
 void OId::fromRawData(const std::vector<unsigned char>& raw)
 {
-	if(raw.size()<GIT_OID_RAWSZ)
-		_oid = raw;
-	else
-		_oid.assign(raw.begin(), raw.begin()+GIT_OID_RAWSZ);
+	size_t len = std::min(raw.size(), (size_t)GIT_OID_RAWSZ);
+	std::memset(_oid.id, 0, GIT_OID_RAWSZ);
+	std::memcpy(_oid.id, raw.data(), len);
+	_len = len * 2;
 }
 
 bool OId::isZero() const
 {
-	return git_oid_iszero(constData());
+	for(size_t n=0; n<GIT_OID_RAWSZ; ++n)
+	{
+		if(_oid.id[n]!=0)
+			return false;
+	}
+	return true;
 }
 
 OId OId::hexToOid(const std::vector<char>& hex)
@@ -102,61 +106,197 @@ OId OId::rawDataToOid(const std::vector<unsigned char>& raw)
 
 std::string OId::format() const
 {
-	std::vector<char> buffer((size_t)GIT_OID_HEXSZ+1, (char)0);
-	git_oid_fmt(buffer.data(), constData());
-	return std::string(buffer.data());
+	char buffer[GIT_OID_HEXSZ];
+	formatMany(this, 1, buffer);
+	return std::string(buffer, _len);
 }
 
 std::string OId::pathFormat() const
 {
-	std::vector<char> buffer((size_t)GIT_OID_HEXSZ+1, (char)0);
-	git_oid_pathfmt(buffer.data(), constData());
-	return std::string(buffer.data());
+	char buffer[GIT_OID_HEXSZ+1];
+	git_oid_pathfmt(buffer, constData());
+	return std::string(buffer, GIT_OID_HEXSZ+1);
 }
 
-git_oid* OId::data()
+//
+// Bulk hexadecimal conversions
+//
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Nibble value of an hexadecimal character, -1 if not an hex digit.
+static const signed char hex_values[256] = {
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1,
+	-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+
+// Kernels convert one raw 20-byte id at a time.
+// Decoders return false if an invalid character is found.
+typedef void (*hex_encode_fn)(const unsigned char* raw, char* out);
+typedef bool (*hex_decode_fn)(const char* hex, unsigned char* raw);
+
+static void hex_encode_scalar(const unsigned char* raw, char* out)
+{
+	for(size_t n=0; n<GIT_OID_RAWSZ; ++n)
+	{
+		*out++ = hex_digits[raw[n] >> 4];
+		*out++ = hex_digits[raw[n] & 0x0F];
+	}
+}
+
+static bool hex_decode_scalar(const char* hex, unsigned char* raw)
+{
+	int bad = 0;
+	for(size_t n=0; n<GIT_OID_RAWSZ; ++n)
+	{
+		int hi = hex_values[(unsigned char)hex[2*n]];
+		int lo = hex_values[(unsigned char)hex[2*n+1]];
+		bad |= hi | lo;
+		raw[n] = (unsigned char)((hi << 4) | (lo & 0x0F));
+	}
+	return bad >= 0;
+}
+
+#ifdef GIT2PP_OID_HEX_X86
+
+// Convert 16 raw bytes into 32 hex digits (two 16-byte halves).
+__attribute__((target("ssse3")))
+static inline void hex_encode16_ssse3(__m128i bytes, __m128i& first, __m128i& second)
 {
-	return reinterpret_cast<git_oid*>(&_oid.front());
+	const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_digits));
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	__m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+	__m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+	first  = _mm_unpacklo_epi8(hi, lo);
+	second = _mm_unpackhi_epi8(hi, lo);
 }
-	
-const git_oid* OId::constData() const
+
+__attribute__((target("ssse3")))
+static void hex_encode_ssse3(const unsigned char* raw, char* out)
 {
-	return reinterpret_cast<const git_oid*>(&_oid.front());
+	__m128i first, second;
+	// Bytes 4..19 overlap bytes 0..15, this covers the 20 bytes with two loads.
+	hex_encode16_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + 4)), first, second);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), first);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 24), second);
+	hex_encode16_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(raw)), first, second);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), first);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), second);
 }
 
-int OId::length() const
+__attribute__((target("avx2")))
+static void hex_encode_avx2(const unsigned char* raw, char* out)
 {
-	return _oid.size() * 2;
+	// Low lane holds bytes 0..15, high lane bytes 4..19.
+	const __m256i bytes = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(raw))),
+		_mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + 4)), 1);
+	const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_digits)));
+	const __m256i mask = _mm256_set1_epi8(0x0F);
+	__m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+	__m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, mask));
+	__m256i first  = _mm256_unpacklo_epi8(hi, lo);
+	__m256i second = _mm256_unpackhi_epi8(hi, lo);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(first));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm256_castsi256_si128(second));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 24), _mm256_extracti128_si256(second, 1));
 }
 
-bool operator ==(const OId &oid1, const OId &oid2)
+// Convert 16 hex digits into 8 raw bytes, stored in the low half of the result.
+__attribute__((target("ssse3")))
+static inline __m128i hex_decode16_ssse3(__m128i chars, __m128i& bad)
 {
-	return git_oid_cmp(oid1.constData(), oid2.constData()) == 0;
+	// Fold upper case letters onto lower case ones, digits are left untouched.
+	const __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+	const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+	const __m128i alpha = _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10));
+	// Signed comparisons, bytes >= 0x80 are negative and so rejected.
+	const __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+	                                      _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+	const __m128i isAlpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+	                                      _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+	bad = _mm_or_si128(bad, _mm_andnot_si128(_mm_or_si128(isDigit, isAlpha), _mm_set1_epi8(-1)));
+	const __m128i nibbles = _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_andnot_si128(isDigit, alpha));
+	// Merge pairs of nibbles: hi*16 + lo.
+	const __m128i words = _mm_maddubs_epi16(nibbles, _mm_set1_epi16(0x0110));
+	return _mm_packus_epi16(words, words);
 }
 
-bool operator !=(const OId &oid1, const OId &oid2)
+__attribute__((target("ssse3")))
+static bool hex_decode_ssse3(const char* hex, unsigned char* raw)
 {
-	return git_oid_cmp(oid1.constData(), oid2.constData()) != 0;
+	__m128i bad = _mm_setzero_si128();
+	// Digits 24..39 overlap digits 16..31, this covers the 40 digits with three loads.
+	__m128i b0 = hex_decode16_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex)), bad);
+	__m128i b1 = hex_decode16_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16)), bad);
+	__m128i b2 = hex_decode16_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 24)), bad);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(raw), b0);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(raw + 8), b1);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(raw + 12), b2);
+	return _mm_movemask_epi8(bad) == 0;
 }
 
-bool operator >(const OId &oid1, const OId &oid2)
+#endif // GIT2PP_OID_HEX_X86
+
+static hex_encode_fn select_hex_encoder()
 {
-	return git_oid_cmp(oid1.constData(), oid2.constData()) > 0;
+#ifdef GIT2PP_OID_HEX_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return hex_encode_avx2;
+	if(__builtin_cpu_supports("ssse3"))
+		return hex_encode_ssse3;
+#endif
+	return hex_encode_scalar;
 }
 
-bool operator <(const OId &oid1, const OId &oid2)
+static hex_decode_fn select_hex_decoder()
 {
-	return git_oid_cmp(oid1.constData(), oid2.constData()) < 0;
+#ifdef GIT2PP_OID_HEX_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("ssse3"))
+		return hex_decode_ssse3;
+#endif
+	return hex_decode_scalar;
 }
 
-bool operator >=(const OId &oid1, const OId &oid2)
+void OId::formatMany(const OId* oids, size_t count, char* out)
 {
-	return git_oid_cmp(oid1.constData(), oid2.constData()) >= 0;
+	static const hex_encode_fn encode = select_hex_encoder();
+	for(size_t n=0; n<count; ++n)
+	{
+		encode(oids[n]._oid.id, out);
+		out += GIT_OID_HEXSZ;
+	}
 }
 
-bool operator <=(const OId &oid1, const OId &oid2)
+void OId::parseMany(const char* hex, size_t count, OId* out)
 {
-	return git_oid_cmp(oid1.constData(), oid2.constData()) <= 0;
+	static const hex_decode_fn decode = select_hex_decoder();
+	for(size_t n=0; n<count; ++n)
+	{
+		if(!decode(hex, out[n]._oid.id))
+		{
+			giterr_set_str(GITERR_INVALID, "Unable to parse OId - contains invalid characters");
+			throw Exception(GIT_ERROR);
+		}
+		out[n]._len = GIT_OID_HEXSZ;
+		hex += GIT_OID_HEXSZ;
+	}
 }
 
 bool operator == (const OId &oid, const std::string &str)
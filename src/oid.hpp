@@ -22,6 +22,9 @@
 
 #include <git2.h>
 
+#include <cstddef>
+#include <cstring>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -29,20 +32,40 @@ namespace git2
 {
 
 
+namespace helper
+{
+
+/**
+ * Compile-time friendly lexicographic comparison of raw oid bytes.
+ * @return negative, zero or positive like memcmp.
+ */
+constexpr int oid_cmp(const unsigned char* a, const unsigned char* b, size_t n)
+{
+	return n==0 ? 0 : ( *a!=*b ? (*a<*b ? -1 : 1) : oid_cmp(a+1, b+1, n-1) );
+}
+
+} // namespace helper
+
 /**
  * This class represent a Git SHA1 id, i.e. 40 hexadecimal digits.
+ *
+ * OId is a trivially copyable value type: the 20 raw bytes are stored
+ * inline, no heap allocation is ever done when creating or copying it.
+ * Shortened ids (prefixes) keep their significant length in a separate
+ * field, the unused trailing bytes are always zero.
  */
 class OId
 {
 public:
-	/** Constructor */
-	OId(const git_oid *oid = NULL);
-
-	/** Copy constructor */
-	OId(const OId& oid);
+	/** Constructor, null (all zeros) full-length OId. */
+	constexpr OId():
+	_oid(),
+	_len(GIT_OID_HEXSZ)
+	{
+	}
 
-	/** Destructor */
-	~OId();
+	/** Constructor from a raw git_oid, null OId if oid is NULL. */
+	OId(const git_oid *oid);
 
     /**
      * Checks if this is a valid Git OId.
@@ -52,15 +75,33 @@ public:
     bool isValid() const;
 	
 
-    git_oid* data();
-    const git_oid* constData() const;
+    git_oid* data(){return &_oid;}
+    const git_oid* constData() const{return &_oid;}
+
+	/**
+	 * Returns the raw bytes of the OId.
+	 */
+	constexpr const unsigned char* raw() const{return _oid.id;}
 
 	/**
 	 * Returns the length of the OId as a number of hexadecimal characters.
 	 *
 	 * The full length of a OId is 40, but OId represented by this class may be shorter.
      */
-	int length() const;
+	constexpr int length() const{return _len;}
+
+	/**
+	 * Check if the OId is a full-length one (40 hexadecimal characters).
+	 */
+	constexpr bool isFull() const{return _len==GIT_OID_HEXSZ;}
+
+	/**
+	 * Three-way comparison of raw bytes, like git_oid_cmp.
+	 */
+	constexpr int compare(const OId& other) const
+	{
+		return helper::oid_cmp(_oid.id, other._oid.id, GIT_OID_RAWSZ);
+	}
 
     /**
      * Set the value of the object parsing a hex array.
@@ -152,41 +193,87 @@ public:
      */
     static OId rawDataToOid(const std::vector<unsigned char>& raw);
 
-	// TODO Should implement oid shorten related functions ?
-	
+	/**
+	 * Format an array of OIds into a caller-provided buffer.
+	 *
+	 * Each id is written as its full 40 hexadecimal digits, without
+	 * separator nor terminating NUL, whatever its length is.
+	 * SIMD kernels (AVX2 or SSSE3) are used when the CPU supports them.
+	 *
+	 * @param oids OIds to format.
+	 * @param count number of OIds.
+	 * @param out output buffer, at least count*GIT_OID_HEXSZ characters.
+	 */
+	static void formatMany(const OId* oids, size_t count, char* out);
+
+	/**
+	 * Parse an array of full-length hex ids from a caller-provided buffer.
+	 *
+	 * The buffer holds count ids of 40 hexadecimal digits each, without
+	 * separator. Both lower and upper case digits are accepted.
+	 * SIMD kernels (SSSE3) are used when the CPU supports them.
+	 *
+	 * @param hex input buffer, at least count*GIT_OID_HEXSZ characters.
+	 * @param count number of ids to parse.
+	 * @param out output OIds, at least count elements.
+	 * @throws Exception if a non hexadecimal character is found.
+	 */
+	static void parseMany(const char* hex, size_t count, OId* out);
+
+	// Unique abbreviation lengths are computed by Database::abbreviate().
+
 private:
-	std::vector<unsigned char> _oid;
+	git_oid _oid;
+	unsigned char _len;
 };
 
 /**
  * Compare two OIds.
  */
-bool operator ==(const OId &oid1, const OId &oid2);
+constexpr bool operator ==(const OId &oid1, const OId &oid2)
+{
+	return oid1.compare(oid2) == 0;
+}
 
 /**
  * Compare two OIds.
  */
-bool operator !=(const OId &oid1, const OId &oid2);
+constexpr bool operator !=(const OId &oid1, const OId &oid2)
+{
+	return oid1.compare(oid2) != 0;
+}
 
 /**
  * Compare two OIds.
  */
-bool operator >(const OId &oid1, const OId &oid2);
+constexpr bool operator >(const OId &oid1, const OId &oid2)
+{
+	return oid1.compare(oid2) > 0;
+}
 
 /**
  * Compare two OIds.
  */
-bool operator <(const OId &oid1, const OId &oid2);
+constexpr bool operator <(const OId &oid1, const OId &oid2)
+{
+	return oid1.compare(oid2) < 0;
+}
 
 /**
  * Compare two OIds.
  */
-bool operator >=(const OId &oid1, const OId &oid2);
+constexpr bool operator >=(const OId &oid1, const OId &oid2)
+{
+	return oid1.compare(oid2) >= 0;
+}
 
 /**
  * Compare two OIds.
  */
-bool operator <=(const OId &oid1, const OId &oid2);
+constexpr bool operator <=(const OId &oid1, const OId &oid2)
+{
+	return oid1.compare(oid2) <= 0;
+}
 
 /**
  * Compare an OId with a string.
@@ -200,5 +287,28 @@ bool operator == (const OId &oid, const char* str);
 
 
 } // namespace git2
+
+namespace std
+{
+
+/**
+ * Hash of an OId.
+ *
+ * SHA-1 bytes are already uniformly distributed, the first bytes of the
+ * id are used as is.
+ */
+template<>
+struct hash<git2::OId>
+{
+	size_t operator()(const git2::OId& oid) const
+	{
+		size_t h;
+		std::memcpy(&h, oid.raw(), sizeof(h));
+		return h;
+	}
+};
+
+} // namespace std
+
 #endif // _GIT2PP_OID_HPP_
 
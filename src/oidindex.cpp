@@ -0,0 +1,442 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "oidindex.hpp"
+
+#include "exception.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <dirent.h>
+
+namespace git2
+{
+
+static bool oid_less(const git_oid& a, const git_oid& b)
+{
+	return std::memcmp(a.id, b.id, GIT_OID_RAWSZ) < 0;
+}
+
+static bool oid_equal(const git_oid& a, const git_oid& b)
+{
+	return std::memcmp(a.id, b.id, GIT_OID_RAWSZ) == 0;
+}
+
+// Number of leading hexadecimal digits shared by two ids.
+static int common_hex_length(const git_oid& a, const git_oid& b)
+{
+	int n = 0;
+	while(n<GIT_OID_RAWSZ && a.id[n]==b.id[n])
+		++n;
+	if(n==GIT_OID_RAWSZ)
+		return GIT_OID_HEXSZ;
+	return 2*n + (((a.id[n] ^ b.id[n]) & 0xF0) == 0 ? 1 : 0);
+}
+
+// Position of the first id not less than oid in ids[pos, end), searching
+// forward from pos with growing steps: successive sorted queries are
+// usually far sparser than the ids, so most of them are skipped at once.
+static size_t gallop(const git_oid* ids, size_t pos, size_t end, const git_oid& oid)
+{
+	size_t low = pos, step = 1;
+	while(pos<end && oid_less(ids[pos], oid))
+	{
+		low = pos + 1;
+		pos += step;
+		step *= 2;
+	}
+	return std::lower_bound(ids+low, ids+std::min(pos, end), oid, oid_less) - ids;
+}
+
+static uint32_t read_be32(const unsigned char* buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+static bool ends_with(const std::string& str, const std::string& suffix)
+{
+	return str.size()>=suffix.size() && str.compare(str.size()-suffix.size(), suffix.size(), suffix)==0;
+}
+
+// Read the sorted id table of a pack index file (version 1 or 2).
+static bool read_pack_index(const std::string& path, std::vector<git_oid>& ids)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+		return false;
+
+	unsigned char header[8];
+	if(!file.read((char*)header, sizeof(header)))
+		return false;
+
+	bool v2 = header[0]==0xFF && header[1]=='t' && header[2]=='O' && header[3]=='c';
+	if(v2 && read_be32(header+4)!=2)
+		return false;
+
+	unsigned char fanout[256*4];
+	file.seekg(v2 ? 8 : 0);
+	if(!file.read((char*)fanout, sizeof(fanout)))
+		return false;
+	uint32_t count = read_be32(fanout + 255*4);
+
+	size_t first = ids.size();
+	ids.resize(first + count);
+	if(v2)
+	{
+		// Names table follows the fan-out table.
+		if(!file.read((char*)&ids[first], (std::streamsize)count*GIT_OID_RAWSZ))
+		{
+			ids.resize(first);
+			return false;
+		}
+	}
+	else
+	{
+		// Entries are 4-byte offset followed by the name.
+		unsigned char entry[4 + GIT_OID_RAWSZ];
+		for(uint32_t n=0; n<count; ++n)
+		{
+			if(!file.read((char*)entry, sizeof(entry)))
+			{
+				ids.resize(first);
+				return false;
+			}
+			std::memcpy(ids[first+n].id, entry+4, GIT_OID_RAWSZ);
+		}
+	}
+	return true;
+}
+
+static std::vector<std::string> list_directory(const std::string& path)
+{
+	std::vector<std::string> names;
+	DIR* dir = opendir(path.c_str());
+	if(dir==NULL)
+		return names;
+	while(struct dirent* entry = readdir(dir))
+	{
+		if(entry->d_name[0]!='.')
+			names.push_back(entry->d_name);
+	}
+	closedir(dir);
+	return names;
+}
+
+
+//
+// ObjectIdIndex::SortedIds
+//
+
+void ObjectIdIndex::SortedIds::build()
+{
+	std::sort(ids.begin(), ids.end(), oid_less);
+	ids.erase(std::unique(ids.begin(), ids.end(), oid_equal), ids.end());
+
+	size_t pos = 0;
+	for(size_t b=0; b<256; ++b)
+	{
+		while(pos<ids.size() && ids[pos].id[0]==b)
+			++pos;
+		fanout[b] = pos;
+	}
+}
+
+void ObjectIdIndex::SortedIds::merge(std::vector<git_oid>& other)
+{
+	std::sort(other.begin(), other.end(), oid_less);
+	size_t middle = ids.size();
+	ids.insert(ids.end(), other.begin(), other.end());
+	std::inplace_merge(ids.begin(), ids.begin()+middle, ids.end(), oid_less);
+	build();
+}
+
+bool ObjectIdIndex::SortedIds::contains(const git_oid& oid) const
+{
+	if(ids.empty())
+		return false;
+	size_t begin = oid.id[0]==0 ? 0 : fanout[oid.id[0]-1], end = fanout[oid.id[0]];
+	return std::binary_search(ids.begin()+begin, ids.begin()+end, oid, oid_less);
+}
+
+int ObjectIdIndex::SortedIds::commonLength(const git_oid& oid) const
+{
+	if(ids.empty())
+		return 0;
+	// Ids with another first byte share at most one digit, below any
+	// accepted abbreviation length, so only the fan-out bucket is searched.
+	size_t begin = oid.id[0]==0 ? 0 : fanout[oid.id[0]-1], end = fanout[oid.id[0]];
+	std::vector<git_oid>::const_iterator first = ids.begin()+begin, last = ids.begin()+end;
+	std::vector<git_oid>::const_iterator it = std::lower_bound(first, last, oid, oid_less);
+
+	int common = 0;
+	if(it!=first)
+		common = std::max(common, common_hex_length(oid, *(it-1)));
+	if(it!=last && oid_equal(*it, oid))
+		++it;
+	if(it!=last)
+		common = std::max(common, common_hex_length(oid, *it));
+	return common;
+}
+
+
+//
+// ObjectIdIndex
+//
+
+ObjectIdIndex::ObjectIdIndex(const std::string& objectsDir):
+_objectsDir(objectsDir),
+_loaded(false),
+_partial(false)
+{
+	while(_objectsDir.size()>1 && _objectsDir[_objectsDir.size()-1]=='/')
+		_objectsDir.erase(_objectsDir.size()-1);
+	std::fill(_packed.fanout, _packed.fanout+256, 0);
+	std::fill(_loose.fanout, _loose.fanout+256, 0);
+}
+
+const std::string& ObjectIdIndex::objectsDir() const
+{
+	return _objectsDir;
+}
+
+void ObjectIdIndex::setPartial()
+{
+	_partial = true;
+}
+
+bool ObjectIdIndex::partial() const
+{
+	return _partial;
+}
+
+std::vector<std::string> ObjectIdIndex::directories() const
+{
+	std::vector<std::string> dirs(1, _objectsDir);
+
+	// Alternates are listed one per line, absolute or relative to the objects directory.
+	std::ifstream alternates((_objectsDir + "/info/alternates").c_str());
+	std::string line;
+	while(std::getline(alternates, line))
+	{
+		while(!line.empty() && (line[line.size()-1]=='\r' || line[line.size()-1]=='/'))
+			line.erase(line.size()-1);
+		if(line.empty() || line[0]=='#')
+			continue;
+		dirs.push_back(line[0]=='/' ? line : _objectsDir + "/" + line);
+	}
+	return dirs;
+}
+
+void ObjectIdIndex::loadPacks(const std::string& objectsDir)
+{
+	std::string packDir = objectsDir + "/pack";
+	std::vector<git_oid> ids;
+	for(const std::string& name : list_directory(packDir))
+	{
+		std::string path = packDir + "/" + name;
+		if(!ends_with(name, ".idx") || _packs.count(path)!=0)
+			continue;
+		if(read_pack_index(path, ids))
+			_packs.insert(path);
+	}
+	if(!ids.empty())
+		_packed.merge(ids);
+}
+
+void ObjectIdIndex::scanLoose(const std::string& objectsDir, std::vector<git_oid>& ids)
+{
+	static const char hex[] = "0123456789abcdef";
+	char fan[3] = {0, 0, 0};
+	for(int b=0; b<256; ++b)
+	{
+		fan[0] = hex[b>>4];
+		fan[1] = hex[b&0xF];
+		for(const std::string& name : list_directory(objectsDir + "/" + fan))
+		{
+			if(name.size()!=GIT_OID_HEXSZ-2)
+				continue;
+			git_oid oid;
+			std::string str = fan + name;
+			if(git_oid_fromstrn(&oid, str.c_str(), str.size())==GIT_OK)
+				ids.push_back(oid);
+		}
+	}
+}
+
+void ObjectIdIndex::load()
+{
+	std::vector<std::string> dirs = directories();
+	std::vector<git_oid> loose;
+	for(const std::string& dir : dirs)
+	{
+		loadPacks(dir);
+		scanLoose(dir, loose);
+	}
+	_loose.ids.swap(loose);
+	_loose.build();
+	_loaded = true;
+}
+
+void ObjectIdIndex::refresh()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_loaded)
+		load();
+}
+
+size_t ObjectIdIndex::size()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(!_loaded)
+		load();
+	size_t count = _packed.ids.size();
+	for(const git_oid& oid : _loose.ids)
+	{
+		if(!_packed.contains(oid))
+			++count;
+	}
+	return count;
+}
+
+bool ObjectIdIndex::contains(const OId& oid)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(!_loaded)
+		load();
+	return _packed.contains(*oid.constData()) || _loose.contains(*oid.constData());
+}
+
+std::vector<bool> ObjectIdIndex::containsMany(const std::vector<OId>& oids)
+{
+	std::vector<bool> found(oids.size(), false);
+	std::vector<size_t> order(oids.size());
+	for(size_t n=0; n<order.size(); ++n)
+		order[n] = n;
+	std::sort(order.begin(), order.end(), [&oids](size_t a, size_t b){
+			return oid_less(*oids[a].constData(), *oids[b].constData());
+		});
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::vector<std::string> dirs = directories();
+	if(!_loaded)
+		load();
+	else
+	{
+		for(const std::string& dir : dirs)
+			loadPacks(dir);
+	}
+
+	// Merge-join with the packed ids, bucket by bucket.
+	std::vector<size_t> missing;
+	const git_oid* packed = _packed.ids.data();
+	size_t pos = 0;
+	for(size_t index : order)
+	{
+		const git_oid& oid = *oids[index].constData();
+		size_t begin = oid.id[0]==0 ? 0 : _packed.fanout[oid.id[0]-1], end = _packed.fanout[oid.id[0]];
+		pos = gallop(packed, std::max(pos, begin), end, oid);
+		if(pos<end && oid_equal(packed[pos], oid))
+			found[index] = true;
+		else
+			missing.push_back(index);
+	}
+
+	// Loose objects, listing each fan-out directory holding missing ids once.
+	static const char hex[] = "0123456789abcdef";
+	for(size_t n=0, last=0; n<missing.size(); n=last)
+	{
+		unsigned char first = oids[missing[n]].raw()[0];
+		for(last=n; last<missing.size() && oids[missing[last]].raw()[0]==first; ++last);
+
+		char fan[3] = {hex[first>>4], hex[first&0xF], 0};
+		std::vector<std::string> names;
+		for(const std::string& dir : dirs)
+		{
+			std::vector<std::string> listed = list_directory(dir + "/" + fan);
+			names.insert(names.end(), listed.begin(), listed.end());
+		}
+		if(names.empty())
+			continue;
+		std::sort(names.begin(), names.end());
+
+		char str[GIT_OID_HEXSZ + 1];
+		str[GIT_OID_HEXSZ] = 0;
+		for(size_t m=n; m<last; ++m)
+		{
+			git_oid_fmt(str, oids[missing[m]].constData());
+			if(std::binary_search(names.begin(), names.end(), std::string(str+2)))
+				found[missing[m]] = true;
+		}
+	}
+	return found;
+}
+
+std::vector<OId> ObjectIdIndex::ids(unsigned char first)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(!_loaded)
+		load();
+
+	// Objects can be both loose and packed, the two buckets are merged without duplicates.
+	std::vector<git_oid> merged;
+	size_t packedBegin = first==0 ? 0 : _packed.fanout[first-1], packedEnd = _packed.fanout[first];
+	size_t looseBegin = first==0 ? 0 : _loose.fanout[first-1], looseEnd = _loose.fanout[first];
+	merged.reserve(packedEnd - packedBegin + looseEnd - looseBegin);
+	std::set_union(_packed.ids.begin()+packedBegin, _packed.ids.begin()+packedEnd,
+		_loose.ids.begin()+looseBegin, _loose.ids.begin()+looseEnd,
+		std::back_inserter(merged), oid_less);
+
+	std::vector<OId> ids;
+	ids.reserve(merged.size());
+	for(const git_oid& oid : merged)
+		ids.push_back(OId(&oid));
+	return ids;
+}
+
+int ObjectIdIndex::abbreviateLocked(const OId& oid, int minLength) const
+{
+	int common = std::max(_packed.commonLength(*oid.constData()), _loose.commonLength(*oid.constData()));
+	return std::min(std::max(common + 1, minLength), (int)GIT_OID_HEXSZ);
+}
+
+int ObjectIdIndex::abbreviate(const OId& oid, int minLength)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(!_loaded)
+		load();
+	return abbreviateLocked(oid, std::max(minLength, (int)GIT_OID_MINPREFIXLEN));
+}
+
+std::vector<int> ObjectIdIndex::abbreviate(const std::vector<OId>& oids, int minLength)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(!_loaded)
+		load();
+	minLength = std::max(minLength, (int)GIT_OID_MINPREFIXLEN);
+	std::vector<int> lengths;
+	lengths.reserve(oids.size());
+	for(const OId& oid : oids)
+		lengths.push_back(abbreviateLocked(oid, minLength));
+	return lengths;
+}
+
+} // namespace git2
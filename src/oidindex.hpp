@@ -0,0 +1,164 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_OIDINDEX_HPP_
+#define _GIT2PP_OIDINDEX_HPP_
+
+#include <git2.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "oid.hpp"
+
+namespace git2
+{
+
+/**
+ * Sorted snapshot of all object ids of an object directory.
+ *
+ * The snapshot is built from the pack `.idx` files and the loose object
+ * fan-out directories of an objects directory and of its alternates.
+ * Ids are kept in sorted arrays indexed by their first byte, which makes
+ * unique abbreviation computation a pair of neighbour comparisons.
+ *
+ * The snapshot is loaded on first use. refresh() only reads packs which
+ * were not loaded yet and rescans loose objects. Ids of packs removed
+ * since loading are kept, which can only make abbreviations longer.
+ *
+ * Instances are safe to share between threads.
+ */
+class ObjectIdIndex
+{
+public:
+	/**
+	 * Create an index over an objects directory.
+	 *
+	 * @param objectsDir path to the "objects" directory.
+	 */
+	ObjectIdIndex(const std::string& objectsDir);
+
+	/**
+	 * Objects directory indexed by this snapshot.
+	 */
+	const std::string& objectsDir() const;
+
+	/**
+	 * Load new packs and rescan loose objects.
+	 * Does nothing if the snapshot is not loaded yet.
+	 */
+	void refresh();
+
+	/**
+	 * Number of distinct ids in the snapshot.
+	 */
+	size_t size();
+
+	/**
+	 * Check if an id is known by the snapshot.
+	 */
+	bool contains(const OId& oid);
+
+	/**
+	 * Check a batch of ids against the objects on disk.
+	 *
+	 * Packs added since the snapshot was loaded are read first. Ids are
+	 * sorted and merge-joined with the packed ids; the ones not packed
+	 * are looked for in the loose objects with one listing per fan-out
+	 * directory, so objects written since loading are found.
+	 *
+	 * @param oids full-length ids to check.
+	 * @return One flag per id, in input order.
+	 */
+	std::vector<bool> containsMany(const std::vector<OId>& oids);
+
+	/**
+	 * List the ids of a fan-out bucket.
+	 *
+	 * @param first first byte of the ids to list.
+	 * @return Sorted unique ids whose first byte is first.
+	 */
+	std::vector<OId> ids(unsigned char first);
+
+	/**
+	 * Compute the minimal unique abbreviation length of an id.
+	 *
+	 * @param oid full-length id to abbreviate.
+	 * @param minLength minimal length to return, at least GIT_OID_MINPREFIXLEN.
+	 * @return Length in hexadecimal digits.
+	 */
+	int abbreviate(const OId& oid, int minLength = 7);
+
+	/**
+	 * Compute the minimal unique abbreviation lengths of a batch of ids.
+	 *
+	 * @param oids full-length ids to abbreviate.
+	 * @param minLength minimal length to return, at least GIT_OID_MINPREFIXLEN.
+	 * @return Lengths in hexadecimal digits, in input order.
+	 */
+	std::vector<int> abbreviate(const std::vector<OId>& oids, int minLength = 7);
+
+	/**
+	 * Record that a database using this snapshot got a backend which the
+	 * objects directory does not cover.
+	 */
+	void setPartial();
+
+	/**
+	 * Check if a database using this snapshot may know objects which are
+	 * not in the objects directory.
+	 */
+	bool partial() const;
+
+private:
+	/**
+	 * Sorted array of unique ids with its first-byte fan-out table.
+	 */
+	struct SortedIds
+	{
+		std::vector<git_oid> ids;
+		uint32_t fanout[256];
+
+		void build();
+		void merge(std::vector<git_oid>& other);
+		bool contains(const git_oid& oid) const;
+		int commonLength(const git_oid& oid) const;
+	};
+
+	void load();
+	void loadPacks(const std::string& objectsDir);
+	void scanLoose(const std::string& objectsDir, std::vector<git_oid>& ids);
+	std::vector<std::string> directories() const;
+	int abbreviateLocked(const OId& oid, int minLength) const;
+
+	std::string _objectsDir;
+	std::mutex _mutex;
+	bool _loaded;
+	std::atomic<bool> _partial;
+	std::set<std::string> _packs;
+	SortedIds _packed;
+	SortedIds _loose;
+};
+
+} // namespace git2
+#endif // _GIT2PP_OIDINDEX_HPP_
@@ -0,0 +1,474 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_OIDMAP_HPP_
+#define _GIT2PP_OIDMAP_HPP_
+
+#include <git2.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "oid.hpp"
+
+namespace git2
+{
+
+namespace helper
+{
+
+/**
+ * Flat open addressing hash table keyed by raw git object ids.
+ *
+ * Slots store the 20-byte key inline (and the value for maps) in one
+ * contiguous array, with linear probing and backward-shift deletion, so
+ * there is neither per-element allocation nor tombstone.
+ * The hash is made of the first 8 bytes of the id: SHA-1 output is
+ * already uniformly distributed, it is only mixed to pick the slot.
+ *
+ * @tparam _Slot Slot type, must be default constructible and have a
+ * `git_oid key` member.
+ */
+template<class _Slot>
+class OIdTable
+{
+public:
+	OIdTable():
+	_size(0),
+	_shift(64)
+	{
+	}
+
+	/**
+	 * Number of stored ids.
+	 */
+	size_t size() const {return _size;}
+
+	/**
+	 * Check if no id is stored.
+	 */
+	bool empty() const {return _size==0;}
+
+	/**
+	 * Number of slots currently allocated.
+	 */
+	size_t capacity() const {return _slots.size();}
+
+	/**
+	 * Remove all ids, keeping allocated slots.
+	 */
+	void clear()
+	{
+		std::fill(_used.begin(), _used.end(), (unsigned char)0);
+		std::fill(_slots.begin(), _slots.end(), _Slot());
+		_size = 0;
+	}
+
+	/**
+	 * Make room for at least count ids without rehashing.
+	 */
+	void reserve(size_t count)
+	{
+		size_t needed = 16;
+		while(needed - needed/4 < count)
+			needed *= 2;
+		if(needed > _slots.size())
+			rehash(needed);
+	}
+
+	/**
+	 * Find the slot of a key.
+	 * @return The slot, nullptr if not found.
+	 */
+	_Slot* findSlot(const git_oid& key) const
+	{
+		if(_size==0)
+			return nullptr;
+		const size_t mask = _slots.size() - 1;
+		for(size_t pos = bucket(key); _used[pos]; pos = (pos + 1) & mask)
+		{
+			if(std::memcmp(_slots[pos].key.id, key.id, GIT_OID_RAWSZ)==0)
+				return const_cast<_Slot*>(&_slots[pos]);
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Find or create the slot of a key.
+	 * @return The slot and true if it has just been created.
+	 */
+	std::pair<_Slot*, bool> insertSlot(const git_oid& key)
+	{
+		if(_size + 1 > _slots.size() - _slots.size()/4)
+			reserve(_size + 1);
+		const size_t mask = _slots.size() - 1;
+		size_t pos = bucket(key);
+		for(; _used[pos]; pos = (pos + 1) & mask)
+		{
+			if(std::memcmp(_slots[pos].key.id, key.id, GIT_OID_RAWSZ)==0)
+				return std::make_pair(&_slots[pos], false);
+		}
+		_used[pos] = 1;
+		_slots[pos].key = key;
+		++_size;
+		return std::make_pair(&_slots[pos], true);
+	}
+
+	/**
+	 * Remove a key.
+	 * @return True if the key was present.
+	 */
+	bool eraseSlot(const git_oid& key)
+	{
+		_Slot* slot = findSlot(key);
+		if(slot==nullptr)
+			return false;
+		const size_t mask = _slots.size() - 1;
+		size_t hole = slot - &_slots.front();
+		// Backward-shift following entries which probed past the hole.
+		for(size_t pos = (hole + 1) & mask; _used[pos]; pos = (pos + 1) & mask)
+		{
+			size_t home = bucket(_slots[pos].key);
+			if(((pos - home) & mask) >= ((pos - hole) & mask))
+			{
+				_slots[hole] = std::move(_slots[pos]);
+				hole = pos;
+			}
+		}
+		_used[hole] = 0;
+		_slots[hole] = _Slot();
+		--_size;
+		return true;
+	}
+
+	/**
+	 * Iterator over occupied slots.
+	 */
+	template<class _Value, class _Table>
+	class SlotIterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef _Value value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef _Value* pointer;
+		typedef _Value& reference;
+
+		SlotIterator():_table(nullptr),_pos(0){}
+		SlotIterator(_Table* table, size_t pos):_table(table),_pos(pos){skip();}
+
+		_Value& operator*() const {return _table->_slots[_pos];}
+		_Value* operator->() const {return &_table->_slots[_pos];}
+
+		SlotIterator& operator++(){++_pos; skip(); return *this;}
+		SlotIterator operator++(int){SlotIterator it(*this); ++*this; return it;}
+
+		bool operator==(const SlotIterator& other) const {return _pos==other._pos;}
+		bool operator!=(const SlotIterator& other) const {return _pos!=other._pos;}
+
+	private:
+		void skip()
+		{
+			while(_pos < _table->_slots.size() && !_table->_used[_pos])
+				++_pos;
+		}
+
+		_Table* _table;
+		size_t _pos;
+	};
+
+protected:
+	size_t bucket(const git_oid& key) const
+	{
+		uint64_t h;
+		std::memcpy(&h, key.id, sizeof(h));
+		return (size_t)((h * 0x9E3779B97F4A7C15ULL) >> _shift);
+	}
+
+	void rehash(size_t count)
+	{
+		std::vector<_Slot> slots(count);
+		std::vector<unsigned char> used(count, (unsigned char)0);
+		_slots.swap(slots);
+		_used.swap(used);
+		_shift = 64;
+		for(size_t n=count; n>1; n/=2)
+			--_shift;
+
+		const size_t mask = count - 1;
+		for(size_t n=0; n<slots.size(); ++n)
+		{
+			if(!used[n])
+				continue;
+			size_t pos = bucket(slots[n].key);
+			while(_used[pos])
+				pos = (pos + 1) & mask;
+			_used[pos] = 1;
+			_slots[pos] = std::move(slots[n]);
+		}
+	}
+
+	std::vector<_Slot> _slots;
+	std::vector<unsigned char> _used;
+	size_t _size;
+	unsigned int _shift;
+};
+
+/**
+ * Slot of an OIdSet.
+ */
+struct OIdSetSlot
+{
+	git_oid key;
+
+	OIdSetSlot():key(){}
+};
+
+/**
+ * Slot of an OIdMap.
+ */
+template<class V>
+struct OIdMapSlot
+{
+	git_oid key;
+	V value;
+
+	OIdMapSlot():key(),value(){}
+
+	/** Get the id of the entry. */
+	OId oid() const {return OId(&key);}
+};
+
+/**
+ * Reserve room in a table before inserting a range, when its size is known.
+ */
+template<class Table, class It>
+void reserve_for(Table& table, It first, It last, std::forward_iterator_tag)
+{
+	table.reserve(table.size() + std::distance(first, last));
+}
+
+template<class Table, class It>
+void reserve_for(Table&, It, It, std::input_iterator_tag)
+{
+}
+
+} // namespace helper
+
+
+/**
+ * Set of object ids.
+ *
+ * Flat open addressing set, tuned for "seen" sets of full git object ids.
+ * Ids are compared on their 20 raw bytes, prefix lengths are not kept.
+ */
+class OIdSet : public helper::OIdTable<helper::OIdSetSlot>
+{
+public:
+	/**
+	 * Iterator over stored ids, dereferencing to the OId.
+	 */
+	class const_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef OId value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const OId* pointer;
+		typedef OId reference;
+
+		const_iterator(){}
+		const_iterator(const OIdSet* set, size_t pos):_it(set, pos){}
+
+		OId operator*() const {return OId(&_it->key);}
+
+		const_iterator& operator++(){++_it; return *this;}
+		const_iterator operator++(int){const_iterator it(*this); ++_it; return it;}
+
+		bool operator==(const const_iterator& other) const {return _it==other._it;}
+		bool operator!=(const const_iterator& other) const {return _it!=other._it;}
+
+	private:
+		SlotIterator<const helper::OIdSetSlot, const OIdSet> _it;
+	};
+	typedef const_iterator iterator;
+
+	OIdSet(){}
+
+	/**
+	 * Insert an id.
+	 * @return True if the id was not already in the set.
+	 */
+	bool insert(const OId& oid)
+	{
+		return insertSlot(*oid.constData()).second;
+	}
+
+	/**
+	 * Insert a range of ids.
+	 */
+	template<class It>
+	void insert(It first, It last)
+	{
+		helper::reserve_for(*this, first, last, typename std::iterator_traits<It>::iterator_category());
+		for(; first!=last; ++first)
+			insert(*first);
+	}
+
+	/**
+	 * Check if an id is in the set.
+	 */
+	bool contains(const OId& oid) const
+	{
+		return findSlot(*oid.constData()) != nullptr;
+	}
+
+	/**
+	 * Count occurences of an id, 0 or 1.
+	 */
+	size_t count(const OId& oid) const
+	{
+		return contains(oid) ? 1 : 0;
+	}
+
+	/**
+	 * Remove an id.
+	 * @return True if the id was in the set.
+	 */
+	bool erase(const OId& oid)
+	{
+		return eraseSlot(*oid.constData());
+	}
+
+	const_iterator begin() const {return const_iterator(this, 0);}
+	const_iterator end() const {return const_iterator(this, _slots.size());}
+
+	friend class const_iterator;
+};
+
+
+/**
+ * Map of values keyed by object ids.
+ *
+ * Flat open addressing map, keys and values are stored inline.
+ * Ids are compared on their 20 raw bytes, prefix lengths are not kept.
+ * Iteration gives access to entries with `oid()` and `value` members.
+ *
+ * @tparam V Value type, must be default constructible.
+ */
+template<class V>
+class OIdMap : public helper::OIdTable<helper::OIdMapSlot<V>>
+{
+	typedef helper::OIdTable<helper::OIdMapSlot<V>> _Table;
+public:
+	typedef helper::OIdMapSlot<V> Entry;
+	typedef typename _Table::template SlotIterator<Entry, OIdMap> iterator;
+	typedef typename _Table::template SlotIterator<const Entry, const OIdMap> const_iterator;
+
+	OIdMap(){}
+
+	/**
+	 * Access the value of an id, default constructing it if needed.
+	 */
+	V& operator[](const OId& oid)
+	{
+		return this->insertSlot(*oid.constData()).first->value;
+	}
+
+	/**
+	 * Insert a value if its id is not already in the map.
+	 * @return True if inserted.
+	 */
+	bool insert(const OId& oid, const V& value)
+	{
+		std::pair<Entry*, bool> res = this->insertSlot(*oid.constData());
+		if(res.second)
+			res.first->value = value;
+		return res.second;
+	}
+
+	/**
+	 * Insert a range of (OId, V) pairs, existing ids are kept untouched.
+	 */
+	template<class It>
+	void insert(It first, It last)
+	{
+		helper::reserve_for(*this, first, last, typename std::iterator_traits<It>::iterator_category());
+		for(; first!=last; ++first)
+			insert(first->first, first->second);
+	}
+
+	/**
+	 * Find the value of an id.
+	 * @return Pointer to the value, nullptr if not found.
+	 */
+	V* find(const OId& oid)
+	{
+		Entry* entry = this->findSlot(*oid.constData());
+		return entry!=nullptr ? &entry->value : nullptr;
+	}
+
+	const V* find(const OId& oid) const
+	{
+		const Entry* entry = this->findSlot(*oid.constData());
+		return entry!=nullptr ? &entry->value : nullptr;
+	}
+
+	/**
+	 * Check if an id is in the map.
+	 */
+	bool contains(const OId& oid) const
+	{
+		return this->findSlot(*oid.constData()) != nullptr;
+	}
+
+	/**
+	 * Count occurences of an id, 0 or 1.
+	 */
+	size_t count(const OId& oid) const
+	{
+		return contains(oid) ? 1 : 0;
+	}
+
+	/**
+	 * Remove an id and its value.
+	 * @return True if the id was in the map.
+	 */
+	bool erase(const OId& oid)
+	{
+		return this->eraseSlot(*oid.constData());
+	}
+
+	iterator begin() {return iterator(this, 0);}
+	iterator end() {return iterator(this, this->_slots.size());}
+	const_iterator begin() const {return const_iterator(this, 0);}
+	const_iterator end() const {return const_iterator(this, this->_slots.size());}
+
+	friend iterator;
+	friend const_iterator;
+};
+
+
+} // namespace git2
+#endif // _GIT2PP_OIDMAP_HPP_
@@ -0,0 +1,969 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "packwriter.hpp"
+
+#include "exception.hpp"
+#include "oidmap.hpp"
+#include "sha1.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace git2
+{
+
+static void throw_pack_error(int klass, const std::string& msg)
+{
+	giterr_set_str(klass, msg.c_str());
+	throw Exception(GIT_ERROR);
+}
+
+static void put_be32(std::vector<unsigned char>& out, uint32_t value)
+{
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+static void put_varint(std::vector<unsigned char>& out, size_t value)
+{
+	do
+	{
+		unsigned char c = value & 0x7F;
+		value >>= 7;
+		if(value)
+			c |= 0x80;
+		out.push_back(c);
+	}
+	while(value);
+}
+
+// zlib counts are 32-bit: input and output are given by chunks.
+static const size_t ZlibChunk = 0x40000000;
+
+// Deflate a buffer into out. Returns false if zlib fails or out is too small.
+static bool deflate_buffer(z_stream& zs, const void* data, size_t size, Bytef*& out, size_t& outLeft)
+{
+	const Bytef* in = (const Bytef*)data;
+	for(;;)
+	{
+		size_t chunk = std::min(size, ZlibChunk);
+		uInt avail = (uInt)std::min(outLeft, ZlibChunk);
+		zs.next_in = (Bytef*)in;
+		zs.avail_in = (uInt)chunk;
+		zs.next_out = out;
+		zs.avail_out = avail;
+		int res = deflate(&zs, chunk==size ? Z_FINISH : Z_NO_FLUSH);
+		size_t consumed = chunk - zs.avail_in, produced = avail - zs.avail_out;
+		in += consumed;
+		size -= consumed;
+		out += produced;
+		outLeft -= produced;
+		if(res==Z_STREAM_END)
+			return true;
+		if(res!=Z_OK && res!=Z_BUF_ERROR)
+			return false;
+		if(consumed==0 && produced==0)
+			return false;
+	}
+}
+
+// Inflate a whole stream, which must fill out exactly.
+static bool inflate_buffer(z_stream& zs, const void* data, size_t size, Bytef* out, size_t outSize)
+{
+	const Bytef* in = (const Bytef*)data;
+	for(;;)
+	{
+		size_t chunk = std::min(size, ZlibChunk);
+		uInt avail = (uInt)std::min(outSize, ZlibChunk);
+		zs.next_in = (Bytef*)in;
+		zs.avail_in = (uInt)chunk;
+		zs.next_out = out;
+		zs.avail_out = avail;
+		int res = inflate(&zs, Z_NO_FLUSH);
+		size_t consumed = chunk - zs.avail_in, produced = avail - zs.avail_out;
+		in += consumed;
+		size -= consumed;
+		out += produced;
+		outSize -= produced;
+		if(res==Z_STREAM_END)
+			return outSize==0;
+		if(res!=Z_OK && res!=Z_BUF_ERROR)
+			return false;
+		if(consumed==0 && produced==0)
+			return false;
+	}
+}
+
+//
+// Deltas, in the git format: source and target sizes, then copy and insert commands.
+//
+
+static const size_t DeltaBlock = 16;
+
+static uint32_t delta_block_hash(const unsigned char* data)
+{
+	uint32_t hash = 2166136261u;
+	for(size_t i=0; i<DeltaBlock; ++i)
+		hash = (hash ^ data[i]) * 16777619u;
+	return hash;
+}
+
+static void put_delta_copy(std::vector<unsigned char>& out, size_t offset, size_t size)
+{
+	size_t cmd = out.size();
+	out.push_back(0x80);
+	for(int b=0; b<4; ++b)
+	{
+		if((offset >> (8*b)) & 0xFF)
+		{
+			out[cmd] |= 1 << b;
+			out.push_back((unsigned char)(offset >> (8*b)));
+		}
+	}
+	for(int b=0; b<3; ++b)
+	{
+		if((size >> (8*b)) & 0xFF)
+		{
+			out[cmd] |= 0x10 << b;
+			out.push_back((unsigned char)(size >> (8*b)));
+		}
+	}
+}
+
+// Greedy delta over 16-byte blocks of the source, false if larger than maxSize.
+static bool make_delta(const unsigned char* src, size_t srcLen, const unsigned char* dst, size_t dstLen, size_t maxSize, std::vector<unsigned char>& out)
+{
+	out.clear();
+	if(srcLen<DeltaBlock || dstLen<DeltaBlock || srcLen>=0xFFFFFFFFu)
+		return false;
+
+	size_t buckets = 16;
+	while(buckets < srcLen/DeltaBlock)
+		buckets *= 2;
+	const size_t mask = buckets - 1;
+	std::vector<uint32_t> table(buckets, 0xFFFFFFFFu);
+	for(size_t i=0; i+DeltaBlock<=srcLen; i+=DeltaBlock)
+		table[delta_block_hash(src + i) & mask] = (uint32_t)i;
+
+	put_varint(out, srcLen);
+	put_varint(out, dstLen);
+
+	size_t literal = 0;
+	auto flushLiterals = [&](size_t end)
+	{
+		while(literal<end)
+		{
+			size_t n = std::min(end - literal, (size_t)0x7F);
+			out.push_back((unsigned char)n);
+			out.insert(out.end(), dst + literal, dst + literal + n);
+			literal += n;
+		}
+	};
+
+	size_t i = 0;
+	while(i+DeltaBlock<=dstLen)
+	{
+		uint32_t candidate = table[delta_block_hash(dst + i) & mask];
+		if(candidate==0xFFFFFFFFu || std::memcmp(src + candidate, dst + i, DeltaBlock)!=0)
+		{
+			++i;
+			if(out.size() + (i - literal) > maxSize)
+				return false;
+			continue;
+		}
+
+		// Extend the match backward over pending literals, then forward.
+		size_t s = candidate, d = i;
+		while(s>0 && d>literal && src[s-1]==dst[d-1])
+		{
+			--s;
+			--d;
+		}
+		size_t srcEnd = candidate + DeltaBlock, dstEnd = i + DeltaBlock;
+		while(srcEnd<srcLen && dstEnd<dstLen && src[srcEnd]==dst[dstEnd])
+		{
+			++srcEnd;
+			++dstEnd;
+		}
+
+		flushLiterals(d);
+		for(size_t offset = s, remaining = dstEnd - d; remaining>0; )
+		{
+			size_t n = std::min(remaining, (size_t)0x10000);
+			put_delta_copy(out, offset, n);
+			offset += n;
+			remaining -= n;
+		}
+		i = literal = dstEnd;
+		if(out.size()>maxSize)
+			return false;
+	}
+	flushLiterals(dstLen);
+	return out.size()<=maxSize;
+}
+
+static bool apply_delta(const unsigned char* base, size_t baseLen, const unsigned char* delta, size_t deltaLen, std::vector<unsigned char>& out)
+{
+	const unsigned char* p = delta;
+	const unsigned char* end = delta + deltaLen;
+	auto varint = [&](size_t& value)->bool
+	{
+		value = 0;
+		int shift = 0;
+		unsigned char c;
+		do
+		{
+			if(p==end)
+				return false;
+			c = *p++;
+			value |= (size_t)(c & 0x7F) << shift;
+			shift += 7;
+		}
+		while(c & 0x80);
+		return true;
+	};
+
+	size_t srcSize, dstSize;
+	if(!varint(srcSize) || !varint(dstSize) || srcSize!=baseLen)
+		return false;
+	out.resize(dstSize);
+	size_t pos = 0;
+	while(p<end)
+	{
+		unsigned char cmd = *p++;
+		if(cmd & 0x80)
+		{
+			size_t offset = 0, size = 0;
+			for(int b=0; b<4; ++b)
+			{
+				if(cmd & (1 << b))
+				{
+					if(p==end)
+						return false;
+					offset |= (size_t)*p++ << (8*b);
+				}
+			}
+			for(int b=0; b<3; ++b)
+			{
+				if(cmd & (0x10 << b))
+				{
+					if(p==end)
+						return false;
+					size |= (size_t)*p++ << (8*b);
+				}
+			}
+			if(size==0)
+				size = 0x10000;
+			if(offset + size > baseLen || pos + size > dstSize)
+				return false;
+			std::memcpy(&out[pos], base + offset, size);
+			pos += size;
+		}
+		else if(cmd!=0)
+		{
+			if((size_t)(end - p) < cmd || pos + cmd > dstSize)
+				return false;
+			std::memcpy(&out[pos], p, cmd);
+			p += cmd;
+			pos += cmd;
+		}
+		else
+			return false;
+	}
+	return pos==dstSize;
+}
+
+
+//
+// PackWriter::State
+//
+
+/**
+ * Pack being written, owned by the writer and read by its database backend.
+ */
+class PackWriter::State
+{
+public:
+	static const size_t NoBase = (size_t)-1;
+
+	/**
+	 * Location of an object in the pack.
+	 */
+	struct Entry
+	{
+		git_oid oid;
+		uint64_t offset;
+		size_t length;
+		size_t headerLength;
+		size_t storedSize;
+		size_t size;
+		size_t base;
+		git_otype type;
+		unsigned int depth;
+		uint32_t crc;
+	};
+
+	/**
+	 * Previous object of a path, kept to compute deltas.
+	 */
+	struct Recent
+	{
+		size_t entry;
+		std::vector<unsigned char> content;
+	};
+
+	State(const std::string& objectsDir, bool deltas, size_t deltaCacheBytes);
+	~State();
+
+	OId add(const void* data, size_t len, git_otype type, const std::string& path);
+	bool read(const OId& oid, DatabaseBackendObject& object);
+	bool readHeader(const OId& oid, ObjectHeader& header);
+	bool exists(const OId& oid);
+	void list(std::vector<OId>& oids);
+	size_t count();
+	bool isOpen();
+	std::string close();
+	void abort();
+
+private:
+	void append(const void* data, size_t len);
+	void flush();
+	void readAt(uint64_t offset, void* buffer, size_t len);
+	void load(size_t entry, std::vector<unsigned char>& content);
+	void writeIndex(const std::string& path, const git_oid& packId);
+	void release();
+
+	std::mutex _mutex;
+	std::string _objectsDir;
+	std::string _packPath;
+	int _fd;
+	bool _deltas;
+	size_t _deltaCacheBytes;
+	size_t _recentBytes;
+	std::vector<unsigned char> _buffer;
+	uint64_t _flushed;
+	uint64_t _offset;
+	std::vector<Entry> _entries;
+	OIdMap<size_t> _index;
+	std::unordered_map<std::string, Recent> _recent;
+	z_stream _zs;
+	bool _compressing;
+};
+
+const size_t PackWriter::State::NoBase;
+
+PackWriter::State::State(const std::string& objectsDir, bool deltas, size_t deltaCacheBytes):
+_objectsDir(objectsDir),
+_fd(-1),
+_deltas(deltas),
+_deltaCacheBytes(deltaCacheBytes),
+_recentBytes(0),
+_flushed(0),
+_offset(0),
+_compressing(false)
+{
+	std::string packDir = _objectsDir + "/pack";
+	if(::mkdir(packDir.c_str(), 0777)!=0 && errno!=EEXIST)
+		throw_pack_error(GITERR_OS, "Failed to create pack directory '" + packDir + "'");
+	_packPath = packDir + "/tmp_pack_git2pp_XXXXXX";
+	_fd = ::mkstemp(&_packPath[0]);
+	if(_fd<0)
+		throw_pack_error(GITERR_OS, "Failed to create temporary pack file '" + _packPath + "'");
+
+	std::memset(&_zs, 0, sizeof(_zs));
+	if(deflateInit(&_zs, Z_DEFAULT_COMPRESSION)!=Z_OK)
+	{
+		::close(_fd);
+		::unlink(_packPath.c_str());
+		throw_pack_error(GITERR_ZLIB, "Failed to initialize pack compression");
+	}
+	_compressing = true;
+
+	// The object count is written on close.
+	static const unsigned char header[12] = {'P', 'A', 'C', 'K', 0, 0, 0, 2, 0, 0, 0, 0};
+	append(header, sizeof(header));
+}
+
+PackWriter::State::~State()
+{
+	abort();
+	release();
+}
+
+void PackWriter::State::append(const void* data, size_t len)
+{
+	_buffer.insert(_buffer.end(), (const unsigned char*)data, (const unsigned char*)data + len);
+	_offset += len;
+	if(_buffer.size() >= 1024*1024)
+		flush();
+}
+
+void PackWriter::State::flush()
+{
+	const unsigned char* data = _buffer.data();
+	size_t len = _buffer.size();
+	while(len>0)
+	{
+		ssize_t n = ::write(_fd, data, len);
+		if(n<0 && errno==EINTR)
+			continue;
+		if(n<=0)
+			throw_pack_error(GITERR_OS, "Failed to write pack file '" + _packPath + "'");
+		data += n;
+		len -= n;
+		_flushed += n;
+	}
+	_buffer.clear();
+}
+
+void PackWriter::State::readAt(uint64_t offset, void* buffer, size_t len)
+{
+	if(offset + len > _flushed)
+		flush();
+	unsigned char* bytes = (unsigned char*)buffer;
+	while(len>0)
+	{
+		ssize_t n = ::pread(_fd, bytes, len, (off_t)offset);
+		if(n<0 && errno==EINTR)
+			continue;
+		if(n<=0)
+			throw_pack_error(GITERR_OS, "Failed to read pack file '" + _packPath + "'");
+		bytes += n;
+		len -= n;
+		offset += n;
+	}
+}
+
+OId PackWriter::State::add(const void* data, size_t len, git_otype type, const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_fd<0)
+		throw_pack_error(GITERR_INVALID, "Pack writer is closed");
+
+	helper::Sha1 sha1;
+	sha1.updateObjectHeader(type, len);
+	sha1.update(data, len);
+	Entry entry;
+	sha1.final(entry.oid);
+	if(_index.contains(OId(&entry.oid)))
+		return OId(&entry.oid);
+
+	entry.offset = _offset;
+	entry.size = len;
+	entry.type = type;
+	entry.base = NoBase;
+	entry.depth = 0;
+
+	// Delta against the previous object of the path, when at most half the size.
+	const unsigned char* payload = (const unsigned char*)data;
+	size_t payloadLength = len;
+	std::vector<unsigned char> delta;
+	std::unordered_map<std::string, Recent>::iterator recent = _recent.end();
+	if(_deltas && !path.empty())
+	{
+		recent = _recent.find(path);
+		if(recent!=_recent.end())
+		{
+			const Entry& base = _entries[recent->second.entry];
+			if(base.type==type && base.depth<MaxDeltaDepth
+				&& make_delta(recent->second.content.data(), recent->second.content.size(), payload, len, len/2, delta))
+			{
+				entry.base = recent->second.entry;
+				entry.depth = base.depth + 1;
+				payload = delta.data();
+				payloadLength = delta.size();
+			}
+		}
+	}
+
+	// Type and size, 4 bits then 7 bits per byte, then the base distance for deltas.
+	std::vector<unsigned char> header;
+	int packType = entry.base!=NoBase ? GIT_OBJ_OFS_DELTA : type;
+	size_t size = payloadLength;
+	unsigned char c = (unsigned char)((packType << 4) | (size & 0x0F));
+	for(size >>= 4; size; size >>= 7)
+	{
+		header.push_back(c | 0x80);
+		c = size & 0x7F;
+	}
+	header.push_back(c);
+	if(entry.base!=NoBase)
+	{
+		uint64_t distance = entry.offset - _entries[entry.base].offset;
+		unsigned char ofs[16];
+		size_t pos = sizeof(ofs) - 1;
+		ofs[pos] = distance & 0x7F;
+		while(distance >>= 7)
+			ofs[--pos] = 0x80 | (--distance & 0x7F);
+		header.insert(header.end(), ofs + pos, ofs + sizeof(ofs));
+	}
+
+	std::vector<unsigned char> compressed(deflateBound(&_zs, payloadLength));
+	deflateReset(&_zs);
+	Bytef* out = compressed.data();
+	size_t outLeft = compressed.size();
+	if(!deflate_buffer(_zs, payload, payloadLength, out, outLeft))
+		throw_pack_error(GITERR_ZLIB, "Failed to compress pack object");
+	compressed.resize(compressed.size() - outLeft);
+
+	entry.crc = crc32(crc32(0, header.data(), header.size()), compressed.data(), compressed.size());
+	entry.headerLength = header.size();
+	entry.length = header.size() + compressed.size();
+	entry.storedSize = payloadLength;
+	append(header.data(), header.size());
+	append(compressed.data(), compressed.size());
+
+	_entries.push_back(entry);
+	_index.insert(OId(&entry.oid), _entries.size() - 1);
+
+	if(_deltas && !path.empty())
+	{
+		if(recent==_recent.end())
+			recent = _recent.insert(std::make_pair(path, Recent())).first;
+		_recentBytes -= recent->second.content.size();
+		recent->second.entry = _entries.size() - 1;
+		recent->second.content.assign((const unsigned char*)data, (const unsigned char*)data + len);
+		_recentBytes += len;
+		// Dropping all bases is cheaper to track than evicting the oldest ones.
+		if(_recentBytes > _deltaCacheBytes)
+		{
+			_recent.clear();
+			_recentBytes = 0;
+		}
+	}
+	return OId(&entry.oid);
+}
+
+void PackWriter::State::load(size_t pos, std::vector<unsigned char>& content)
+{
+	const Entry& entry = _entries[pos];
+	std::vector<unsigned char> raw(entry.length - entry.headerLength);
+	readAt(entry.offset + entry.headerLength, raw.data(), raw.size());
+
+	std::vector<unsigned char> stored(entry.storedSize);
+	z_stream zs;
+	std::memset(&zs, 0, sizeof(zs));
+	if(inflateInit(&zs)!=Z_OK)
+		throw_pack_error(GITERR_ZLIB, "Failed to initialize pack decompression");
+	bool inflated = inflate_buffer(zs, raw.data(), raw.size(), stored.data(), stored.size());
+	inflateEnd(&zs);
+	if(!inflated)
+		throw_pack_error(GITERR_ZLIB, "Corrupted object in pack being written");
+
+	if(entry.base==NoBase)
+	{
+		content.swap(stored);
+		return;
+	}
+	std::vector<unsigned char> base;
+	load(entry.base, base);
+	if(!apply_delta(base.data(), base.size(), stored.data(), stored.size(), content))
+		throw_pack_error(GITERR_ODB, "Corrupted delta in pack being written");
+}
+
+bool PackWriter::State::read(const OId& oid, DatabaseBackendObject& object)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const size_t* pos = _index.find(oid);
+	if(_fd<0 || pos==nullptr)
+		return false;
+	std::vector<unsigned char> content;
+	load(*pos, content);
+	object.assign(_entries[*pos].type, content.data(), content.size());
+	return true;
+}
+
+bool PackWriter::State::readHeader(const OId& oid, ObjectHeader& header)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const size_t* pos = _index.find(oid);
+	if(_fd<0 || pos==nullptr)
+		return false;
+	header = ObjectHeader(_entries[*pos].type, _entries[*pos].size);
+	return true;
+}
+
+bool PackWriter::State::exists(const OId& oid)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _fd>=0 && _index.contains(oid);
+}
+
+void PackWriter::State::list(std::vector<OId>& oids)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_fd<0)
+		return;
+	oids.reserve(_entries.size());
+	for(const Entry& entry : _entries)
+		oids.push_back(OId(&entry.oid));
+}
+
+size_t PackWriter::State::count()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries.size();
+}
+
+bool PackWriter::State::isOpen()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _fd>=0;
+}
+
+void PackWriter::State::writeIndex(const std::string& path, const git_oid& packId)
+{
+	std::vector<size_t> order(_entries.size());
+	for(size_t n=0; n<order.size(); ++n)
+		order[n] = n;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+		return std::memcmp(_entries[a].oid.id, _entries[b].oid.id, GIT_OID_RAWSZ) < 0;
+	});
+
+	// Version 2: fan-out, names, CRCs, 31-bit offsets, then 64-bit offsets.
+	std::vector<unsigned char> idx;
+	static const unsigned char magic[8] = {0xFF, 't', 'O', 'c', 0, 0, 0, 2};
+	idx.insert(idx.end(), magic, magic + sizeof(magic));
+	size_t count = 0;
+	for(int b=0; b<256; ++b)
+	{
+		while(count<order.size() && _entries[order[count]].oid.id[0]==b)
+			++count;
+		put_be32(idx, (uint32_t)count);
+	}
+	for(size_t n : order)
+		idx.insert(idx.end(), _entries[n].oid.id, _entries[n].oid.id + GIT_OID_RAWSZ);
+	for(size_t n : order)
+		put_be32(idx, _entries[n].crc);
+	std::vector<uint64_t> large;
+	for(size_t n : order)
+	{
+		if(_entries[n].offset < 0x80000000u)
+			put_be32(idx, (uint32_t)_entries[n].offset);
+		else
+		{
+			put_be32(idx, 0x80000000u | (uint32_t)large.size());
+			large.push_back(_entries[n].offset);
+		}
+	}
+	for(uint64_t offset : large)
+	{
+		put_be32(idx, (uint32_t)(offset >> 32));
+		put_be32(idx, (uint32_t)offset);
+	}
+	idx.insert(idx.end(), packId.id, packId.id + GIT_OID_RAWSZ);
+	helper::Sha1 sha1;
+	sha1.update(idx.data(), idx.size());
+	git_oid idxId;
+	sha1.final(idxId);
+	idx.insert(idx.end(), idxId.id, idxId.id + GIT_OID_RAWSZ);
+
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if(file==NULL)
+		throw_pack_error(GITERR_OS, "Failed to create pack index '" + path + "'");
+	bool written = std::fwrite(idx.data(), 1, idx.size(), file)==idx.size();
+	if(std::fclose(file)!=0 || !written)
+	{
+		::unlink(path.c_str());
+		throw_pack_error(GITERR_OS, "Failed to write pack index '" + path + "'");
+	}
+}
+
+std::string PackWriter::State::close()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_fd<0)
+		throw_pack_error(GITERR_INVALID, "Pack writer is closed");
+	if(_entries.empty())
+	{
+		::close(_fd);
+		::unlink(_packPath.c_str());
+		_fd = -1;
+		release();
+		return std::string();
+	}
+
+	// Patch the object count, then hash the whole pack for its trailer.
+	flush();
+	unsigned char count[4] = {
+		(unsigned char)(_entries.size() >> 24), (unsigned char)(_entries.size() >> 16),
+		(unsigned char)(_entries.size() >> 8), (unsigned char)_entries.size()};
+	if(::pwrite(_fd, count, sizeof(count), 8)!=(ssize_t)sizeof(count))
+		throw_pack_error(GITERR_OS, "Failed to write pack file '" + _packPath + "'");
+	helper::Sha1 sha1;
+	std::vector<unsigned char> chunk(1024*1024);
+	for(uint64_t offset=0; offset<_flushed; )
+	{
+		size_t n = (size_t)std::min((uint64_t)chunk.size(), _flushed - offset);
+		readAt(offset, chunk.data(), n);
+		sha1.update(chunk.data(), n);
+		offset += n;
+	}
+	git_oid packId;
+	sha1.final(packId);
+	append(packId.id, GIT_OID_RAWSZ);
+	flush();
+
+	char hex[GIT_OID_HEXSZ];
+	git_oid_fmt(hex, &packId);
+	std::string base = _objectsDir + "/pack/pack-" + std::string(hex, GIT_OID_HEXSZ);
+	std::string idxTemp = _packPath + ".idx";
+	writeIndex(idxTemp, packId);
+
+	// The index is installed last, packs are only looked up through it.
+	::close(_fd);
+	_fd = -1;
+	release();
+	::chmod(_packPath.c_str(), 0444);
+	::chmod(idxTemp.c_str(), 0444);
+	if(::rename(_packPath.c_str(), (base + ".pack").c_str())!=0 || ::rename(idxTemp.c_str(), (base + ".idx").c_str())!=0)
+	{
+		::unlink(_packPath.c_str());
+		::unlink(idxTemp.c_str());
+		throw_pack_error(GITERR_OS, "Failed to install pack '" + base + ".pack'");
+	}
+	return base + ".pack";
+}
+
+void PackWriter::State::abort()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(_fd<0)
+		return;
+	::close(_fd);
+	::unlink(_packPath.c_str());
+	_fd = -1;
+	release();
+}
+
+// Free the memory of a closed pack, the writer may be kept long after.
+void PackWriter::State::release()
+{
+	std::vector<unsigned char>().swap(_buffer);
+	std::vector<Entry>().swap(_entries);
+	_index = OIdMap<size_t>();
+	_recent.clear();
+	_recentBytes = 0;
+	if(_compressing)
+	{
+		deflateEnd(&_zs);
+		_compressing = false;
+	}
+}
+
+
+//
+// PackWriter::Backend
+//
+
+/**
+ * Read-only backend serving the objects of the packs being written.
+ *
+ * A database gets a single backend, added with its first writer and
+ * freed with it. Writers are only referenced weakly: a dropped writer
+ * costs nothing to the database and is forgotten on the next attach.
+ */
+class PackWriter::Backend : public CustomDatabaseBackend
+{
+public:
+	~Backend()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex());
+		std::map<git_odb*, Backend*>::iterator it = registry().find(_odb);
+		if(it!=registry().end() && it->second==this)
+			registry().erase(it);
+	}
+
+	/**
+	 * Serve the objects of a writer from its database.
+	 */
+	static void attach(Database& database, const std::shared_ptr<State>& state)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex());
+		std::map<git_odb*, Backend*>::iterator it = registry().find(database.data());
+		if(it!=registry().end())
+		{
+			it->second->add(state);
+			return;
+		}
+
+		// The database owns the backend, which lives as long as it does.
+		Backend* backend = new Backend(database.data());
+		backend->add(state);
+		try
+		{
+			database.addBackend(backend, 0);
+		}
+		catch(...)
+		{
+			delete backend;
+			throw;
+		}
+		registry()[database.data()] = backend;
+	}
+
+	bool read(const OId& oid, DatabaseBackendObject& object)
+	{
+		for(const std::shared_ptr<State>& state : states())
+		{
+			if(state->read(oid, object))
+				return true;
+		}
+		return false;
+	}
+
+	bool readHeader(const OId& oid, ObjectHeader& header)
+	{
+		for(const std::shared_ptr<State>& state : states())
+		{
+			if(state->readHeader(oid, header))
+				return true;
+		}
+		return false;
+	}
+
+	bool exists(const OId& oid)
+	{
+		for(const std::shared_ptr<State>& state : states())
+		{
+			if(state->exists(oid))
+				return true;
+		}
+		return false;
+	}
+
+	bool foreach(std::function<bool(const OId&)> callback)
+	{
+		std::vector<OId> oids;
+		for(const std::shared_ptr<State>& state : states())
+			state->list(oids);
+		for(const OId& oid : oids)
+		{
+			if(!callback(oid))
+				return true;
+		}
+		return false;
+	}
+
+private:
+	Backend(git_odb* odb):_odb(odb){}
+
+	void add(const std::shared_ptr<State>& state)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_states.erase(std::remove_if(_states.begin(), _states.end(),
+			[](const std::weak_ptr<State>& state){return state.expired();}), _states.end());
+		_states.push_back(state);
+	}
+
+	// Writers still alive, locked outside of the backend mutex.
+	std::vector<std::shared_ptr<State>> states()
+	{
+		std::vector<std::shared_ptr<State>> states;
+		std::lock_guard<std::mutex> lock(_mutex);
+		for(const std::weak_ptr<State>& weak : _states)
+		{
+			if(std::shared_ptr<State> state = weak.lock())
+				states.push_back(state);
+		}
+		return states;
+	}
+
+	// Backends by database, entries are removed when the database frees them.
+	static std::mutex& registryMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static std::map<git_odb*, Backend*>& registry()
+	{
+		static std::map<git_odb*, Backend*> backends;
+		return backends;
+	}
+
+	git_odb* _odb;
+	std::mutex _mutex;
+	std::vector<std::weak_ptr<State>> _states;
+};
+
+
+//
+// PackWriter
+//
+
+PackWriter::PackWriter(Database& database, bool deltas, size_t deltaCacheBytes):
+_database(database)
+{
+	std::string objectsDir = database.objectsDir();
+	if(objectsDir.empty())
+		throw_pack_error(GITERR_ODB, "Object database has no objects directory to write a pack to");
+	_state = std::make_shared<State>(objectsDir, deltas, deltaCacheBytes);
+	Backend::attach(_database, _state);
+}
+
+PackWriter::~PackWriter()
+{
+	_state->abort();
+}
+
+OId PackWriter::write(const void* data, size_t len, git_otype type, const std::string& path)
+{
+	return _state->add(data, len, type, path);
+}
+
+size_t PackWriter::count() const
+{
+	return _state->count();
+}
+
+bool PackWriter::isOpen() const
+{
+	return _state->isOpen();
+}
+
+std::string PackWriter::close()
+{
+	std::string path = _state->close();
+	if(!path.empty())
+		_database.refresh();
+	return path;
+}
+
+void PackWriter::abort()
+{
+	_state->abort();
+}
+
+} // namespace git2
@@ -0,0 +1,119 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_PACKWRITER_HPP_
+#define _GIT2PP_PACKWRITER_HPP_
+
+#include <git2.h>
+
+#include <memory>
+#include <string>
+
+#include "database.hpp"
+#include "oid.hpp"
+
+namespace git2
+{
+
+/**
+ * Writer of objects straight into a new pack file, for bulk imports.
+ *
+ * Objects are appended to a temporary pack of the database objects
+ * directory as they are written, optionally as deltas against the
+ * previous object written for the same path. close() writes the pack
+ * index and installs the pack, without any loose object nor repack.
+ *
+ * Written objects are readable through the database right away: a
+ * read-only backend, added to it with its first writer, serves them
+ * from the temporary pack until it is closed. Closing or aborting the
+ * pack frees its buffers, the backend keeps no reference to the writer.
+ *
+ * A writer is used from one thread, its backend can be read from any.
+ */
+class PackWriter
+{
+public:
+	/** Longest chain of deltas to reach an object. */
+	static const unsigned int MaxDeltaDepth = 50;
+
+	/**
+	 * Start a new pack.
+	 *
+	 * @param database database to write to, which must have an objects directory.
+	 * @param deltas compute deltas against the previous object of a same path.
+	 * @param deltaCacheBytes memory kept for the previous objects of paths.
+	 * @throws Exception
+	 */
+	PackWriter(Database& database, bool deltas = true, size_t deltaCacheBytes = 64*1024*1024);
+
+	/**
+	 * Abort the pack if it was not closed.
+	 */
+	~PackWriter();
+
+	/**
+	 * Append an object to the pack.
+	 * Objects already written to this pack are not written again.
+	 *
+	 * @param data content of the object.
+	 * @param len size of the content.
+	 * @param type type of the object.
+	 * @param path path of the object in the imported trees, empty if none,
+	 * used to find a delta base.
+	 * @return Id of the object.
+	 * @throws Exception
+	 */
+	OId write(const void* data, size_t len, git_otype type, const std::string& path = std::string());
+
+	/**
+	 * Number of objects in the pack.
+	 */
+	size_t count() const;
+
+	/**
+	 * Check if the pack is still being written.
+	 */
+	bool isOpen() const;
+
+	/**
+	 * Finish the pack, write its index and install both in the objects directory.
+	 *
+	 * @return Path of the pack file, empty if no object was written.
+	 * @throws Exception
+	 */
+	std::string close();
+
+	/**
+	 * Drop the pack and its objects.
+	 */
+	void abort();
+
+private:
+	PackWriter(const PackWriter&) = delete;
+	PackWriter& operator=(const PackWriter&) = delete;
+
+	class State;
+	class Backend;
+
+	Database _database;
+	std::shared_ptr<State> _state;
+};
+
+} // namespace git2
+#endif // _GIT2PP_PACKWRITER_HPP_
@@ -0,0 +1,93 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace git2
+{
+namespace helper
+{
+
+unsigned int parallel_threads(size_t count, unsigned int threadCount)
+{
+	if(threadCount==0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	return (unsigned int)std::min((size_t)threadCount, std::max(count, (size_t)1));
+}
+
+void parallel_for(size_t count, unsigned int threadCount, const std::function<void(size_t, unsigned int)>& task, size_t chunkSize)
+{
+	if(count==0)
+		return;
+	chunkSize = std::max(chunkSize, (size_t)1);
+	threadCount = parallel_threads((count + chunkSize - 1) / chunkSize, threadCount);
+
+	std::atomic<size_t> next(0);
+	std::mutex errorMutex;
+	std::exception_ptr error;
+	auto work = [&](unsigned int worker)
+	{
+		try
+		{
+			for(size_t begin; (begin = next.fetch_add(chunkSize)) < count; )
+			{
+				size_t end = std::min(begin + chunkSize, count);
+				for(size_t n=begin; n<end; ++n)
+					task(n, worker);
+			}
+		}
+		catch(...)
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if(!error)
+				error = std::current_exception();
+			next = count;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	try
+	{
+		for(unsigned int n=1; n<threadCount; ++n)
+			threads.push_back(std::thread(work, n));
+	}
+	catch(...)
+	{
+		next = count;
+		for(std::thread& thread : threads)
+			thread.join();
+		throw;
+	}
+	work(0);
+	for(std::thread& thread : threads)
+		thread.join();
+
+	if(error)
+		std::rethrow_exception(error);
+}
+
+} // namespace helper
+} // namespace git2
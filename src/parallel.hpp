@@ -0,0 +1,55 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_PARALLEL_HPP_
+#define _GIT2PP_PARALLEL_HPP_
+
+#include <cstddef>
+#include <functional>
+
+namespace git2
+{
+namespace helper
+{
+
+/**
+ * Number of threads to run count tasks on.
+ *
+ * @param threadCount Maximum number of threads, 0 for one per processor.
+ * @return At least 1, at most count otherwise.
+ */
+unsigned int parallel_threads(size_t count, unsigned int threadCount);
+
+/**
+ * Run task(n, worker) for each n from 0 to count-1 on several threads.
+ *
+ * Threads take chunks of chunkSize consecutive tasks in turn. The
+ * calling thread is worker 0, others are numbered from 1, so that
+ * callers can give each one its own resources.
+ * The first exception thrown by a task stops all the threads once their
+ * current task is over, and is rethrown.
+ *
+ * @param threadCount Maximum number of threads, see parallel_threads().
+ * @throws Exception
+ */
+void parallel_for(size_t count, unsigned int threadCount, const std::function<void(size_t, unsigned int)>& task, size_t chunkSize = 1);
+
+} // namespace helper
+} // namespace git2
+#endif // _GIT2PP_PARALLEL_HPP_
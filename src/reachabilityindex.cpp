@@ -0,0 +1,738 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "reachabilityindex.hpp"
+
+#include "commit.hpp"
+#include "commitgraph.hpp"
+#include "exception.hpp"
+#include "repository.hpp"
+#include "tree.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace git2
+{
+
+//
+// Index file format, all integers are big-endian:
+//   header    "G2RB", version, object count, bitmap count (4 x 4 bytes)
+//   oids      object count x 20 bytes, in position order
+//   commits   EWAH bitmap of the positions of commits
+//   bitmaps   bitmap count x (commit position (4 bytes), EWAH bitmap)
+//
+// An EWAH bitmap is a word count (4 bytes) followed by that many 64-bit
+// words. Each marker word holds a run bit (bit 0), a number of words all
+// set to the run bit (bits 1 to 32) and a number of literal words which
+// follow the marker (bits 33 to 63).
+//
+
+static const char IndexMagic[4] = {'G', '2', 'R', 'B'};
+static const uint32_t IndexVersion = 1;
+static const size_t HeaderSize = 16;
+
+static const char IndexFile[] = "/pack/git2pp-reachability.bitmap";
+
+static uint32_t read_be32(const unsigned char* buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+static uint64_t read_be64(const unsigned char* buffer)
+{
+	return ((uint64_t)read_be32(buffer) << 32) | read_be32(buffer + 4);
+}
+
+static void write_be32(std::vector<unsigned char>& buffer, uint32_t value)
+{
+	buffer.push_back((unsigned char)(value >> 24));
+	buffer.push_back((unsigned char)(value >> 16));
+	buffer.push_back((unsigned char)(value >> 8));
+	buffer.push_back((unsigned char)value);
+}
+
+static void write_be64(std::vector<unsigned char>& buffer, uint64_t value)
+{
+	write_be32(buffer, (uint32_t)(value >> 32));
+	write_be32(buffer, (uint32_t)value);
+}
+
+static bool ends_with(const std::string& str, const std::string& suffix)
+{
+	return str.size()>=suffix.size() && str.compare(str.size()-suffix.size(), suffix.size(), suffix)==0;
+}
+
+//
+// Bitmaps
+//
+
+static void bit_set(std::vector<uint64_t>& bits, uint32_t pos)
+{
+	if(bits.size() <= pos/64)
+		bits.resize(pos/64 + 1, 0);
+	bits[pos/64] |= (uint64_t)1 << (pos%64);
+}
+
+static bool bit_test(const std::vector<uint64_t>& bits, uint32_t pos)
+{
+	return pos/64 < bits.size() && (bits[pos/64] & ((uint64_t)1 << (pos%64)))!=0;
+}
+
+static void bits_or(std::vector<uint64_t>& bits, const std::vector<uint64_t>& other)
+{
+	if(bits.size() < other.size())
+		bits.resize(other.size(), 0);
+	for(size_t n=0; n<other.size(); ++n)
+		bits[n] |= other[n];
+}
+
+static std::vector<uint64_t> ewah_encode(const std::vector<uint64_t>& bits)
+{
+	std::vector<uint64_t> words;
+	size_t size = bits.size();
+	while(size>0 && bits[size-1]==0)
+		--size;
+	for(size_t n=0; n<size; )
+	{
+		uint64_t runBit = 0, run = 0;
+		if(bits[n]==0 || bits[n]==~(uint64_t)0)
+		{
+			uint64_t pattern = bits[n];
+			runBit = pattern!=0 ? 1 : 0;
+			for(; n<size && bits[n]==pattern && run<0xFFFFFFFF; ++n)
+				++run;
+		}
+		size_t literals = n;
+		while(literals<size && bits[literals]!=0 && bits[literals]!=~(uint64_t)0 && literals-n<0x7FFFFFFF)
+			++literals;
+		words.push_back(runBit | (run << 1) | ((uint64_t)(literals - n) << 33));
+		words.insert(words.end(), bits.begin()+n, bits.begin()+literals);
+		n = literals;
+	}
+	return words;
+}
+
+// Decode an EWAH bitmap into bits, or-ing it with their content.
+template<typename Words>
+static void ewah_or(Words word, size_t count, std::vector<uint64_t>& bits)
+{
+	size_t pos = 0;
+	for(size_t n=0; n<count; )
+	{
+		uint64_t marker = word(n++);
+		size_t run = (size_t)((marker >> 1) & 0xFFFFFFFF), literals = (size_t)(marker >> 33);
+		if(bits.size() < pos + run + literals)
+			bits.resize(pos + run + literals, 0);
+		if(marker & 1)
+			std::fill(bits.begin()+pos, bits.begin()+pos+run, ~(uint64_t)0);
+		pos += run;
+		for(size_t l=0; l<literals && n<count; ++l)
+			bits[pos++] |= word(n++);
+	}
+}
+
+// Or-ing of a mapped EWAH bitmap, starting at its word count.
+static void ewah_or_mapped(const unsigned char* data, std::vector<uint64_t>& bits)
+{
+	ewah_or([data](size_t n){return read_be64(data + 4 + n*8);}, read_be32(data), bits);
+}
+
+// Size of a mapped EWAH bitmap, 0 if it does not fit in the remaining bytes.
+static size_t ewah_mapped_size(const unsigned char* data, size_t available)
+{
+	if(available<4)
+		return 0;
+	size_t size = 4 + (size_t)read_be32(data) * 8;
+	return size<=available ? size : 0;
+}
+
+//
+// Pack indexes
+//
+
+// Read the ids of a pack index file (version 1 or 2) in pack order.
+static bool read_pack_objects(const std::string& path, std::vector<git_oid>& ids)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	std::vector<unsigned char> idx((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if(idx.size() < 8 + 256*4)
+		return false;
+
+	bool v2 = idx[0]==0xFF && idx[1]=='t' && idx[2]=='O' && idx[3]=='c';
+	if(v2 && read_be32(&idx[4])!=2)
+		return false;
+	const unsigned char* fanout = &idx[v2 ? 8 : 0];
+	size_t count = read_be32(fanout + 255*4);
+
+	std::vector<std::pair<uint64_t, const unsigned char*>> entries;
+	entries.reserve(count);
+	if(v2)
+	{
+		const unsigned char* names = fanout + 256*4;
+		const unsigned char* offsets = names + count*(GIT_OID_RAWSZ + 4);
+		const unsigned char* largeOffsets = offsets + count*4;
+		if(idx.size() < (size_t)(largeOffsets - &idx[0]))
+			return false;
+		for(size_t n=0; n<count; ++n)
+		{
+			uint64_t offset = read_be32(offsets + n*4);
+			if(offset & 0x80000000)
+			{
+				const unsigned char* large = largeOffsets + (offset & 0x7FFFFFFF)*8;
+				if(large + 8 > &idx[0] + idx.size())
+					return false;
+				offset = read_be64(large);
+			}
+			entries.push_back(std::make_pair(offset, names + n*GIT_OID_RAWSZ));
+		}
+	}
+	else
+	{
+		const unsigned char* table = fanout + 256*4;
+		if(idx.size() < 256*4 + count*(4 + GIT_OID_RAWSZ))
+			return false;
+		for(size_t n=0; n<count; ++n)
+			entries.push_back(std::make_pair((uint64_t)read_be32(table + n*24), table + n*24 + 4));
+	}
+
+	std::sort(entries.begin(), entries.end());
+	for(const std::pair<uint64_t, const unsigned char*>& entry : entries)
+	{
+		git_oid oid;
+		std::memcpy(oid.id, entry.second, GIT_OID_RAWSZ);
+		ids.push_back(oid);
+	}
+	return true;
+}
+
+
+//
+// ReachabilityIndex::Walker
+//
+
+/**
+ * Walk marking the objects reachable from commits.
+ *
+ * Objects with a position are marked in bits, others in extra. When a
+ * commit with a bitmap is reached, its bitmap is or-ed instead of walking
+ * its ancestors. When writing the index, the walker gives positions to the
+ * objects which have none yet.
+ *
+ * The positions of the commits walked, rather than or-ed from a bitmap,
+ * are also kept apart: packed commits out of the index commit mask get
+ * their position from their pack.
+ */
+class ReachabilityIndex::Walker
+{
+public:
+	typedef std::function<bool(const OId& oid, std::vector<uint64_t>& bits)> BitmapFunction;
+
+	Walker(const Repository& repository, const OIdMap<uint32_t>& positions, BitmapFunction bitmap):
+	_repository(repository),
+	_graph(repository.commitGraph()),
+	_positions(positions),
+	_bitmap(bitmap),
+	_newPositions(NULL),
+	_ids(NULL),
+	_stop(NULL),
+	_trees(true),
+	_targetPos(CommitGraph::NoPosition),
+	_hasTarget(false)
+	{
+	}
+
+	/**
+	 * Give positions to unknown objects, adding them to positions, which
+	 * must be the map of the walker, and appending them to ids.
+	 */
+	void grow(OIdMap<uint32_t>* positions, std::vector<git_oid>* ids)
+	{
+		_newPositions = positions;
+		_ids = ids;
+	}
+
+	/**
+	 * Only walk commits, for queries which need no tree nor blob.
+	 */
+	void commitsOnly()
+	{
+		_trees = false;
+	}
+
+	/**
+	 * Do not walk objects marked by another walk.
+	 */
+	void stopAt(const Walker* stop)
+	{
+		_stop = stop;
+	}
+
+	/**
+	 * Stop the walk as soon as an object is marked.
+	 */
+	void target(const OId& oid)
+	{
+		_hasTarget = true;
+		_target = oid;
+		const uint32_t* pos = _positions.find(oid);
+		_targetPos = pos!=nullptr ? *pos : CommitGraph::NoPosition;
+	}
+
+	bool found() const
+	{
+		return _hasTarget && marked(_target);
+	}
+
+	bool marked(const OId& oid) const
+	{
+		const uint32_t* pos = _positions.find(oid);
+		if(pos!=nullptr)
+			return bit_test(_bits, *pos);
+		return _extra.contains(oid);
+	}
+
+	const std::vector<uint64_t>& bits() const {return _bits;}
+	const std::vector<uint64_t>& commits() const {return _commits;}
+	const OIdMap<git_otype>& extra() const {return _extra;}
+
+	void walk(const std::vector<OId>& tips)
+	{
+		std::vector<OId> stack(tips.rbegin(), tips.rend());
+		std::vector<uint32_t> parents;
+		if(found())
+			return;
+		while(!stack.empty())
+		{
+			OId oid = stack.back();
+			stack.pop_back();
+			if(marked(oid) || (_stop!=NULL && _stop->marked(oid)))
+				continue;
+			if(_bitmap(oid, _bits))
+			{
+				if(found())
+					return;
+				continue;
+			}
+
+			mark(oid, GIT_OBJ_COMMIT);
+			OId tree;
+			uint32_t pos = _graph ? _graph->position(oid) : CommitGraph::NoPosition;
+			if(pos!=CommitGraph::NoPosition)
+			{
+				if(_trees)
+					tree = _graph->treeId(pos);
+				_graph->parents(pos, parents);
+				for(std::vector<uint32_t>::reverse_iterator it=parents.rbegin(); it!=parents.rend(); ++it)
+					stack.push_back(_graph->oid(*it));
+			}
+			else
+			{
+				Commit commit = _repository.lookupCommit(oid);
+				if(_trees)
+					tree = OId(git_commit_tree_id(commit.data()));
+				for(unsigned int n=git_commit_parentcount(commit.data()); n>0; --n)
+					stack.push_back(OId(git_commit_parent_id(commit.data(), n-1)));
+			}
+			if(_trees)
+				walkTree(tree);
+			if(found())
+				return;
+		}
+	}
+
+private:
+	bool mark(const OId& oid, git_otype type)
+	{
+		const uint32_t* found = _positions.find(oid);
+		uint32_t pos;
+		if(found!=nullptr)
+			pos = *found;
+		else if(_ids!=NULL)
+		{
+			pos = (uint32_t)_ids->size();
+			_ids->push_back(*oid.constData());
+			_newPositions->insert(oid, pos);
+		}
+		else
+			return _extra.insert(oid, type);
+
+		if(bit_test(_bits, pos))
+			return false;
+		bit_set(_bits, pos);
+		if(type==GIT_OBJ_COMMIT)
+			bit_set(_commits, pos);
+		return true;
+	}
+
+	void walkTree(const OId& root)
+	{
+		std::vector<OId> stack(1, root);
+		while(!stack.empty())
+		{
+			OId oid = stack.back();
+			stack.pop_back();
+			if((_stop!=NULL && _stop->marked(oid)) || !mark(oid, GIT_OBJ_TREE))
+				continue;
+			Tree tree = _repository.lookupTree(oid);
+			size_t count = git_tree_entrycount(tree.data());
+			for(size_t n=0; n<count; ++n)
+			{
+				const git_tree_entry* entry = git_tree_entry_byindex(tree.data(), n);
+				git_otype type = git_tree_entry_type(entry);
+				// Submodule commits are not part of the repository.
+				if(type==GIT_OBJ_TREE)
+					stack.push_back(OId(git_tree_entry_id(entry)));
+				else if(type==GIT_OBJ_BLOB && (_stop==NULL || !_stop->marked(OId(git_tree_entry_id(entry)))))
+					mark(OId(git_tree_entry_id(entry)), GIT_OBJ_BLOB);
+			}
+		}
+	}
+
+	const Repository& _repository;
+	std::shared_ptr<const CommitGraph> _graph;
+	const OIdMap<uint32_t>& _positions;
+	BitmapFunction _bitmap;
+	OIdMap<uint32_t>* _newPositions;
+	std::vector<git_oid>* _ids;
+	const Walker* _stop;
+	bool _trees;
+	OId _target;
+	uint32_t _targetPos;
+	bool _hasTarget;
+	std::vector<uint64_t> _bits;
+	std::vector<uint64_t> _commits;
+	OIdMap<git_otype> _extra;
+};
+
+
+//
+// ReachabilityIndex
+//
+
+ReachabilityIndex::ReachabilityIndex(const std::string& objectsDir):
+_objectsDir(objectsDir),
+_map(NULL),
+_mapSize(0),
+_count(0),
+_oids(NULL),
+_commits(NULL)
+{
+	while(_objectsDir.size()>1 && _objectsDir[_objectsDir.size()-1]=='/')
+		_objectsDir.erase(_objectsDir.size()-1);
+	load();
+}
+
+ReachabilityIndex::~ReachabilityIndex()
+{
+	if(_map!=NULL)
+		munmap(_map, _mapSize);
+}
+
+void ReachabilityIndex::load()
+{
+	int fd = open((_objectsDir + IndexFile).c_str(), O_RDONLY);
+	if(fd<0)
+		return;
+	struct stat st;
+	if(fstat(fd, &st)!=0 || (size_t)st.st_size<HeaderSize)
+	{
+		close(fd);
+		return;
+	}
+	_mapSize = (size_t)st.st_size;
+	_map = mmap(NULL, _mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(_map==MAP_FAILED)
+	{
+		_map = NULL;
+		return;
+	}
+
+	// Validate the whole layout before using any of it.
+	const unsigned char* data = (const unsigned char*)_map;
+	const unsigned char* end = data + _mapSize;
+	uint32_t count = read_be32(data + 8), bitmaps = read_be32(data + 12);
+	bool ok = std::memcmp(data, IndexMagic, 4)==0 && read_be32(data + 4)==IndexVersion
+		&& _mapSize - HeaderSize >= (size_t)count*GIT_OID_RAWSZ;
+	const unsigned char* cursor = data + HeaderSize + (size_t)count*GIT_OID_RAWSZ;
+	const unsigned char* commits = cursor;
+	size_t size = ok ? ewah_mapped_size(cursor, end - cursor) : 0;
+	ok = ok && size>0;
+	cursor += size;
+	std::vector<std::pair<uint32_t, const unsigned char*>> entries;
+	for(uint32_t n=0; ok && n<bitmaps; ++n)
+	{
+		size = end - cursor >= 4 ? ewah_mapped_size(cursor + 4, end - cursor - 4) : 0;
+		ok = size>0 && read_be32(cursor) < count;
+		if(ok)
+		{
+			entries.push_back(std::make_pair(read_be32(cursor), cursor + 4));
+			cursor += 4 + size;
+		}
+	}
+	if(!ok || cursor!=end)
+	{
+		munmap(_map, _mapSize);
+		_map = NULL;
+		return;
+	}
+
+	_count = count;
+	_oids = data + HeaderSize;
+	_commits = commits;
+	_positions.reserve(count);
+	for(uint32_t pos=0; pos<count; ++pos)
+		_positions.insert(oid(pos), pos);
+	_bitmaps.reserve(entries.size());
+	for(const std::pair<uint32_t, const unsigned char*>& entry : entries)
+		_bitmaps.insert(oid(entry.first), entry.second);
+}
+
+bool ReachabilityIndex::orBitmap(const OId& oid, std::vector<uint64_t>& bits) const
+{
+	const unsigned char* const* data = _bitmaps.find(oid);
+	if(data==nullptr)
+		return false;
+	ewah_or_mapped(*data, bits);
+	return true;
+}
+
+OId ReachabilityIndex::oid(uint32_t pos) const
+{
+	return OId(reinterpret_cast<const git_oid*>(_oids + (size_t)pos * GIT_OID_RAWSZ));
+}
+
+const std::string& ReachabilityIndex::objectsDir() const
+{
+	return _objectsDir;
+}
+
+bool ReachabilityIndex::empty() const
+{
+	return _bitmaps.size()==0;
+}
+
+size_t ReachabilityIndex::objectCount() const
+{
+	return _count;
+}
+
+size_t ReachabilityIndex::bitmapCount() const
+{
+	return _bitmaps.size();
+}
+
+size_t ReachabilityIndex::write(Repository& repository, const std::vector<OId>& tips, unsigned int interval)
+{
+	repository.writeCommitGraph(tips);
+	std::shared_ptr<const CommitGraph> graph = repository.commitGraph();
+	std::string objectsDir = graph->objectsDir();
+	interval = std::max(interval, 1u);
+
+	std::vector<uint32_t> pushed;
+	OIdSet tipSet;
+	for(const OId& tip : tips)
+	{
+		uint32_t pos = graph->position(tip);
+		if(pos==CommitGraph::NoPosition)
+		{
+			giterr_set_str(GITERR_INVALID, ("Commit " + tip.format() + " is not in the commit graph").c_str());
+			throw Exception(GIT_ENOTFOUND);
+		}
+		pushed.push_back(pos);
+		tipSet.insert(tip);
+	}
+
+	// Packed objects come first, in pack order.
+	std::vector<git_oid> ids;
+	OIdMap<uint32_t> positions;
+	std::vector<std::string> packs;
+	if(DIR* dir = opendir((objectsDir + "/pack").c_str()))
+	{
+		while(struct dirent* entry = readdir(dir))
+		{
+			if(ends_with(entry->d_name, ".idx"))
+				packs.push_back(objectsDir + "/pack/" + entry->d_name);
+		}
+		closedir(dir);
+	}
+	std::sort(packs.begin(), packs.end());
+	for(const std::string& pack : packs)
+	{
+		std::vector<git_oid> packed;
+		read_pack_objects(pack, packed);
+		for(const git_oid& oid : packed)
+		{
+			if(positions.insert(OId(&oid), (uint32_t)ids.size()))
+				ids.push_back(oid);
+		}
+	}
+
+	// Bitmaps are computed parents first, each walk stopping at the
+	// bitmaps of the ancestors computed before.
+	std::vector<std::vector<uint64_t>> bitmaps;
+	std::vector<OId> selected;
+	OIdMap<size_t> bitmapIndex;
+	std::vector<uint64_t> commits;
+	Walker::BitmapFunction bitmap = [&bitmaps, &bitmapIndex](const OId& oid, std::vector<uint64_t>& bits)->bool
+	{
+		const size_t* index = bitmapIndex.find(oid);
+		if(index==nullptr)
+			return false;
+		const std::vector<uint64_t>& words = bitmaps[*index];
+		ewah_or([&words](size_t n){return words[n];}, words.size(), bits);
+		return true;
+	};
+
+	std::vector<uint32_t> order = graph->walk(pushed, std::vector<uint32_t>(), GIT_SORT_TOPOLOGICAL);
+	size_t distance = 0;
+	for(std::vector<uint32_t>::reverse_iterator it=order.rbegin(); it!=order.rend(); ++it)
+	{
+		OId commit = graph->oid(*it);
+		if(++distance < interval && !tipSet.contains(commit))
+			continue;
+		distance = 0;
+		Walker walker(repository, positions, bitmap);
+		walker.grow(&positions, &ids);
+		walker.walk(std::vector<OId>(1, commit));
+		bits_or(commits, walker.commits());
+		bitmapIndex.insert(commit, bitmaps.size());
+		bitmaps.push_back(ewah_encode(walker.bits()));
+		selected.push_back(commit);
+	}
+
+	std::vector<unsigned char> buffer(IndexMagic, IndexMagic + 4);
+	write_be32(buffer, IndexVersion);
+	write_be32(buffer, (uint32_t)ids.size());
+	write_be32(buffer, (uint32_t)bitmaps.size());
+	for(const git_oid& oid : ids)
+		buffer.insert(buffer.end(), oid.id, oid.id + GIT_OID_RAWSZ);
+	std::vector<uint64_t> words = ewah_encode(commits);
+	write_be32(buffer, (uint32_t)words.size());
+	for(uint64_t word : words)
+		write_be64(buffer, word);
+	for(size_t n=0; n<bitmaps.size(); ++n)
+	{
+		write_be32(buffer, *positions.find(selected[n]));
+		write_be32(buffer, (uint32_t)bitmaps[n].size());
+		for(uint64_t word : bitmaps[n])
+			write_be64(buffer, word);
+	}
+
+	// Write under a temporary name then move it in place.
+	std::string path = objectsDir + IndexFile, tmp = path + ".lock";
+	std::FILE* file = std::fopen(tmp.c_str(), "wb");
+	bool ok = file!=NULL && std::fwrite(buffer.data(), 1, buffer.size(), file)==buffer.size();
+	if(file!=NULL)
+		ok = (std::fclose(file)==0) && ok;
+	if(!ok || std::rename(tmp.c_str(), path.c_str())!=0)
+	{
+		std::remove(tmp.c_str());
+		giterr_set_str(GITERR_OS, ("Unable to write reachability index file " + path).c_str());
+		throw Exception(GIT_ERROR);
+	}
+	return bitmaps.size();
+}
+
+size_t ReachabilityIndex::countCommits(const Repository& repository, const std::vector<OId>& include, const std::vector<OId>& exclude) const
+{
+	Walker::BitmapFunction bitmap = [this](const OId& oid, std::vector<uint64_t>& bits){return orBitmap(oid, bits);};
+	Walker hidden(repository, _positions, bitmap);
+	hidden.commitsOnly();
+	hidden.walk(exclude);
+	Walker walker(repository, _positions, bitmap);
+	walker.commitsOnly();
+	walker.stopAt(&hidden);
+	walker.walk(include);
+
+	// Commits or-ed from bitmaps were all walked by write(), the others
+	// may have been packed out of the mask.
+	std::vector<uint64_t> mask = walker.commits();
+	if(_commits!=NULL)
+		ewah_or_mapped(_commits, mask);
+	const std::vector<uint64_t>& bits = walker.bits();
+	const std::vector<uint64_t>& hiddenBits = hidden.bits();
+	size_t count = 0;
+	for(size_t n=0; n<bits.size() && n<mask.size(); ++n)
+	{
+		uint64_t word = bits[n] & mask[n];
+		if(n<hiddenBits.size())
+			word &= ~hiddenBits[n];
+		count += std::bitset<64>(word).count();
+	}
+	for(const OIdMap<git_otype>::Entry& entry : walker.extra())
+	{
+		if(entry.value==GIT_OBJ_COMMIT && !hidden.extra().contains(entry.oid()))
+			++count;
+	}
+	return count;
+}
+
+bool ReachabilityIndex::isReachable(const Repository& repository, const OId& commit, const std::vector<OId>& from) const
+{
+	Walker walker(repository, _positions, [this](const OId& oid, std::vector<uint64_t>& bits){return orBitmap(oid, bits);});
+	walker.commitsOnly();
+	walker.target(commit);
+	walker.walk(from);
+	return walker.found();
+}
+
+std::vector<OId> ReachabilityIndex::reachableObjects(const Repository& repository, const std::vector<OId>& include, const std::vector<OId>& exclude) const
+{
+	Walker::BitmapFunction bitmap = [this](const OId& oid, std::vector<uint64_t>& bits){return orBitmap(oid, bits);};
+	Walker hidden(repository, _positions, bitmap);
+	hidden.walk(exclude);
+	Walker walker(repository, _positions, bitmap);
+	walker.stopAt(&hidden);
+	walker.walk(include);
+
+	std::vector<OId> oids;
+	const std::vector<uint64_t>& bits = walker.bits();
+	const std::vector<uint64_t>& hiddenBits = hidden.bits();
+	for(size_t n=0; n<bits.size(); ++n)
+	{
+		uint64_t word = n<hiddenBits.size() ? bits[n] & ~hiddenBits[n] : bits[n];
+		for(unsigned int b=0; word!=0; ++b, word >>= 1)
+		{
+			if((word & 1) && n*64 + b < _count)
+				oids.push_back(oid((uint32_t)(n*64 + b)));
+		}
+	}
+	for(const OIdMap<git_otype>::Entry& entry : walker.extra())
+	{
+		if(!hidden.extra().contains(entry.oid()))
+			oids.push_back(entry.oid());
+	}
+	return oids;
+}
+
+} // namespace git2
@@ -0,0 +1,161 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_REACHABILITYINDEX_HPP_
+#define _GIT2PP_REACHABILITYINDEX_HPP_
+
+#include <git2.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "oid.hpp"
+#include "oidmap.hpp"
+
+namespace git2
+{
+
+class Repository;
+
+/**
+ * Memory-mapped reachability bitmaps of a repository.
+ *
+ * The index gives each object a position, packed objects first in the
+ * order of their packs, and stores for selected commits the EWAH
+ * compressed bitmap of the positions of all the objects (commits, trees
+ * and blobs) they reach. Queries walk from their tips down to the
+ * nearest selected commits and combine their bitmaps, so only the few
+ * commits above them are read.
+ *
+ * The index is written as the "pack/git2pp-reachability.bitmap" file of
+ * the objects directory, next to the packs. It stays correct when new
+ * objects are added: commits and objects which are not in it are read
+ * from the repository, using the commit graph when it knows them.
+ *
+ * An instance is a read-only snapshot and is safe to share between threads.
+ */
+class ReachabilityIndex
+{
+public:
+	/**
+	 * Open the index of an objects directory.
+	 * The index is empty if none was written yet.
+	 *
+	 * @param objectsDir path to the "objects" directory.
+	 */
+	ReachabilityIndex(const std::string& objectsDir);
+
+	~ReachabilityIndex();
+
+	/**
+	 * Objects directory of this index.
+	 */
+	const std::string& objectsDir() const;
+
+	/**
+	 * Check if the index has no bitmap.
+	 */
+	bool empty() const;
+
+	/**
+	 * Number of objects with a position.
+	 */
+	size_t objectCount() const;
+
+	/**
+	 * Number of commits with a bitmap.
+	 */
+	size_t bitmapCount() const;
+
+	/**
+	 * Write the index of the commits reachable from some tips, replacing
+	 * the existing one.
+	 *
+	 * The tips are first appended to the commit graph of the repository.
+	 * Each tip gets a bitmap, and so does one commit every interval
+	 * commits in ancestry order.
+	 *
+	 * @param repository repository to index.
+	 * @param tips full-length ids of the commits to start from.
+	 * @param interval distance between commits with a bitmap.
+	 * @return Number of written bitmaps.
+	 * @throws Exception
+	 */
+	static size_t write(Repository& repository, const std::vector<OId>& tips, unsigned int interval = 100);
+
+	/**
+	 * Count the commits reachable from some commits but not from others,
+	 * like `git rev-list --count include ^exclude`.
+	 * Only commits are walked, trees are not read.
+	 *
+	 * @param repository repository of the index, to read unindexed commits.
+	 * @param include full-length ids of the commits to count from.
+	 * @param exclude full-length ids of the commits to hide with their ancestors.
+	 * @return Number of commits.
+	 * @throws Exception
+	 */
+	size_t countCommits(const Repository& repository, const std::vector<OId>& include, const std::vector<OId>& exclude = std::vector<OId>()) const;
+
+	/**
+	 * Check if a commit is reachable from other ones (or is one of them).
+	 * The walk stops as soon as the commit is found, and only walks commits.
+	 *
+	 * @param repository repository of the index, to read unindexed commits.
+	 * @param commit full-length id of the commit to look for.
+	 * @param from full-length ids of the commits to start from.
+	 * @throws Exception
+	 */
+	bool isReachable(const Repository& repository, const OId& commit, const std::vector<OId>& from) const;
+
+	/**
+	 * List the objects reachable from some commits but not from others,
+	 * like `git rev-list --objects include ^exclude`.
+	 *
+	 * @param repository repository of the index, to read unindexed commits.
+	 * @param include full-length ids of the commits to start from.
+	 * @param exclude full-length ids of the commits to hide with their objects.
+	 * @return Ids of commits, trees and blobs, indexed objects in position order first.
+	 * @throws Exception
+	 */
+	std::vector<OId> reachableObjects(const Repository& repository, const std::vector<OId>& include, const std::vector<OId>& exclude = std::vector<OId>()) const;
+
+private:
+	ReachabilityIndex(const ReachabilityIndex&) = delete;
+	ReachabilityIndex& operator=(const ReachabilityIndex&) = delete;
+
+	class Walker;
+	friend class Walker;
+
+	void load();
+	bool orBitmap(const OId& oid, std::vector<uint64_t>& bits) const;
+	OId oid(uint32_t pos) const;
+
+	std::string _objectsDir;
+	void* _map;
+	size_t _mapSize;
+	uint32_t _count;
+	const unsigned char* _oids;
+	const unsigned char* _commits;
+	OIdMap<uint32_t> _positions;
+	OIdMap<const unsigned char*> _bitmaps;
+};
+
+} // namespace git2
+#endif // _GIT2PP_REACHABILITYINDEX_HPP_
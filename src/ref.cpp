@@ -86,6 +86,16 @@ std::string Reference::symbolicTarget()const
 	return std::string(git_reference_symbolic_target(data()));
 }
 
+StringView Reference::nameView() const
+{
+	return StringView(git_reference_name(data()));
+}
+
+StringView Reference::symbolicTargetView()const
+{
+	return StringView(git_reference_symbolic_target(data()));
+}
+
 Reference Reference::resolve() const
 {
     git_reference *ref;
@@ -286,6 +296,11 @@ std::string RefLogEntry::getEntryMessage() const
 	return std::string(git_reflog_entry_message(data()));
 }
 
+StringView RefLogEntry::getEntryMessageView() const
+{
+	return StringView(git_reflog_entry_message(data()));
+}
+
 const git_reflog_entry * RefLogEntry::data()const
 {
 	return _entry;
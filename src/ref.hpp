@@ -25,6 +25,7 @@
 #include <memory>
 
 #include "common.hpp"
+#include "stringview.hpp"
 
 
 namespace git2
@@ -76,6 +77,12 @@ public:
      */
     std::string name() const;
 
+	/**
+	 * Get a view of the full name of a reference,
+	 * valid as long as this reference.
+	 */
+	StringView nameView() const;
+
 	/**
 	 * Get full name to the reference pointed to by a symbolic reference.
 	 *
@@ -83,6 +90,12 @@ public:
 	 */
 	std::string symbolicTarget()const;
 
+	/**
+	 * Get a view of the symbolic target, valid as long as this reference.
+	 * Empty if the reference is not symbolic.
+	 */
+	StringView symbolicTargetView()const;
+
 	/**
 	 * Get the type of a reference.
 	 * 
@@ -409,6 +422,11 @@ public:
 	 * @return the log msg
 	 */
 	std::string getEntryMessage() const;
+
+	/**
+	 * Get a view of the log msg, valid as long as the reflog.
+	 */
+	StringView getEntryMessageView() const;
 	
 	const git_reflog_entry * data()const;
 private:
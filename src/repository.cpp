@@ -21,20 +21,36 @@
 
 #include "blob.hpp"
 #include "branch.hpp"
+#include "changedpaths.hpp"
 #include "commit.hpp"
+#include "commitgraph.hpp"
 #include "config.hpp"
 #include "database.hpp"
 #include "exception.hpp"
 #include "index.hpp"
 #include "oid.hpp"
+#include "oidindex.hpp"
+#include "oidmap.hpp"
+#include "parallel.hpp"
+#include "reachabilityindex.hpp"
 #include "ref.hpp"
 #include "remote.hpp"
+#include "sharedobjectcache.hpp"
 #include "revwalk.hpp"
 #include "signature.hpp"
 #include "status.hpp"
 #include "tag.hpp"
 #include "tree.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
 
 #ifdef GIT_WIN32
 #define GIT2PP_PATH_DIRECTORY_SEPARATOR '\\'
@@ -46,6 +62,212 @@
 namespace git2
 {
 
+namespace helper
+{
+
+/**
+ * Small bounded cache of shortened ids resolved to full ids.
+ */
+class PrefixCache
+{
+public:
+	/** Maximum number of remembered prefixes, the cache is emptied when reached. */
+	static const size_t capacity = 4096;
+
+	bool find(const OId& prefix, OId& full)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::unordered_map<Key, OId, KeyHash>::const_iterator it = _map.find(Key(prefix));
+		if(it==_map.end())
+			return false;
+		full = it->second;
+		return true;
+	}
+
+	void insert(const OId& prefix, const OId& full)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if(_map.size()>=capacity)
+			_map.clear();
+		_map[Key(prefix)] = full;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_map.clear();
+	}
+
+private:
+	// Prefixes of different lengths sharing their bytes are distinct keys.
+	struct Key
+	{
+		Key(const OId& oid):oid(oid){}
+		bool operator==(const Key& other) const {return oid.length()==other.oid.length() && oid==other.oid;}
+		OId oid;
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const {return std::hash<OId>()(key.oid) ^ (size_t)key.oid.length();}
+	};
+
+	std::mutex _mutex;
+	std::unordered_map<Key, OId, KeyHash> _map;
+};
+
+/**
+ * Wrapper-side data attached to a repository.
+ */
+struct RepositoryData
+{
+	RepositoryData(git_repository *repository):
+	index(std::make_shared<ObjectIdIndex>(std::string(git_repository_path(repository)) + "objects")),
+	exactLookups(0),
+	prefixLookups(0),
+	prefixCacheHits(0),
+	maxHandles(2 * std::max(std::thread::hardware_concurrency(), 1u)),
+	openingHandles(0),
+	sharedObjectCache(false)
+	{
+	}
+
+	~RepositoryData()
+	{
+		// Cached objects may belong to the private handles.
+		objectCache.reset();
+		for(git_repository* handle : handles)
+			git_repository_free(handle);
+	}
+
+	/**
+	 * Get an idle private handle on the repository, opened if none is available.
+	 *
+	 * @return NULL if none is idle and maxHandles are already open.
+	 */
+	git_repository* acquireHandle(git_repository *repository)
+	{
+		{
+			std::lock_guard<std::mutex> lock(handlesMutex);
+			if(!idleHandles.empty())
+			{
+				git_repository* handle = idleHandles.back();
+				idleHandles.pop_back();
+				return handle;
+			}
+			if(handles.size() + openingHandles >= maxHandles)
+				return NULL;
+			++openingHandles;
+		}
+		git_repository* handle = NULL;
+		int res = git_repository_open(&handle, git_repository_path(repository));
+		std::lock_guard<std::mutex> lock(handlesMutex);
+		--openingHandles;
+		Exception::git2_assert(res);
+		handles.push_back(handle);
+		if(sharedObjectCache)
+			addSharedObjectCache(handle);
+		return handle;
+	}
+
+	/**
+	 * Give back a handle got from acquireHandle().
+	 */
+	void releaseHandle(git_repository *handle)
+	{
+		std::lock_guard<std::mutex> lock(handlesMutex);
+		makeIdle(handle);
+	}
+
+	/**
+	 * Put a handle nobody uses in the idle ones, with handlesMutex held.
+	 */
+	void makeIdle(git_repository *handle)
+	{
+		std::vector<git_repository*>::iterator it = std::find(uncachedHandles.begin(), uncachedHandles.end(), handle);
+		if(it!=uncachedHandles.end())
+		{
+			// Busy when the cache was enabled, nobody uses it now.
+			try
+			{
+				addSharedObjectCache(handle);
+				uncachedHandles.erase(it);
+			}
+			catch(...)
+			{
+				// Still reads its packs directly, tried again on next release.
+			}
+		}
+		idleHandles.push_back(handle);
+	}
+
+	/**
+	 * Put a backend reading through the shared object cache in front of
+	 * the packs of a handle.
+	 */
+	static void addSharedObjectCache(git_repository *handle)
+	{
+		git_odb *odb = NULL;
+		Exception::git2_assert(git_repository_odb(&odb, handle));
+		std::unique_ptr<SharedCacheDatabaseBackend> backend;
+		int res;
+		try
+		{
+			backend.reset(new SharedCacheDatabaseBackend(std::string(git_repository_path(handle)) + "objects"));
+			res = git_odb_add_backend(odb, backend->data(), SharedCacheDatabaseBackend::Priority);
+		}
+		catch(...)
+		{
+			git_odb_free(odb);
+			throw;
+		}
+		git_odb_free(odb);
+		Exception::git2_assert(res);
+		// Owned by the odb from now on.
+		backend.release();
+	}
+
+	/** Object id snapshot, shared with the Database instances of the repository. */
+	std::shared_ptr<ObjectIdIndex> index;
+
+	/** Resolved shortened ids. */
+	PrefixCache prefixes;
+
+	/** Lookup counters. */
+	std::atomic<size_t> exactLookups, prefixLookups, prefixCacheHits;
+
+	/** Optional object cache, accessed with atomic shared_ptr operations. */
+	std::shared_ptr<ObjectCache> objectCache;
+
+	/** Commit graph, opened on first use, accessed with atomic shared_ptr operations. */
+	std::shared_ptr<CommitGraph> commitGraph;
+
+	/** Reachability bitmaps, opened on first use, accessed with atomic shared_ptr operations. */
+	std::shared_ptr<ReachabilityIndex> reachabilityIndex;
+
+	/** Changed-path filters, opened on first use, accessed with atomic shared_ptr operations. */
+	std::shared_ptr<ChangedPathFilters> changedPathFilters;
+
+	/** Private handles used by batch lookups, and the ones not in use. */
+	std::mutex handlesMutex;
+	std::vector<git_repository*> handles, idleHandles;
+
+	/**
+	 * Most private handles open at once, guarded by handlesMutex. Objects
+	 * kept by the object cache hold their handle, batches fall back to
+	 * fewer threads rather than opening more handles.
+	 */
+	size_t maxHandles, openingHandles;
+
+	/** Whether the handles read through the shared object cache, guarded by handlesMutex. */
+	bool sharedObjectCache;
+
+	/** Handles to put behind the shared object cache once released, guarded by handlesMutex. */
+	std::vector<git_repository*> uncachedHandles;
+};
+
+} // namespace helper
+
 //
 // Repository
 //
@@ -55,12 +277,14 @@ Repository::Repository()
 }
 
 Repository::Repository(git_repository *repository):
-_Class(repository)
+_Class(repository),
+_d(repository!=NULL ? std::make_shared<helper::RepositoryData>(repository) : nullptr)
 {
 }
 
 Repository::Repository( const Repository& other):
-_Class(other)
+_Class(other),
+_d(other._d)
 {
 }
 
@@ -220,11 +444,50 @@ Reference Repository::lookupShorthandReference(const std::string& shorthand) con
     return Reference(ref);
 }
 
+Object Repository::lookupObject(const OId& oid, git_otype type) const
+{
+	git_object *object = NULL;
+	std::shared_ptr<ObjectCache> cache = _d ? std::atomic_load(&_d->objectCache) : nullptr;
+
+	OId full = oid;
+	if(oid.isFull())
+	{
+		if(_d)
+			++_d->exactLookups;
+	}
+	else if(_d)
+	{
+		++_d->prefixLookups;
+		if(_d->prefixes.find(oid, full))
+			++_d->prefixCacheHits;
+	}
+
+	if(!full.isFull())
+	{
+		Exception::git2_assert(git_object_lookup_prefix(&object, data(), oid.constData(), oid.length(), type));
+		if(_d)
+			_d->prefixes.insert(oid, OId(git_object_id(object)));
+	}
+	else
+	{
+		if(cache)
+		{
+			Object cached = cache->find(full, type);
+			if(!cached.isNull())
+				return cached;
+		}
+		Exception::git2_assert(git_object_lookup(&object, data(), full.constData(), type));
+	}
+
+	Object res(object);
+	if(cache)
+		cache->insert(res);
+	return res;
+}
+
 Commit Repository::lookupCommit(const OId& oid) const
 {
-    git_commit *commit = NULL;
-    Exception::git2_assert(git_commit_lookup_prefix(&commit, data(), oid.constData(), oid.length()));
-    return Commit(commit);
+    return Commit(lookupObject(oid, GIT_OBJ_COMMIT));
 }
 
 Branch Repository::lookupBranch(const std::string& branchName, git_branch_t branchType)
@@ -236,30 +499,209 @@ Branch Repository::lookupBranch(const std::string& branchName, git_branch_t bran
 
 Tag Repository::lookupTag(const OId& oid) const
 {
-    git_tag *tag = NULL;
-    Exception::git2_assert(git_tag_lookup_prefix(&tag, data(), oid.constData(), oid.length()));
-    return Tag(tag);
+    return Tag(lookupObject(oid, GIT_OBJ_TAG));
 }
 
 Tree Repository::lookupTree(const OId& oid) const
 {
-    git_tree *tree = NULL;
-    Exception::git2_assert(git_tree_lookup_prefix(&tree, data(), oid.constData(), oid.length()));
-    return Tree(tree);
+    return Tree(lookupObject(oid, GIT_OBJ_TREE));
 }
 
 Blob Repository::lookupBlob(const OId& oid) const
 {
-    git_blob *blob = NULL;
-    Exception::git2_assert(git_blob_lookup_prefix(&blob, data(), oid.constData(), oid.length()));
-    return Blob(blob);
+    return Blob(lookupObject(oid, GIT_OBJ_BLOB));
 }
 
 Object Repository::lookup(const OId &oid) const
 {
-    git_object *object = NULL;
-    Exception::git2_assert(git_object_lookup_prefix(&object, data(), oid.constData(), oid.length(), GIT_OBJ_ANY));
-    return Object(object);
+    return lookupObject(oid, GIT_OBJ_ANY);
+}
+
+std::vector<Object> Repository::lookupObjects(const std::vector<OId>& oids, git_otype type, unsigned int threadCount) const
+{
+	// Below this count of objects per thread, spawning threads costs more than it saves.
+	static const size_t minPerThread = 16;
+	static const size_t chunkSize = 4;
+
+	std::vector<Object> objects(oids.size());
+	std::shared_ptr<ObjectCache> cache = _d ? std::atomic_load(&_d->objectCache) : nullptr;
+
+	std::vector<size_t> pending;
+	pending.reserve(oids.size());
+	for(size_t n=0; n<oids.size(); ++n)
+	{
+		if(_d)
+			++(oids[n].isFull() ? _d->exactLookups : _d->prefixLookups);
+		if(cache && oids[n].isFull())
+			objects[n] = cache->find(oids[n], type);
+		if(objects[n].isNull())
+			pending.push_back(n);
+	}
+
+	size_t workers = helper::parallel_threads((pending.size() + minPerThread - 1) / minPerThread, threadCount);
+
+	// The calling thread works with the main handle, others with private
+	// ones, given back once the lease and all the objects found are freed.
+	// Without a handle left, the remaining objects are found by fewer threads.
+	std::weak_ptr<helper::RepositoryData> owner = _d;
+	std::vector<std::shared_ptr<git_repository>> leases;
+	for(size_t n=1; n<workers; ++n)
+	{
+		git_repository* handle = _d->acquireHandle(data());
+		if(handle==NULL)
+			break;
+		try
+		{
+			leases.push_back(std::shared_ptr<git_repository>(handle, [owner](git_repository *handle)
+			{
+				std::shared_ptr<helper::RepositoryData> d = owner.lock();
+				if(d)
+					d->releaseHandle(handle);
+			}));
+		}
+		catch(...)
+		{
+			_d->releaseHandle(handle);
+			throw;
+		}
+	}
+	helper::parallel_for(pending.size(), leases.size() + 1, [&](size_t i, unsigned int worker)
+		{
+			git_repository *repository = worker==0 ? data() : leases[worker-1].get();
+			const OId& oid = oids[pending[i]];
+			git_object *object = NULL;
+			int err = oid.isFull()
+				? git_object_lookup(&object, repository, oid.constData(), type)
+				: git_object_lookup_prefix(&object, repository, oid.constData(), oid.length(), type);
+			if(err!=GIT_OK)
+				return;
+			if(worker==0)
+				objects[pending[i]] = Object(object);
+			else
+			{
+				// Objects of a private handle keep it leased until they are freed.
+				std::shared_ptr<git_repository> lease = leases[worker-1];
+				try
+				{
+					objects[pending[i]] = Object(std::shared_ptr<git_object>(object, [lease](git_object *object){git_object_free(object);}));
+				}
+				catch(...)
+				{
+					git_object_free(object);
+					throw;
+				}
+			}
+		}, chunkSize);
+	leases.clear();
+
+	for(size_t n : pending)
+	{
+		if(objects[n].isNull())
+			continue;
+		if(cache)
+			cache->insert(objects[n]);
+		if(_d && !oids[n].isFull())
+			_d->prefixes.insert(oids[n], objects[n].oid());
+	}
+	return objects;
+}
+
+std::vector<Object> Repository::lookupMany(const std::vector<OId>& oids, unsigned int threadCount) const
+{
+	return lookupObjects(oids, GIT_OBJ_ANY, threadCount);
+}
+
+std::vector<Commit> Repository::lookupCommits(const std::vector<OId>& oids, unsigned int threadCount) const
+{
+	std::vector<Object> objects = lookupObjects(oids, GIT_OBJ_COMMIT, threadCount);
+	return std::vector<Commit>(objects.begin(), objects.end());
+}
+
+std::vector<Tree> Repository::lookupTrees(const std::vector<OId>& oids, unsigned int threadCount) const
+{
+	std::vector<Object> objects = lookupObjects(oids, GIT_OBJ_TREE, threadCount);
+	return std::vector<Tree>(objects.begin(), objects.end());
+}
+
+std::vector<Blob> Repository::lookupBlobs(const std::vector<OId>& oids, unsigned int threadCount) const
+{
+	std::vector<Object> objects = lookupObjects(oids, GIT_OBJ_BLOB, threadCount);
+	return std::vector<Blob>(objects.begin(), objects.end());
+}
+
+std::vector<Tag> Repository::lookupTags(const std::vector<OId>& oids, unsigned int threadCount) const
+{
+	std::vector<Object> objects = lookupObjects(oids, GIT_OBJ_TAG, threadCount);
+	return std::vector<Tag>(objects.begin(), objects.end());
+}
+
+LookupStats Repository::lookupStats() const
+{
+	LookupStats stats = {0, 0, 0};
+	if(_d)
+	{
+		stats.exact = _d->exactLookups;
+		stats.prefix = _d->prefixLookups;
+		stats.prefixCacheHit = _d->prefixCacheHits;
+	}
+	return stats;
+}
+
+void Repository::clearLookupCache()
+{
+	if(_d)
+	{
+		_d->prefixes.clear();
+		_d->exactLookups = 0;
+		_d->prefixLookups = 0;
+		_d->prefixCacheHits = 0;
+	}
+}
+
+void Repository::enableObjectCache(size_t commitBytes, size_t treeBytes, size_t tagBytes, size_t shardCount)
+{
+	if(_d)
+		std::atomic_store(&_d->objectCache, std::make_shared<ObjectCache>(commitBytes, treeBytes, tagBytes, shardCount));
+}
+
+void Repository::disableObjectCache()
+{
+	if(_d)
+		std::atomic_store(&_d->objectCache, std::shared_ptr<ObjectCache>());
+}
+
+ObjectCacheStats Repository::objectCacheStats(git_otype type) const
+{
+	std::shared_ptr<ObjectCache> cache = _d ? std::atomic_load(&_d->objectCache) : nullptr;
+	if(cache)
+		return cache->stats(type);
+	ObjectCacheStats stats = {0, 0, 0, 0, 0};
+	return stats;
+}
+
+void Repository::enableSharedObjectCache()
+{
+	if(!_d)
+		return;
+	std::lock_guard<std::mutex> lock(_d->handlesMutex);
+	if(_d->sharedObjectCache)
+		return;
+	helper::RepositoryData::addSharedObjectCache(data());
+	_d->sharedObjectCache = true;
+
+	// An odb backend list is not safe to change while the handle is read
+	// from: busy handles get the cache when released.
+	for(git_repository* handle : _d->handles)
+		_d->uncachedHandles.push_back(handle);
+	std::vector<git_repository*> idleHandles;
+	idleHandles.swap(_d->idleHandles);
+	for(git_repository* handle : idleHandles)
+		_d->makeIdle(handle);
+}
+
+ObjectCacheStats Repository::sharedObjectCacheStats()
+{
+	return SharedObjectCache::global().stats();
 }
 
 Reference Repository::createReference(const std::string& name, const OId& id, bool force)
@@ -372,6 +814,46 @@ OId Repository::createBlobFromBuffer(const void* buffer, size_t len)
     return oid;
 }
 
+std::vector<OId> Repository::createBlobsFromBuffers(const std::vector<ByteView>& buffers, unsigned int threadCount, bool sync)
+{
+	return database().writeMany(buffers, GIT_OBJ_BLOB, threadCount, sync);
+}
+
+OId Repository::createBlobFromChunks(std::function<size_t(char*, size_t)> source, const std::string& hintPath)
+{
+	struct Payload
+	{
+		std::function<size_t(char*, size_t)>& source;
+		std::exception_ptr error;
+	} payload = {source, nullptr};
+
+	OId oid;
+	int res = git_blob_create_fromchunks(oid.data(), data(), hintPath.empty() ? NULL : hintPath.c_str(),
+		[](char* content, size_t maxLength, void* ptr)->int{
+			Payload& payload = *(Payload*)ptr;
+			try
+			{
+				return (int)payload.source(content, maxLength);
+			}
+			catch(...)
+			{
+				payload.error = std::current_exception();
+				return -1;
+			}
+		}, &payload);
+	if(payload.error)
+		std::rethrow_exception(payload.error);
+	Exception::git2_assert(res);
+	return oid;
+}
+
+OId Repository::createBlobFromStream(std::istream& stream, size_t size)
+{
+	ObjectWriteStream writer = database().openWriteStream(size, GIT_OBJ_BLOB);
+	writer.write(stream);
+	return writer.finalize();
+}
+
 OId Repository::createBlobFromWorkdir(const std::string& relativePath)
 {
     OId oid;
@@ -442,7 +924,12 @@ Database Repository::database() const
 {
     git_odb *odb;
     Exception::git2_assert( git_repository_odb(&odb, data()) );
-    return Database(odb);
+    return Database(odb, _d ? _d->index : nullptr);
+}
+
+std::vector<int> Repository::abbreviate(const std::vector<OId>& oids, int minLength) const
+{
+	return database().abbreviate(oids, minLength);
 }
 
 Index Repository::index() const
@@ -613,16 +1100,382 @@ RevWalk Repository::createRevWalk()
 {
 	git_revwalk *out;
 	git_revwalk_new(&out, data());
-	return RevWalk(out);
+	return RevWalk(out, commitGraph());
 }
 
 std::pair<size_t, size_t> Repository::aheadBehind(const OId& local, const OId& upstream)const
 {
+	std::shared_ptr<const CommitGraph> graph = commitGraph();
+	if(graph && !graph->empty())
+	{
+		uint32_t localPos = graph->position(local), upstreamPos = graph->position(upstream);
+		if(localPos!=CommitGraph::NoPosition && upstreamPos!=CommitGraph::NoPosition)
+			return graph->aheadBehind(localPos, upstreamPos);
+	}
+
 	std::pair<size_t, size_t> res;
 	Exception::git2_assert(git_graph_ahead_behind(&res.first, &res.second, data(), local.constData(), upstream.constData()));
 	return res;
 }
 
+namespace helper
+{
+
+// Paint down the ancestors of commits by commit time, reading them through
+// the commit graph when it knows them.
+class MergeBasePainter
+{
+public:
+	enum { First = 1, Second = 2, Both = 3, Stale = 4, Result = 8 };
+
+	MergeBasePainter(const Repository& repository, const CommitGraph* graph):
+	_repository(repository), _graph(graph), _active(0)
+	{
+	}
+
+	// Best common ancestors of one and others. Skewed commit times may
+	// report a merge base with one of its ancestors, see reduce().
+	std::vector<OId> paint(const OId& one, const std::vector<OId>& others)
+	{
+		push(one, First);
+		for(const OId& oid : others)
+			push(oid, Second);
+
+		std::vector<OId> candidates;
+		while(_active>0)
+		{
+			OId oid = _queue.top().second;
+			_queue.pop();
+			Node& node = _nodes[oid];
+			--node.queued;
+			if((node.flags & Stale)==0)
+				--_active;
+			unsigned char flags = node.flags & (Both|Stale);
+			if(flags==Both)
+			{
+				if((node.flags & Result)==0)
+				{
+					node.flags |= Result;
+					candidates.push_back(oid);
+				}
+				flags |= Stale;
+			}
+			std::vector<OId> parents = node.parents;
+			for(const OId& parent : parents)
+				push(parent, flags);
+		}
+
+		std::vector<OId> bases;
+		for(const OId& oid : candidates)
+		{
+			if((_nodes[oid].flags & Stale)==0)
+				bases.push_back(oid);
+		}
+		return bases;
+	}
+
+	bool reached(const OId& oid, unsigned char flags) const
+	{
+		const Node* node = _nodes.find(oid);
+		return node!=nullptr && (node->flags & flags)==flags;
+	}
+
+	git_time_t time(const OId& oid) const
+	{
+		const Node* node = _nodes.find(oid);
+		return node!=nullptr ? node->time : 0;
+	}
+
+private:
+	struct Node
+	{
+		unsigned char flags;
+		unsigned int queued;
+		git_time_t time;
+		std::vector<OId> parents;
+	};
+
+	Node& node(const OId& oid)
+	{
+		Node* found = _nodes.find(oid);
+		if(found!=nullptr)
+			return *found;
+		Node node = {0, 0, 0, std::vector<OId>()};
+		uint32_t pos = _graph!=NULL ? _graph->position(oid) : CommitGraph::NoPosition;
+		if(pos!=CommitGraph::NoPosition)
+		{
+			std::vector<uint32_t> parents;
+			_graph->parents(pos, parents);
+			for(uint32_t parent : parents)
+				node.parents.push_back(_graph->oid(parent));
+			node.time = _graph->time(pos);
+		}
+		else
+		{
+			Commit commit = _repository.lookupCommit(oid);
+			for(unsigned int n=0; n<git_commit_parentcount(commit.data()); ++n)
+				node.parents.push_back(OId(git_commit_parent_id(commit.data(), n)));
+			node.time = git_commit_time(commit.data());
+		}
+		Node& inserted = _nodes[oid];
+		inserted = std::move(node);
+		return inserted;
+	}
+
+	// Commits are pushed again when they get new flags, as a descendant
+	// with a skewed time may come after them.
+	void push(const OId& oid, unsigned char flags)
+	{
+		Node& n = node(oid);
+		if((n.flags & flags)==flags)
+			return;
+		if((n.flags & Stale)==0 && (flags & Stale)!=0)
+			_active -= n.queued;
+		n.flags |= flags;
+		++n.queued;
+		if((n.flags & Stale)==0)
+			++_active;
+		_queue.push(std::make_pair(n.time, oid));
+	}
+
+	const Repository& _repository;
+	const CommitGraph* _graph;
+	OIdMap<Node> _nodes;
+	std::priority_queue<std::pair<git_time_t, OId>> _queue;
+	size_t _active;
+};
+
+} // namespace helper
+
+// Remove the merge bases reachable from other ones.
+static std::vector<OId> reduce_merge_bases(const Repository& repository, const CommitGraph* graph, const std::vector<OId>& bases)
+{
+	std::vector<OId> res;
+	for(size_t n=0; n<bases.size(); ++n)
+	{
+		std::vector<OId> others;
+		for(size_t m=0; m<bases.size(); ++m)
+		{
+			if(m!=n)
+				others.push_back(bases[m]);
+		}
+		helper::MergeBasePainter painter(repository, graph);
+		painter.paint(bases[n], others);
+		if(!painter.reached(bases[n], helper::MergeBasePainter::Second))
+			res.push_back(bases[n]);
+	}
+	return res;
+}
+
+OId Repository::mergeBase(const OId& one, const OId& two)const
+{
+	std::vector<OId> bases = mergeBaseMany(one, std::vector<OId>(1, two));
+	if(bases.empty())
+	{
+		giterr_set_str(GITERR_MERGE, "No merge base found");
+		throw Exception(GIT_ENOTFOUND);
+	}
+	return bases.front();
+}
+
+std::vector<OId> Repository::mergeBaseMany(const OId& one, const std::vector<OId>& others)const
+{
+	std::vector<OId> bases;
+	if(others.empty())
+		return bases;
+	if(std::find(others.begin(), others.end(), one)!=others.end())
+	{
+		bases.push_back(one);
+		return bases;
+	}
+
+	std::shared_ptr<const CommitGraph> graph = commitGraph();
+	if(graph && !graph->empty())
+	{
+		std::vector<uint32_t> positions;
+		for(const OId& oid : others)
+		{
+			uint32_t pos = graph->position(oid);
+			if(pos==CommitGraph::NoPosition)
+				break;
+			positions.push_back(pos);
+		}
+		uint32_t onePos = graph->position(one);
+		if(onePos!=CommitGraph::NoPosition && positions.size()==others.size())
+		{
+			for(uint32_t pos : graph->mergeBases(onePos, positions))
+				bases.push_back(graph->oid(pos));
+			return bases;
+		}
+	}
+
+	helper::MergeBasePainter painter(*this, graph.get());
+	bases = painter.paint(one, others);
+	if(bases.size()>1)
+	{
+		bases = reduce_merge_bases(*this, graph.get(), bases);
+		std::stable_sort(bases.begin(), bases.end(), [&painter](const OId& a, const OId& b)
+		{
+			return painter.time(a) > painter.time(b);
+		});
+	}
+	return bases;
+}
+
+std::vector<OId> Repository::mergeBaseOctopus(const std::vector<OId>& commits)const
+{
+	std::vector<OId> bases;
+	if(commits.empty())
+		return bases;
+	bases.push_back(commits.front());
+	for(size_t n=1; n<commits.size() && !bases.empty(); ++n)
+	{
+		std::vector<OId> next;
+		for(const OId& base : bases)
+		{
+			for(const OId& oid : mergeBaseMany(base, std::vector<OId>(1, commits[n])))
+			{
+				if(std::find(next.begin(), next.end(), oid)==next.end())
+					next.push_back(oid);
+			}
+		}
+		// Merge bases of different bases may be ancestors of one another.
+		bases = next.size()>1 ? reduce_merge_bases(*this, commitGraph().get(), next) : next;
+	}
+	return bases;
+}
+
+std::shared_ptr<const CommitGraph> Repository::commitGraph() const
+{
+	if(!_d)
+		return nullptr;
+	std::shared_ptr<CommitGraph> graph = std::atomic_load(&_d->commitGraph);
+	if(!graph)
+	{
+		// Concurrent first calls may open it twice, the last one wins.
+		graph = std::make_shared<CommitGraph>(_d->index->objectsDir());
+		std::atomic_store(&_d->commitGraph, graph);
+	}
+	return graph;
+}
+
+// Commits pointed by the references of a repository, directly or through tags.
+static std::vector<OId> reference_tips(git_repository *repository)
+{
+	std::vector<OId> tips;
+	git_strarray refs;
+	Exception::git2_assert(git_reference_list(&refs, repository));
+	for(size_t n=0; n<refs.count; ++n)
+	{
+		git_oid oid;
+		git_object *object = NULL, *commit = NULL;
+		if(git_reference_name_to_id(&oid, repository, refs.strings[n])!=GIT_OK
+			|| git_object_lookup(&object, repository, &oid, GIT_OBJ_ANY)!=GIT_OK)
+			continue;
+		// References to trees or blobs are skipped.
+		if(git_object_peel(&commit, object, GIT_OBJ_COMMIT)==GIT_OK)
+		{
+			tips.push_back(OId(git_object_id(commit)));
+			git_object_free(commit);
+		}
+		git_object_free(object);
+	}
+	git_strarray_free(&refs);
+	giterr_clear();
+	return tips;
+}
+
+size_t Repository::writeCommitGraph()
+{
+	return writeCommitGraph(reference_tips(data()));
+}
+
+size_t Repository::writeCommitGraph(const std::vector<OId>& tips)
+{
+	std::shared_ptr<const CommitGraph> graph = commitGraph();
+	if(!graph)
+		return 0;
+	size_t count = graph->append(*this, tips);
+	if(count>0)
+		std::atomic_store(&_d->commitGraph, std::make_shared<CommitGraph>(graph->objectsDir()));
+	return count;
+}
+
+std::shared_ptr<const ReachabilityIndex> Repository::reachabilityIndex() const
+{
+	if(!_d)
+		return nullptr;
+	std::shared_ptr<ReachabilityIndex> index = std::atomic_load(&_d->reachabilityIndex);
+	if(!index)
+	{
+		// Concurrent first calls may open it twice, the last one wins.
+		index = std::make_shared<ReachabilityIndex>(_d->index->objectsDir());
+		std::atomic_store(&_d->reachabilityIndex, index);
+	}
+	return index;
+}
+
+size_t Repository::writeReachabilityIndex(unsigned int interval)
+{
+	if(!_d)
+		return 0;
+	size_t count = ReachabilityIndex::write(*this, reference_tips(data()), interval);
+	std::atomic_store(&_d->reachabilityIndex, std::make_shared<ReachabilityIndex>(_d->index->objectsDir()));
+	return count;
+}
+
+bool Repository::isReachable(const OId& commit, const std::string& refname) const
+{
+	git_oid oid;
+	git_object *object = NULL, *peeled = NULL;
+	Exception::git2_assert(git_reference_name_to_id(&oid, data(), refname.c_str()));
+	Exception::git2_assert(git_object_lookup(&object, data(), &oid, GIT_OBJ_ANY));
+	int err = git_object_peel(&peeled, object, GIT_OBJ_COMMIT);
+	git_object_free(object);
+	Exception::git2_assert(err);
+	OId tip(git_object_id(peeled));
+	git_object_free(peeled);
+	return reachabilityIndex()->isReachable(*this, commit, std::vector<OId>(1, tip));
+}
+
+std::shared_ptr<const ChangedPathFilters> Repository::changedPathFilters() const
+{
+	if(!_d)
+		return nullptr;
+	std::shared_ptr<ChangedPathFilters> filters = std::atomic_load(&_d->changedPathFilters);
+	if(!filters)
+	{
+		// Concurrent first calls may open them twice, the last one wins.
+		filters = std::make_shared<ChangedPathFilters>(_d->index->objectsDir());
+		std::atomic_store(&_d->changedPathFilters, filters);
+	}
+	return filters;
+}
+
+size_t Repository::writeChangedPathFilters()
+{
+	return writeChangedPathFilters(reference_tips(data()));
+}
+
+size_t Repository::writeChangedPathFilters(const std::vector<OId>& tips)
+{
+	std::shared_ptr<const ChangedPathFilters> filters = changedPathFilters();
+	if(!filters)
+		return 0;
+	size_t count = filters->append(*this, tips);
+	if(count>0)
+		std::atomic_store(&_d->changedPathFilters, std::make_shared<ChangedPathFilters>(filters->objectsDir()));
+	return count;
+}
+
+std::vector<OId> Repository::pathHistory(const std::string& path, const OId& from, size_t limit) const
+{
+	std::shared_ptr<const ChangedPathFilters> filters = changedPathFilters();
+	if(!filters)
+		return std::vector<OId>();
+	return filters->history(*this, path, std::vector<OId>(1, from), limit);
+}
+
 void Repository::addIgnoreRule(const std::string& rules)
 {
 	Exception::git2_assert(git_ignore_add_rule(data(), rules.c_str()));
@@ -654,6 +1507,40 @@ OId Repository::hashFile(const std::string& path, git_otype type, const std::str
 	return OId(&out);
 }
 
+std::vector<OId> Repository::hashFiles(const std::vector<std::string>& paths, git_otype type, unsigned int threadCount)
+{
+	std::vector<OId> oids(paths.size());
+	size_t workers = helper::parallel_threads(paths.size(), threadCount);
+
+	// The calling thread works with the main handle, others with private ones.
+	std::vector<git_repository*> handles;
+	try
+	{
+		for(size_t n=1; n<workers; ++n)
+		{
+			git_repository* handle = _d->acquireHandle(data());
+			if(handle==NULL)
+				break;
+			handles.push_back(handle);
+		}
+		helper::parallel_for(paths.size(), handles.size() + 1, [&](size_t n, unsigned int worker)
+			{
+				git_oid oid;
+				Exception::git2_assert(git_repository_hashfile(&oid, worker==0 ? data() : handles[worker-1], paths[n].c_str(), type, NULL));
+				oids[n] = OId(&oid);
+			});
+	}
+	catch(...)
+	{
+		for(git_repository* handle : handles)
+			_d->releaseHandle(handle);
+		throw;
+	}
+	for(git_repository* handle : handles)
+		_d->releaseHandle(handle);
+	return oids;
+}
+
 void Repository::setHead(const std::string& refname)
 {
 	Exception::git2_assert(git_repository_set_head(data(), refname.c_str()));
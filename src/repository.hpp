@@ -22,6 +22,8 @@
 
 #include <git2.h>
 
+#include <functional>
+#include <istream>
 #include <list>
 #include <memory>
 #include <string>
@@ -33,6 +35,8 @@
 #include "diff.hpp"
 #include "status.hpp"
 #include "index.hpp"
+#include "objectcache.hpp"
+#include "stringview.hpp"
 #include "tree.hpp"
 
 namespace git2
@@ -53,10 +57,18 @@ class RefLog;
 class Remote;
 class Repository;
 class RevWalk;
+class CommitGraph;
+class ReachabilityIndex;
+class ChangedPathFilters;
 class Signature;
 class StatusList;
 class StatusOptions;
 
+namespace helper
+{
+struct RepositoryData;
+}
+
 
 typedef std::function<bool(git_checkout_notify_t why, const std::string& path, const DiffFile& baseline,
 	const DiffFile& target, const DiffFile& workdir)> CheckoutNotifyCallbackFunction;
@@ -65,6 +77,16 @@ typedef std::function<void(const char *path, size_t completedSteps, size_t total
 
 typedef std::function<bool(size_t index, const std::string& message, OId stashId)> StashCallbackFunction;
 
+/**
+ * Counters of object lookups done through a Repository.
+ */
+struct LookupStats
+{
+	size_t exact;          //!< Lookups by full-length id.
+	size_t prefix;         //!< Lookups by shortened id.
+	size_t prefixCacheHit; //!< Shortened id lookups resolved from the prefix cache.
+};
+
 /**
  * Represents a Git repository.
  */
@@ -398,6 +420,123 @@ public:
      */
     Object lookup(const OId& oid) const;
 
+	/**
+	 * Lookup a batch of objects in parallel.
+	 *
+	 * Objects are inflated by a pool of threads, each one using its own
+	 * handle on this repository. Handles are opened on first use, kept for
+	 * later batches and released with the repository. Small batches are
+	 * looked up on the calling thread only. libgit2 must be built with
+	 * thread support and initialized with git_threads_init().
+	 *
+	 * Objects which cannot be found (or have an ambiguous short id) come
+	 * back as null entries instead of raising an exception.
+	 * Returned objects stay valid as long as this repository.
+	 *
+	 * Objects found by the pool belong to its private handles, which
+	 * their own lookups (parents, trees...) use. A handle is not given to
+	 * other batches until all the objects it produced are freed, including
+	 * those kept by the object cache. Meanwhile, more handles are opened
+	 * up to twice the hardware concurrency, then batches use fewer threads.
+	 * Like objects of this repository, objects of one handle must not be
+	 * used by several threads at once.
+	 *
+	 * @param oids Identifiers of the objects (complete or short ids).
+	 * @param threadCount Maximum number of threads, 0 for the hardware concurrency.
+	 * @return Objects, in input order.
+	 * @throws Exception if a repository handle cannot be opened.
+	 */
+	std::vector<Object> lookupMany(const std::vector<OId>& oids, unsigned int threadCount = 0) const;
+
+	/**
+	 * Lookup a batch of commits in parallel.
+	 * Same as lookupMany(), objects which are not commits are null entries.
+	 */
+	std::vector<Commit> lookupCommits(const std::vector<OId>& oids, unsigned int threadCount = 0) const;
+
+	/**
+	 * Lookup a batch of trees in parallel.
+	 * Same as lookupMany(), objects which are not trees are null entries.
+	 */
+	std::vector<Tree> lookupTrees(const std::vector<OId>& oids, unsigned int threadCount = 0) const;
+
+	/**
+	 * Lookup a batch of blobs in parallel.
+	 * Same as lookupMany(), objects which are not blobs are null entries.
+	 */
+	std::vector<Blob> lookupBlobs(const std::vector<OId>& oids, unsigned int threadCount = 0) const;
+
+	/**
+	 * Lookup a batch of tags in parallel.
+	 * Same as lookupMany(), objects which are not tags are null entries.
+	 */
+	std::vector<Tag> lookupTags(const std::vector<OId>& oids, unsigned int threadCount = 0) const;
+
+	/**
+	 * Get the object lookup counters of this repository.
+	 *
+	 * Full-length ids are looked up directly. Shortened ids are resolved
+	 * once by prefix then remembered in a small cache, shared by the
+	 * copies of this Repository, mapping them to their full id.
+	 */
+	LookupStats lookupStats() const;
+
+	/**
+	 * Forget resolved prefixes and reset lookup counters.
+	 *
+	 * Cached prefixes are not invalidated when new objects are written;
+	 * call this if a previously unique prefix may have become ambiguous.
+	 */
+	void clearLookupCache();
+
+	/**
+	 * Enable the wrapper-side object cache of this repository.
+	 *
+	 * Once enabled, commits, trees and tags found by full-length id through
+	 * lookup(), lookupCommit(), lookupTree() and lookupTag() are kept in a
+	 * sharded LRU cache, shared by the copies of this Repository, and
+	 * returned directly by later lookups of the same id.
+	 * Enabling it again replaces the previous cache.
+	 *
+	 * @param commitBytes byte budget for commits.
+	 * @param treeBytes byte budget for trees.
+	 * @param tagBytes byte budget for tags.
+	 * @param shardCount number of independently locked shards.
+	 */
+	void enableObjectCache(size_t commitBytes, size_t treeBytes, size_t tagBytes, size_t shardCount = 16);
+
+	/**
+	 * Disable the object cache, releasing all cached objects.
+	 */
+	void disableObjectCache();
+
+	/**
+	 * Get the object cache counters of an object type.
+	 *
+	 * @param type GIT_OBJ_COMMIT, GIT_OBJ_TREE or GIT_OBJ_TAG.
+	 * @return Counters, all zeros if the cache is not enabled.
+	 */
+	ObjectCacheStats objectCacheStats(git_otype type) const;
+
+	/**
+	 * Read packed objects through the process-wide SharedObjectCache.
+	 *
+	 * Once enabled, the database of this repository and the private
+	 * handles used by batch lookups serve packed objects from the shared
+	 * cache, so an object is inflated once for all of them and for the
+	 * other repositories opened on the same directory with the cache
+	 * enabled. Private handles still used by objects of a previous batch
+	 * lookup start reading through it once these objects are freed.
+	 * Enabling it again does nothing.
+	 * @see SharedCacheDatabaseBackend
+	 */
+	void enableSharedObjectCache();
+
+	/**
+	 * Get the counters of the process-wide SharedObjectCache.
+	 */
+	static ObjectCacheStats sharedObjectCacheStats();
+
 	/**
 	 * Create a new symbolic reference.
 	 *
@@ -541,8 +680,49 @@ public:
      */
     OId createBlobFromBuffer(const std::vector<unsigned char>& buffer);
     OId createBlobFromBuffer(const void* buffer, size_t len);
+
+    /**
+     * Write many in-memory buffers to the ODB as blobs, compressing and
+     * writing them concurrently.
+     * @see Database::writeMany
+     *
+     * @param buffers contents of the blobs.
+     * @param threadCount number of threads, 0 for the number of cores.
+     * @param sync flush the written files to the disk once, at the end.
+     * @return Created blob OIds, in input order.
+     * @throws Exception
+     */
+    std::vector<OId> createBlobsFromBuffers(const std::vector<ByteView>& buffers, unsigned int threadCount = 0, bool sync = false);
     
-    // TODO Wrap git_blob_create_fromchunks
+
+    /**
+     * Write a blob whose size is not known beforehand, from chunks
+     * produced by a function.
+     *
+     * The content is stored in a temporary file by libgit2 before being
+     * hashed and written to the ODB.
+     *
+     * @param source fills a buffer of the given size and returns the
+     * number of bytes put, 0 at the end of the content.
+     * @param hintPath path used to select the filters to apply on the
+     * content, empty for none.
+     * @return Created blob OId.
+     * @throws Exception, or the exception thrown by the source.
+     */
+    OId createBlobFromChunks(std::function<size_t(char*, size_t)> source, const std::string& hintPath = "");
+
+    /**
+     * Write a blob from a stream whose size is known.
+     *
+     * Large contents are hashed, deflated and written concurrently.
+     * @see ObjectWriteStream
+     *
+     * @param stream stream to read the content from.
+     * @param size exact size of the content.
+     * @return Created blob OId.
+     * @throws Exception if the stream ends before size bytes.
+     */
+    OId createBlobFromStream(std::istream& stream, size_t size);
 
     /**
      * Read a file from the filesystem and write its content
@@ -611,6 +791,21 @@ public:
      * @throws Exception
      */
     Database database() const;
+
+	/**
+	 * Compute the minimal unique abbreviation lengths of a batch of ids.
+	 *
+	 * Lengths are computed against a sorted snapshot of all the object
+	 * ids of the repository (packs, loose objects and alternates) which is
+	 * built on first call, kept by the repository and updated when its
+	 * Database is refreshed.
+	 *
+	 * @param oids full-length ids to abbreviate.
+	 * @param minLength minimal length to return, at least GIT_OID_MINPREFIXLEN.
+	 * @return Lengths in hexadecimal digits, in input order.
+	 * @throws Exception
+	 */
+	std::vector<int> abbreviate(const std::vector<OId>& oids, int minLength = 7) const;
     
     // TODO Implement git_repository_refdb
 
@@ -786,6 +981,8 @@ public:
 	
 	/**
 	 * Create a revision walker for this repository.
+	 *
+	 * The walker uses the commit graph of the repository when there is one.
 	 */
 	RevWalk createRevWalk();
 	
@@ -796,11 +993,142 @@ public:
 	 * upstream relationship, but it helps to think of one as a branch and
 	 * the other as its upstream, the `ahead` and `behind` values will be
 	 * what git would report for the branches.
+	 *
+	 * Counts are computed on the commit graph when both commits are in it.
 	 * 
 	 * @param local the commit for local
 	 * @param upstream the commit for upstream
 	 */
 	std::pair<size_t, size_t> aheadBehind(const OId& local, const OId& upstream)const;
+
+	/**
+	 * Find the best common ancestor of two commits, like `git merge-base`.
+	 *
+	 * @param one id of the first commit.
+	 * @param two id of the second commit.
+	 * @return Id of the merge base, the first one of mergeBaseMany() if there are several.
+	 * @throws Exception GIT_ENOTFOUND if the commits have no common ancestor.
+	 */
+	OId mergeBase(const OId& one, const OId& two)const;
+
+	/**
+	 * Find all the best common ancestors of a commit and of a hypothetical
+	 * merge of other commits, like `git merge-base --all one others...`.
+	 *
+	 * The walk stops as soon as every pending commit is an ancestor of a
+	 * found merge base. On the commit graph commits are walked by
+	 * generation number, otherwise by commit time and merge bases which
+	 * are ancestors of other ones are removed afterwards.
+	 *
+	 * @param one id of the first commit.
+	 * @param others ids of the other commits.
+	 * @return Ids of the merge bases, by decreasing generation number on
+	 * the commit graph and by decreasing commit time otherwise. Empty if none,
+	 * or if others is empty.
+	 */
+	std::vector<OId> mergeBaseMany(const OId& one, const std::vector<OId>& others)const;
+
+	/**
+	 * Find the best common ancestors of all the commits, like
+	 * `git merge-base --octopus`.
+	 *
+	 * @param commits ids of the commits.
+	 * @return Ids of the merge bases. Empty if none.
+	 */
+	std::vector<OId> mergeBaseOctopus(const std::vector<OId>& commits)const;
+
+	/**
+	 * Get the commit graph of this repository.
+	 *
+	 * The graph is opened on first call and shared by the copies of this
+	 * Repository. It is empty if no graph was written.
+	 */
+	std::shared_ptr<const CommitGraph> commitGraph() const;
+
+	/**
+	 * Append the commits reachable from all references to the commit graph.
+	 *
+	 * @return Number of commits added to the graph.
+	 * @throws Exception
+	 */
+	size_t writeCommitGraph();
+
+	/**
+	 * Append the commits reachable from some commits to the commit graph.
+	 *
+	 * @param tips full-length ids of the commits to start from.
+	 * @return Number of commits added to the graph.
+	 * @throws Exception
+	 */
+	size_t writeCommitGraph(const std::vector<OId>& tips);
+
+	/**
+	 * Get the reachability bitmap index of the repository.
+	 *
+	 * The index is opened on first call and shared by the copies of this
+	 * Repository. It is empty if no index was written.
+	 */
+	std::shared_ptr<const ReachabilityIndex> reachabilityIndex() const;
+
+	/**
+	 * Write the reachability bitmap index of the commits reachable from
+	 * all references, replacing the existing one.
+	 * The commit graph is updated first.
+	 *
+	 * @param interval distance between commits with a bitmap.
+	 * @return Number of written bitmaps.
+	 * @throws Exception
+	 */
+	size_t writeReachabilityIndex(unsigned int interval = 100);
+
+	/**
+	 * Check if a commit is reachable from a reference, using the
+	 * reachability bitmap index.
+	 *
+	 * @param commit full-length id of the commit.
+	 * @param refname name of the reference, peeled to a commit.
+	 * @throws Exception
+	 */
+	bool isReachable(const OId& commit, const std::string& refname) const;
+
+	/**
+	 * Get the changed-path Bloom filters of the repository.
+	 *
+	 * The filters are opened on first call and shared by the copies of this
+	 * Repository. They are empty if none were written.
+	 */
+	std::shared_ptr<const ChangedPathFilters> changedPathFilters() const;
+
+	/**
+	 * Compute the changed-path filters of the commits reachable from all
+	 * references which have none yet.
+	 *
+	 * @return Number of added filters.
+	 * @throws Exception
+	 */
+	size_t writeChangedPathFilters();
+
+	/**
+	 * Compute the changed-path filters of the commits reachable from some
+	 * commits which have none yet.
+	 *
+	 * @param tips full-length ids of the commits to start from.
+	 * @return Number of added filters.
+	 * @throws Exception
+	 */
+	size_t writeChangedPathFilters(const std::vector<OId>& tips);
+
+	/**
+	 * List the commits changing a path, like `git log -- path`, using
+	 * the changed-path filters to skip unchanged commits.
+	 *
+	 * @param path path of a file or directory, relative to the root tree.
+	 * @param from full-length id of the commit to start from.
+	 * @param limit maximum number of commits to list, 0 for all.
+	 * @return Ids of the commits, by decreasing commit time.
+	 * @throws Exception
+	 */
+	std::vector<OId> pathHistory(const std::string& path, const OId& from, size_t limit = 0) const;
 	
 /**
  * @name Ignore
@@ -883,6 +1211,22 @@ public:
 	 */
 	OId hashFile(const std::string& path, git_otype type, const std::string& asPath);
 
+	/**
+	 * Calculate the hashes of many files using repository filtering rules.
+	 *
+	 * Files are spread over several threads, the calling one using this
+	 * repository and the others the private handles of lookupMany(). Each
+	 * file is hashed like hashFile() with its own path for the filtering
+	 * rules. Use Database::hashFiles() when no filter applies.
+	 *
+	 * @param paths Paths to files on disk, absolute or relative to the working directory.
+	 * @param type The object type to hash as (e.g. GIT_OBJ_BLOB).
+	 * @param threadCount Maximum number of threads, 0 for the hardware concurrency.
+	 * @return Ids of the files, in input order.
+	 * @throws Exception if a file cannot be hashed.
+	 */
+	std::vector<OId> hashFiles(const std::vector<std::string>& paths, git_otype type, unsigned int threadCount = 0);
+
 	/**
 	 * Make the repository HEAD point to the specified reference.
 	 *
@@ -1257,6 +1601,23 @@ protected:
      * Construct a wrapper around a libgit2 repository pointer.
      */
     Repository(git_repository *repository);
+
+private:
+    /**
+     * Lookup an object, exactly for full-length ids, through the
+     * prefix cache otherwise.
+     */
+    Object lookupObject(const OId& oid, git_otype type) const;
+
+    /**
+     * Lookup a batch of objects of a type, null entries for failures.
+     */
+    std::vector<Object> lookupObjects(const std::vector<OId>& oids, git_otype type, unsigned int threadCount) const;
+
+    /**
+     * Wrapper-side data attached to the repository, shared by copies.
+     */
+    std::shared_ptr<helper::RepositoryData> _d;
 };
 
 } // namespace git2
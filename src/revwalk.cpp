@@ -20,21 +20,37 @@
 #include "revwalk.hpp"
 
 #include "commit.hpp"
+#include "commitgraph.hpp"
 #include "exception.hpp"
 #include "oid.hpp"
 #include "ref.hpp"
 #include "repository.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 namespace git2
 {
 
-RevWalk::RevWalk(git_revwalk* revwalk):
-_Class(revwalk)
+/** Flags of the commits of queue walks. */
+enum { Visible = 1, Hidden = 2, Queued = 4 };
+
+static uint32_t graph_position(const CommitGraph* graph, const OId& oid);
+static std::pair<int64_t, int64_t> walk_key(git_revwalk* walk, const CommitGraph* graph, RevWalk::SortModes sorting, const OId& oid, uint32_t pos, std::vector<OId>* parents);
+
+
+RevWalk::RevWalk(git_revwalk* revwalk, const std::shared_ptr<const CommitGraph>& graph):
+_Class(revwalk),
+_walk(std::make_shared<GraphWalk>())
 {
+	_walk->graph = graph && !graph->empty() ? graph : nullptr;
+	_walk->sorting = None;
+	_walk->clear();
 }
 
 RevWalk::RevWalk( const RevWalk& other ):
-_Class(other.data())
+_Class(other),
+_walk(other._walk)
 {
 }
 
@@ -42,87 +58,563 @@ RevWalk::~RevWalk()
 {
 }
 
+void RevWalk::GraphWalk::clear()
+{
+	usable = true;
+	pushed.clear();
+	hidden.clear();
+	restart();
+}
+
+void RevWalk::GraphWalk::restart()
+{
+	started = false;
+	commits.clear();
+	next = 0;
+	incremental = false;
+	resumable = false;
+	queue.clear();
+	flags.clear();
+	parents.clear();
+	interesting = 0;
+}
+
+void RevWalk::pushGraph(const OId& oid, bool hide) const
+{
+	if(_walk->resumable)
+		enqueue(oid, hide ? Hidden : Visible);
+	if(!_walk->graph || !_walk->usable)
+		return;
+	uint32_t pos = _walk->graph->position(oid);
+	if(pos==CommitGraph::NoPosition)
+		_walk->usable = false;
+	else
+		(hide ? _walk->hidden : _walk->pushed).push_back(pos);
+}
+
+void RevWalk::pushOpaque() const
+{
+	_walk->usable = false;
+	_walk->resumable = false;
+}
+
 void RevWalk::reset() const
 {
     git_revwalk_reset(data());
+    _walk->clear();
 }
 
 void RevWalk::push(const OId& oid) const
 {
     Exception::git2_assert(git_revwalk_push(data(), oid.constData()));
+    pushGraph(oid, false);
 }
 
 void RevWalk::push(const Commit& commit) const
 {
     Exception::git2_assert(git_revwalk_push(data(), commit.oid().constData()));
+    pushGraph(commit.oid(), false);
 }
 
 void RevWalk::push(const Reference& reference) const
 {
     Exception::git2_assert(git_revwalk_push_glob(data(), reference.name().c_str()));
+    pushOpaque();
 }
 
 void RevWalk::pushRef(const std::string& refname)
 {
 	Exception::git2_assert(git_revwalk_push_ref(data(), refname.c_str()));
+	pushOpaque();
 }
 
 void RevWalk::push(const std::string& glob) const
 {
     Exception::git2_assert(git_revwalk_push_glob(data(), glob.c_str()));
+    pushOpaque();
 }
 
 void RevWalk::pushHead() const
 {
     Exception::git2_assert(git_revwalk_push_head(data()));
+    pushOpaque();
 }
 
 void RevWalk::pushRange(const std::string& range) const
 {
     Exception::git2_assert(git_revwalk_push_range(data(), range.c_str()));
+    pushOpaque();
 }
 
 void RevWalk::hide(const OId& oid) const
 {
     Exception::git2_assert(git_revwalk_hide(data(), oid.constData()));
+    pushGraph(oid, true);
 }
 
 void RevWalk::hide(const Commit& commit) const
 {
     Exception::git2_assert(git_revwalk_hide(data(), commit.oid().constData()));
+    pushGraph(commit.oid(), true);
 }
 
 void RevWalk::hide(const Reference& reference) const
 {
     Exception::git2_assert(git_revwalk_hide_glob(data(), reference.name().c_str()));
+    pushOpaque();
 }
 
 void RevWalk::hideRef(const std::string& refname)
 {
 	Exception::git2_assert(git_revwalk_hide_ref(data(), refname.c_str()));
+	pushOpaque();
 }
 
 void RevWalk::hide(const std::string& glob) const
 {
     Exception::git2_assert(git_revwalk_hide_glob(data(), glob.c_str()));
+    pushOpaque();
 }
 
 void RevWalk::hideHead() const
 {
     Exception::git2_assert(git_revwalk_hide_head(data()));
+    pushOpaque();
 }
 
 bool RevWalk::next(OId& oid) const
 {
-    int err = git_revwalk_next(oid.data(), data());
+    GraphWalk& walk = *_walk;
+    if(walk.resumable)
+        return nextQueued(oid);
+    if(!walk.started)
+    {
+        walk.started = true;
+        if(walk.graph && walk.usable && !walk.pushed.empty())
+        {
+            if(walk.sorting & (Topological|Reverse))
+                walk.commits = walk.graph->walk(walk.pushed, walk.hidden, walk.sorting);
+            else
+            {
+                // Other walks give their first commits without listing the others.
+                walk.incremental = true;
+                for(uint32_t pos : walk.pushed)
+                    enqueue(walk.graph->oid(pos), Visible);
+                for(uint32_t pos : walk.hidden)
+                    enqueue(walk.graph->oid(pos), Hidden);
+            }
+        }
+        else
+            walk.usable = false;
+    }
+    if(walk.usable)
+    {
+        if(walk.incremental)
+            return nextQueued(oid);
+        if(walk.next < walk.commits.size())
+        {
+            oid = walk.graph->oid(walk.commits[walk.next++]);
+            return true;
+        }
+        // Like libgit2, reset the walker when the walk is over.
+        reset();
+        return false;
+    }
+
+    git_oid out;
+    int err = git_revwalk_next(&out, data());
+    if(err == GIT_OK)
+        oid = OId(&out);
+    else
+        walk.clear();
     return (err == GIT_OK);
 }
 
+size_t RevWalk::nextBatch(git_oid* ids, size_t n) const
+{
+    GraphWalk& walk = *_walk;
+    if(n==0)
+        return 0;
+    if(walk.resumable || (walk.started && walk.usable && walk.incremental))
+    {
+        size_t count = 0;
+        OId oid;
+        for(; count<n && nextQueued(oid); ++count)
+            ids[count] = *oid.constData();
+        return count;
+    }
+    if(!walk.started)
+    {
+        OId oid;
+        if(!next(oid))
+            return 0;
+        ids[0] = *oid.constData();
+        return 1 + nextBatch(ids + 1, n - 1);
+    }
+    if(walk.usable)
+    {
+        size_t count = std::min(n, walk.commits.size() - walk.next);
+        for(size_t i=0; i<count; ++i)
+            ids[i] = *walk.graph->oid(walk.commits[walk.next++]).constData();
+        // Like libgit2, reset the walker when the walk is over.
+        if(count<n)
+            reset();
+        return count;
+    }
+
+    size_t count = 0;
+    for(; count<n; ++count)
+    {
+        int err = git_revwalk_next(&ids[count], data());
+        if(err!=GIT_OK)
+        {
+            walk.clear();
+            if(err!=GIT_ITEROVER)
+                Exception::git2_assert(err);
+            break;
+        }
+    }
+    return count;
+}
+
+std::vector<git_oid> RevWalk::nextBatch(size_t n) const
+{
+    std::vector<git_oid> ids(n);
+    ids.resize(nextBatch(ids.data(), n));
+    return ids;
+}
+
+RevWalk::iterator RevWalk::begin() const
+{
+    return iterator(this);
+}
+
+RevWalk::iterator RevWalk::end() const
+{
+    return iterator();
+}
+
 void RevWalk::setSorting(SortModes sm)
 {
+    GraphWalk& walk = *_walk;
+    // libgit2 only resets a walk it runs itself, which drops its pushes.
+    bool running = walk.started && !walk.usable;
     git_revwalk_sorting(data(), sm);
+    walk.sorting = sm;
+    if(running)
+    {
+        walk.clear();
+        return;
+    }
+    if(walk.resumable && (sm & (Topological|Reverse))==0)
+    {
+        // The frontier of a restored walk is kept, in the new order.
+        for(GraphWalk::Entry& entry : walk.queue)
+            entry.first = walk_key(data(), walk.graph.get(), sm, entry.second, graph_position(walk.graph.get(), entry.second), NULL);
+        std::make_heap(walk.queue.begin(), walk.queue.end());
+        return;
+    }
+    walk.restart();
+}
+
+
+//
+// Resumable walks
+//
+
+static uint32_t graph_position(const CommitGraph* graph, const OId& oid)
+{
+    return graph!=NULL ? graph->position(oid) : CommitGraph::NoPosition;
+}
+
+// Walk order key of a commit at pos in the graph, and its parents if
+// asked, read from the commit when the graph does not know it. Keys
+// decrease from children to parents: graph commits come by generation
+// after other ones, which come by commit time.
+static std::pair<int64_t, int64_t> walk_key(git_revwalk* walk, const CommitGraph* graph, RevWalk::SortModes sorting, const OId& oid, uint32_t pos, std::vector<OId>* parents)
+{
+    if(pos!=CommitGraph::NoPosition)
+    {
+        if(parents!=NULL)
+        {
+            std::vector<uint32_t> positions;
+            graph->parents(pos, positions);
+            parents->clear();
+            for(uint32_t parent : positions)
+                parents->push_back(graph->oid(parent));
+        }
+        if(sorting & RevWalk::Time)
+            return std::make_pair((int64_t)0, (int64_t)graph->time(pos));
+        return std::make_pair((int64_t)0, (int64_t)graph->generation(pos));
+    }
+
+    git_commit* commit = NULL;
+    Exception::git2_assert(git_commit_lookup(&commit, git_revwalk_repository(walk), oid.constData()));
+    if(parents!=NULL)
+    {
+        parents->clear();
+        for(unsigned int n=0; n<git_commit_parentcount(commit); ++n)
+            parents->push_back(OId(git_commit_parent_id(commit, n)));
+    }
+    int64_t time = git_commit_time(commit);
+    git_commit_free(commit);
+    return std::make_pair((int64_t)((sorting & RevWalk::Time) ? 0 : 1), time);
+}
+
+void RevWalk::enqueue(const OId& oid, unsigned char flags) const
+{
+    GraphWalk& walk = *_walk;
+    unsigned char* state = walk.flags.find(oid);
+    if(state!=nullptr)
+    {
+        // Walked commits are not queued again, their ancestors all come after them.
+        if((*state & Queued)==0 || (*state & flags)==flags)
+            return;
+        if((*state & Hidden)==0 && (flags & Hidden)!=0)
+            --walk.interesting;
+        *state |= flags;
+        return;
+    }
+    // Commits outside the graph are read once, their parents are kept
+    // until they are walked.
+    uint32_t pos = graph_position(walk.graph.get(), oid);
+    std::vector<OId> parents;
+    GraphWalk::Entry entry(walk_key(data(), walk.graph.get(), walk.sorting, oid, pos,
+        pos==CommitGraph::NoPosition ? &parents : NULL), oid);
+    if(pos==CommitGraph::NoPosition)
+        walk.parents[oid].swap(parents);
+    walk.flags[oid] = flags | Queued;
+    walk.queue.push_back(entry);
+    std::push_heap(walk.queue.begin(), walk.queue.end());
+    if((flags & Hidden)==0)
+        ++walk.interesting;
+}
+
+bool RevWalk::nextQueued(OId& oid) const
+{
+    GraphWalk& walk = *_walk;
+    std::vector<OId> parents;
+    while(walk.interesting>0)
+    {
+        std::pop_heap(walk.queue.begin(), walk.queue.end());
+        OId current = walk.queue.back().second;
+        walk.queue.pop_back();
+        unsigned char state = walk.flags[current] & ~Queued;
+        walk.flags[current] = state;
+        if((state & Hidden)==0)
+            --walk.interesting;
+
+        // Parents are queued before returning, so that the queue is the
+        // frontier of the walk between two calls.
+        std::vector<OId>* read = walk.parents.find(current);
+        if(read!=nullptr)
+        {
+            parents.swap(*read);
+            walk.parents.erase(current);
+        }
+        else
+            walk_key(data(), walk.graph.get(), walk.sorting, current, graph_position(walk.graph.get(), current), &parents);
+        for(const OId& parent : parents)
+            enqueue(parent, state);
+        if(state==Visible)
+        {
+            oid = current;
+            return true;
+        }
+    }
+
+    // Like libgit2, reset the walker when the walk is over, a restored
+    // walk stays resumable with nothing left to walk.
+    bool resumable = walk.resumable;
+    reset();
+    walk.resumable = resumable;
+    return false;
 }
 
+void RevWalk::restore(const Cursor& cursor)
+{
+    reset();
+    setSorting(cursor.sorting());
+    _walk->resumable = true;
+    for(const OId& oid : cursor.pending())
+        push(oid);
+    for(const OId& oid : cursor.hidden())
+        hide(oid);
+}
+
+RevWalk::Cursor RevWalk::cursor() const
+{
+    if(!_walk->resumable)
+    {
+        giterr_set_str(GITERR_INVALID, "Revision walk is not resumable, it must be restored from a cursor");
+        throw Exception(GIT_ERROR);
+    }
+    Cursor res(_walk->sorting);
+    for(const GraphWalk::Entry& entry : _walk->queue)
+    {
+        if(*_walk->flags.find(entry.second) & Hidden)
+            res.hide(entry.second);
+        else
+            res.push(entry.second);
+    }
+    return res;
+}
+
+
+//
+// RevWalk::Cursor
+//
+
+// Token layout: version, sorting, pending and hidden counts as varints,
+// then the raw ids, all encoded in unpadded base64url.
+static const unsigned char CursorVersion = 1;
+static const char Base64Url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+static void write_varint(std::string& buffer, size_t value)
+{
+    while(value>=0x80)
+    {
+        buffer.push_back((char)(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    buffer.push_back((char)value);
+}
+
+static bool read_varint(const std::string& buffer, size_t& pos, size_t& value)
+{
+    value = 0;
+    for(unsigned int shift=0; pos<buffer.size() && shift<64; shift+=7)
+    {
+        unsigned char c = (unsigned char)buffer[pos++];
+        value |= (size_t)(c & 0x7F) << shift;
+        if((c & 0x80)==0)
+            return true;
+    }
+    return false;
+}
+
+static void invalid_cursor()
+{
+    giterr_set_str(GITERR_INVALID, "Invalid revision walk cursor");
+    throw Exception(GIT_ERROR);
+}
+
+RevWalk::Cursor::Cursor(SortModes sorting):
+_sorting(sorting)
+{
+    if((sorting & ~(SortModes)Time)!=0)
+    {
+        giterr_set_str(GITERR_INVALID, "Only walks without sorting or sorted by time can be resumed");
+        throw Exception(GIT_ERROR);
+    }
+}
+
+void RevWalk::Cursor::push(const OId& oid)
+{
+    _pending.push_back(oid);
+}
+
+void RevWalk::Cursor::hide(const OId& oid)
+{
+    _hidden.push_back(oid);
+}
+
+RevWalk::SortModes RevWalk::Cursor::sorting() const
+{
+    return _sorting;
+}
+
+const std::vector<OId>& RevWalk::Cursor::pending() const
+{
+    return _pending;
+}
+
+const std::vector<OId>& RevWalk::Cursor::hidden() const
+{
+    return _hidden;
+}
+
+bool RevWalk::Cursor::done() const
+{
+    return _pending.empty();
+}
+
+std::string RevWalk::Cursor::token() const
+{
+    std::string buffer;
+    buffer.push_back((char)CursorVersion);
+    buffer.push_back((char)_sorting);
+    write_varint(buffer, _pending.size());
+    write_varint(buffer, _hidden.size());
+    for(const std::vector<OId>* oids : {&_pending, &_hidden})
+    {
+        for(const OId& oid : *oids)
+            buffer.append((const char*)oid.raw(), GIT_OID_RAWSZ);
+    }
+
+    std::string res;
+    res.reserve((buffer.size()*4 + 2) / 3);
+    for(size_t n=0; n<buffer.size(); n+=3)
+    {
+        uint32_t bits = (uint32_t)(unsigned char)buffer[n] << 16;
+        if(n+1<buffer.size())
+            bits |= (uint32_t)(unsigned char)buffer[n+1] << 8;
+        if(n+2<buffer.size())
+            bits |= (uint32_t)(unsigned char)buffer[n+2];
+        size_t chars = std::min((size_t)4, (buffer.size() - n)*4/3 + 1);
+        for(size_t c=0; c<chars; ++c)
+            res.push_back(Base64Url[(bits >> (18 - 6*c)) & 0x3F]);
+    }
+    return res;
+}
+
+RevWalk::Cursor RevWalk::Cursor::fromToken(const std::string& token)
+{
+    std::string buffer;
+    uint32_t bits = 0;
+    unsigned int count = 0;
+    for(char c : token)
+    {
+        const char* pos = c!='\0' ? std::strchr(Base64Url, c) : NULL;
+        if(pos==NULL)
+            invalid_cursor();
+        bits = (bits << 6) | (uint32_t)(pos - Base64Url);
+        if(++count==4)
+        {
+            buffer.push_back((char)(bits >> 16));
+            buffer.push_back((char)(bits >> 8));
+            buffer.push_back((char)bits);
+            bits = 0;
+            count = 0;
+        }
+    }
+    if(count==1)
+        invalid_cursor();
+    if(count>=2)
+        buffer.push_back((char)(bits >> (6*count - 8)));
+    if(count==3)
+        buffer.push_back((char)(bits >> 2));
+
+    size_t pos = 2, pending = 0, hidden = 0;
+    if(buffer.size()<2 || (unsigned char)buffer[0]!=CursorVersion
+        || (buffer[1]!=(char)None && buffer[1]!=(char)Time)
+        || !read_varint(buffer, pos, pending) || !read_varint(buffer, pos, hidden)
+        || pending > buffer.size() || hidden > buffer.size()
+        || buffer.size() - pos != (pending + hidden) * GIT_OID_RAWSZ)
+        invalid_cursor();
+
+    Cursor res((SortModes)buffer[1]);
+    for(size_t n=0; n<pending+hidden; ++n, pos+=GIT_OID_RAWSZ)
+    {
+        git_oid oid;
+        git_oid_fromraw(&oid, (const unsigned char*)buffer.data() + pos);
+        if(n<pending)
+            res.push(OId(&oid));
+        else
+            res.hide(OId(&oid));
+    }
+    return res;
+}
 
 } // namespace git2
 
@@ -22,17 +22,23 @@
 
 #include <git2.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "common.hpp"
+#include "oid.hpp"
+#include "oidmap.hpp"
 
 namespace git2
 {
 
 class Commit;
+class CommitGraph;
 class Exception;
-class OId;
 class Reference;
 class Repository;
 
@@ -40,6 +46,13 @@ class Repository;
 /**
   * The revision walker can be used to traverse Git commit history.
   * It features sorting abilities and more.
+  *
+  * When created with a commit graph, walks whose start and hidden points
+  * are all pushed by id and known by the graph are done on the graph,
+  * without reading commit objects. Without Topological nor Reverse
+  * sorting, such walks are incremental: commits come by decreasing
+  * generation number, or by commit time with Time sorting, and the first
+  * ones come without listing the others.
   */
 class  RevWalk : public helper::Git2PtrWrapper<git_revwalk, git_revwalk_free>
 {
@@ -57,7 +70,7 @@ public:
 
     typedef unsigned int SortModes; //!< Combination of SortMode
 
-    RevWalk(git_revwalk* revwalk);
+    RevWalk(git_revwalk* revwalk, const std::shared_ptr<const CommitGraph>& graph = nullptr);
 
     RevWalk( const RevWalk& other );
 
@@ -223,14 +236,235 @@ public:
      */
     bool next(OId& oid) const;
 
+    /**
+     * Get the oids of the next commits from the revision traversal.
+     *
+     * Like next(), the walker is reset once the walk is over, which is
+     * reported by a call returning less than n ids.
+     *
+     * @param ids buffer receiving the raw ids, of at least n entries.
+     * @param n maximum number of ids to get.
+     * @return Number of ids written, less than n only when the walk is over.
+     * @throws Exception
+     */
+    size_t nextBatch(git_oid* ids, size_t n) const;
+
+    /**
+     * Get the oids of the next commits from the revision traversal.
+     *
+     * @param n maximum number of ids to get.
+     * @return The raw ids, less than n only when the walk is over.
+     * @throws Exception
+     */
+    std::vector<git_oid> nextBatch(size_t n) const;
+
+    /**
+     * Input iterator over the oids of a revision traversal.
+     *
+     * Each increment takes one commit from the walker with next(), without
+     * reading ahead: when iteration stops early, the walker continues with
+     * the commit following the last one read.
+     */
+    class iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef OId value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const OId* pointer;
+        typedef const OId& reference;
+
+        iterator():_walk(NULL){}
+
+        reference operator*() const {return _oid;}
+        pointer operator->() const {return &_oid;}
+
+        iterator& operator++()
+        {
+            if(!_walk->next(_oid))
+                _walk = NULL;
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator it(*this);
+            ++*this;
+            return it;
+        }
+
+        bool operator==(const iterator& other) const {return _walk==other._walk;}
+        bool operator!=(const iterator& other) const {return _walk!=other._walk;}
+
+    private:
+        friend class RevWalk;
+        explicit iterator(const RevWalk* walk):_walk(walk){++*this;}
+
+        const RevWalk* _walk;
+        OId _oid;
+    };
+
+    /**
+     * Start iterating over the revision traversal, for use with range-for
+     * and standard algorithms.
+     * The first commit is taken from the walker.
+     */
+    iterator begin() const;
+
+    /**
+     * Iterator past the last commit of the revision traversal.
+     */
+    iterator end() const;
+
     /**
      * Change the sorting mode when iterating through the
      * repository's contents.
-     * Changing the sorting mode resets the walker.
+     * Like libgit2, pushed and hidden commits are kept, and the walk
+     * starts over from them. A walk restored from a cursor goes on from
+     * its frontier in the new order if it can still be resumed (no
+     * sorting or time sorting); otherwise it starts over from the
+     * cursor commits.
      *
      * @param sortMode The sorting mode @see SortModes.
      */
     void setSorting(SortModes sortMode);
+
+    /**
+     * Frontier of a revision traversal, to resume it later in any process.
+     *
+     * A cursor holds the commits queued by a walk and not walked yet, and
+     * the queued commits of the hidden side, so resuming a walk costs the
+     * size of the next page and not the number of commits already walked.
+     *
+     * Walks order commits so that a commit comes after all its children:
+     * by generation number for commits of the commit graph, then by commit
+     * time for other ones, or by commit time only with Time sorting. This
+     * makes the queued commits enough to restore the walk. With commit
+     * times, a commit older than one of its parents may have that parent
+     * walked again after a restore.
+     *
+     * Only None and Time sortings can be resumed.
+     */
+    class Cursor
+    {
+    public:
+        /**
+         * Create a cursor with nothing to walk, pushes and hides are
+         * added with push() and hide().
+         *
+         * @param sorting None or Time.
+         * @throws Exception if the sorting cannot be resumed.
+         */
+        Cursor(SortModes sorting = None);
+
+        /**
+         * Add a commit to start from.
+         */
+        void push(const OId& oid);
+
+        /**
+         * Add a commit to hide with its ancestors.
+         */
+        void hide(const OId& oid);
+
+        /**
+         * Sorting mode of the walk.
+         */
+        SortModes sorting() const;
+
+        /**
+         * Commits left to walk from.
+         */
+        const std::vector<OId>& pending() const;
+
+        /**
+         * Commits hidden with their ancestors.
+         */
+        const std::vector<OId>& hidden() const;
+
+        /**
+         * Check if the walk is over.
+         */
+        bool done() const;
+
+        /**
+         * Serialize the cursor as a compact URL-safe token.
+         */
+        std::string token() const;
+
+        /**
+         * Read a cursor serialized with token().
+         *
+         * @throws Exception if the token is not valid.
+         */
+        static Cursor fromToken(const std::string& token);
+
+    private:
+        SortModes _sorting;
+        std::vector<OId> _pending, _hidden;
+    };
+
+    /**
+     * Reset the walker to resume the walk of a cursor.
+     *
+     * The walker then walks by itself, reading commits from the commit
+     * graph when it knows them, and cursor() can be called at any time
+     * until the walk is over. Pushing or hiding references and globs, or
+     * changing to a topological or reverse sorting, stops the walk from
+     * being resumable.
+     *
+     * @param cursor walk to resume.
+     * @throws Exception
+     */
+    void restore(const Cursor& cursor);
+
+    /**
+     * Get the frontier of the walk, to resume it later with restore().
+     *
+     * @return Cursor of the commits left to walk, done() when the walk is over.
+     * @throws Exception if the walk was not restored from a cursor.
+     */
+    Cursor cursor() const;
+
+private:
+    /**
+     * Graph walk state, shared by copies.
+     */
+    struct GraphWalk
+    {
+        std::shared_ptr<const CommitGraph> graph;
+        bool usable;              //!< All pushes and hides are known by the graph.
+        bool started;
+        SortModes sorting;
+        std::vector<uint32_t> pushed, hidden, commits;
+        size_t next;
+
+        /**
+         * Queue walk, for None and Time sortings on the graph and for
+         * restored walks: queued commits as a max-heap, walk flags and
+         * interesting queued commits.
+         */
+        typedef std::pair<std::pair<int64_t, int64_t>, OId> Entry;
+        bool incremental;         //!< Graph walk done with the queue.
+        bool resumable;           //!< Walk restored from a cursor.
+        std::vector<Entry> queue;
+        OIdMap<unsigned char> flags;
+        OIdMap<std::vector<OId>> parents; //!< Of queued commits outside the graph.
+        size_t interesting;
+
+        /** Forget pushes and hides, and restart. */
+        void clear();
+
+        /** Restart the walk from the pushes and hides. */
+        void restart();
+    };
+
+    void pushGraph(const OId& oid, bool hide) const;
+    void pushOpaque() const;
+    void enqueue(const OId& oid, unsigned char flags) const;
+    bool nextQueued(OId& oid) const;
+
+    std::shared_ptr<GraphWalk> _walk;
 };
 
 
@@ -0,0 +1,268 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "sha1.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GIT2PP_SHA1_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace git2
+{
+namespace helper
+{
+
+static inline uint32_t rol(uint32_t value, int bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+// Portable kernel.
+static void blocks_portable(uint32_t state[5], const unsigned char* data, size_t count)
+{
+	for(; count>0; --count, data += 64)
+	{
+		uint32_t w[80];
+		for(int i=0; i<16; ++i)
+			w[i] = ((uint32_t)data[4*i] << 24) | ((uint32_t)data[4*i+1] << 16) | ((uint32_t)data[4*i+2] << 8) | (uint32_t)data[4*i+3];
+		for(int i=16; i<80; ++i)
+			w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+		for(int i=0; i<80; ++i)
+		{
+			uint32_t f, k;
+			if(i<20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if(i<40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if(i<60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t t = rol(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rol(b, 30);
+			b = a;
+			a = t;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+#ifdef GIT2PP_SHA1_SHANI
+
+// One group of four rounds of the SHA extensions kernel. Message words
+// are kept in four registers, each group consuming msg[G%4] and
+// preparing the words of the following groups.
+template<int G>
+__attribute__((target("sha,sse4.1"), always_inline))
+static inline void shani_rounds(__m128i& abcd, __m128i& e0, __m128i& e1, __m128i msg[4])
+{
+	__m128i& e = G%2==0 ? e0 : e1;
+	__m128i& next = G%2==0 ? e1 : e0;
+	if(G==0)
+		e = _mm_add_epi32(e, msg[0]);
+	else
+		e = _mm_sha1nexte_epu32(e, msg[G%4]);
+	next = abcd;
+	if(G>=3 && G<=18)
+		msg[(G+1)%4] = _mm_sha1msg2_epu32(msg[(G+1)%4], msg[G%4]);
+	abcd = _mm_sha1rnds4_epu32(abcd, e, G/5);
+	if(G>=1 && G<=16)
+		msg[(G+3)%4] = _mm_sha1msg1_epu32(msg[(G+3)%4], msg[G%4]);
+	if(G>=2 && G<=17)
+		msg[(G+2)%4] = _mm_xor_si128(msg[(G+2)%4], msg[G%4]);
+}
+
+// Kernel using the x86 SHA extensions.
+__attribute__((target("sha,sse4.1")))
+static void blocks_shani(uint32_t state[5], const unsigned char* data, size_t count)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	for(; count>0; --count, data += 64)
+	{
+		__m128i abcdSave = abcd, e0Save = e0, e1;
+		__m128i msg[4];
+		for(int i=0; i<4; ++i)
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16*i)), mask);
+
+		shani_rounds<0>(abcd, e0, e1, msg);
+		shani_rounds<1>(abcd, e0, e1, msg);
+		shani_rounds<2>(abcd, e0, e1, msg);
+		shani_rounds<3>(abcd, e0, e1, msg);
+		shani_rounds<4>(abcd, e0, e1, msg);
+		shani_rounds<5>(abcd, e0, e1, msg);
+		shani_rounds<6>(abcd, e0, e1, msg);
+		shani_rounds<7>(abcd, e0, e1, msg);
+		shani_rounds<8>(abcd, e0, e1, msg);
+		shani_rounds<9>(abcd, e0, e1, msg);
+		shani_rounds<10>(abcd, e0, e1, msg);
+		shani_rounds<11>(abcd, e0, e1, msg);
+		shani_rounds<12>(abcd, e0, e1, msg);
+		shani_rounds<13>(abcd, e0, e1, msg);
+		shani_rounds<14>(abcd, e0, e1, msg);
+		shani_rounds<15>(abcd, e0, e1, msg);
+		shani_rounds<16>(abcd, e0, e1, msg);
+		shani_rounds<17>(abcd, e0, e1, msg);
+		shani_rounds<18>(abcd, e0, e1, msg);
+		shani_rounds<19>(abcd, e0, e1, msg);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0Save);
+		abcd = _mm_add_epi32(abcd, abcdSave);
+	}
+
+	_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+static bool has_shani()
+{
+	unsigned int eax, ebx, ecx, edx;
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3))
+		return false;
+	if(__get_cpuid_max(0, NULL) < 7)
+		return false;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1u << 29))!=0;
+}
+
+#endif // GIT2PP_SHA1_SHANI
+
+typedef void (*BlocksFunction)(uint32_t state[5], const unsigned char* data, size_t count);
+
+// Fastest kernel supported by the processor, chosen once.
+static BlocksFunction blocks_kernel()
+{
+#ifdef GIT2PP_SHA1_SHANI
+	static const BlocksFunction kernel = has_shani() ? blocks_shani : blocks_portable;
+	return kernel;
+#else
+	return blocks_portable;
+#endif
+}
+
+Sha1::Sha1()
+{
+	reset();
+}
+
+void Sha1::reset()
+{
+	_state[0] = 0x67452301;
+	_state[1] = 0xEFCDAB89;
+	_state[2] = 0x98BADCFE;
+	_state[3] = 0x10325476;
+	_state[4] = 0xC3D2E1F0;
+	_length = 0;
+	_used = 0;
+}
+
+bool Sha1::accelerated()
+{
+	return blocks_kernel()!=blocks_portable;
+}
+
+void Sha1::update(const void* data, size_t len)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	_length += len;
+	if(_used>0)
+	{
+		size_t n = std::min(len, sizeof(_buffer) - _used);
+		std::memcpy(_buffer + _used, bytes, n);
+		_used += n;
+		bytes += n;
+		len -= n;
+		if(_used<sizeof(_buffer))
+			return;
+		blocks_kernel()(_state, _buffer, 1);
+		_used = 0;
+	}
+	size_t count = len / sizeof(_buffer);
+	if(count>0)
+	{
+		blocks_kernel()(_state, bytes, count);
+		bytes += count * sizeof(_buffer);
+		len -= count * sizeof(_buffer);
+	}
+	std::memcpy(_buffer, bytes, len);
+	_used = len;
+}
+
+void Sha1::final(git_oid& oid)
+{
+	uint64_t bits = _length * 8;
+	unsigned char pad[72];
+	size_t padLen = (_used < 56 ? 56 : 120) - _used;
+	std::memset(pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+	for(int i=0; i<8; ++i)
+		pad[padLen + i] = (unsigned char)(bits >> (56 - 8*i));
+	update(pad, padLen + 8);
+
+	for(int i=0; i<5; ++i)
+	{
+		oid.id[4*i] = (unsigned char)(_state[i] >> 24);
+		oid.id[4*i+1] = (unsigned char)(_state[i] >> 16);
+		oid.id[4*i+2] = (unsigned char)(_state[i] >> 8);
+		oid.id[4*i+3] = (unsigned char)_state[i];
+	}
+}
+
+size_t Sha1::formatObjectHeader(char* buffer, git_otype type, size_t size)
+{
+	int len = std::sprintf(buffer, "%s %lu", git_object_type2string(type), (unsigned long)size);
+	return (size_t)len + 1;
+}
+
+void Sha1::updateObjectHeader(git_otype type, size_t size)
+{
+	char header[32];
+	update(header, formatObjectHeader(header, type, size));
+}
+
+} // namespace helper
+} // namespace git2
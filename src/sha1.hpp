@@ -0,0 +1,87 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_SHA1_HPP_
+#define _GIT2PP_SHA1_HPP_
+
+#include <git2.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace git2
+{
+namespace helper
+{
+
+/**
+ * Incremental SHA-1 computation, libgit2 only hashes whole buffers.
+ *
+ * Blocks are hashed with the x86 SHA extensions when the processor
+ * supports them, with a portable implementation otherwise.
+ */
+class Sha1
+{
+public:
+	Sha1();
+
+	/**
+	 * Restart a new computation.
+	 */
+	void reset();
+
+	/**
+	 * Hash more bytes.
+	 */
+	void update(const void* data, size_t len);
+
+	/**
+	 * Finish the computation.
+	 * The instance must be reset before being reused.
+	 */
+	void final(git_oid& oid);
+
+	/**
+	 * Hash the header of a git object, "<type> <size>\0".
+	 */
+	void updateObjectHeader(git_otype type, size_t size);
+
+	/**
+	 * Format the header of a git object.
+	 *
+	 * @param buffer at least 32 bytes.
+	 * @return Header length, including its terminating NUL.
+	 */
+	static size_t formatObjectHeader(char* buffer, git_otype type, size_t size);
+
+	/**
+	 * Check if blocks are hashed with processor extensions.
+	 */
+	static bool accelerated();
+
+private:
+	uint32_t _state[5];
+	uint64_t _length;
+	unsigned char _buffer[64];
+	size_t _used;
+};
+
+} // namespace helper
+} // namespace git2
+#endif // _GIT2PP_SHA1_HPP_
@@ -0,0 +1,286 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#include "sharedobjectcache.hpp"
+
+#include <git2/odb_backend.h>
+
+#include "exception.hpp"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+namespace git2
+{
+
+//
+// SharedObjectCache
+//
+
+SharedObjectCache::SharedObjectCache(size_t budget, size_t shardCount):
+_budget(budget)
+{
+	size_t count = 1;
+	while(count < shardCount)
+		count *= 2;
+	for(size_t n=0; n<count; ++n)
+	{
+		_shards.push_back(std::unique_ptr<Shard>(new Shard));
+		std::memset(&_shards.back()->stats, 0, sizeof(_shards.back()->stats));
+	}
+}
+
+SharedObjectCache& SharedObjectCache::global()
+{
+	static SharedObjectCache cache(256*1024*1024);
+	return cache;
+}
+
+unsigned int SharedObjectCache::domain(const std::string& objectsDir)
+{
+	char resolved[PATH_MAX];
+	std::string path = ::realpath(objectsDir.c_str(), resolved)!=NULL ? std::string(resolved) : objectsDir;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::map<std::string, unsigned int>::iterator it = _domains.find(path);
+	if(it!=_domains.end())
+		return it->second;
+	unsigned int key = (unsigned int)_domains.size();
+	_domains[path] = key;
+	return key;
+}
+
+SharedObjectCache::Shard& SharedObjectCache::shard(const OId& oid)
+{
+	return *_shards[oid.raw()[0] & (_shards.size() - 1)];
+}
+
+SharedObjectCache::Content SharedObjectCache::find(unsigned int domain, const OId& oid, git_otype& type)
+{
+	Shard& s = shard(oid);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	std::unordered_map<unsigned int, OIdMap<std::list<Entry>::iterator>>::iterator entries = s.entries.find(domain);
+	std::list<Entry>::iterator* it = entries!=s.entries.end() ? entries->second.find(oid) : nullptr;
+	if(it==nullptr)
+		return nullptr;
+	s.lru.splice(s.lru.begin(), s.lru, *it);
+	++s.stats.hits;
+	type = (*it)->type;
+	return (*it)->content;
+}
+
+void SharedObjectCache::miss(const OId& oid)
+{
+	Shard& s = shard(oid);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	++s.stats.misses;
+}
+
+void SharedObjectCache::trim(Shard& s, size_t budget)
+{
+	while(s.stats.bytes > budget)
+	{
+		Entry& victim = s.lru.back();
+		s.entries[victim.domain].erase(victim.oid);
+		s.stats.bytes -= victim.content->size();
+		--s.stats.count;
+		++s.stats.evictions;
+		s.lru.pop_back();
+	}
+}
+
+void SharedObjectCache::insert(unsigned int domain, const OId& oid, git_otype type, const void* data, size_t size)
+{
+	size_t budget = this->budget() / _shards.size();
+	if(size > budget)
+		return;
+	Content content = std::make_shared<std::vector<unsigned char>>((const unsigned char*)data, (const unsigned char*)data + size);
+
+	Shard& s = shard(oid);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	OIdMap<std::list<Entry>::iterator>& entries = s.entries[domain];
+	if(entries.contains(oid))
+		return;
+	Entry entry = {domain, oid, type, content};
+	s.lru.push_front(entry);
+	entries[oid] = s.lru.begin();
+	s.stats.bytes += size;
+	++s.stats.count;
+	trim(s, budget);
+}
+
+void SharedObjectCache::clear()
+{
+	for(std::unique_ptr<Shard>& s : _shards)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->lru.clear();
+		s->entries.clear();
+		s->stats.bytes = 0;
+		s->stats.count = 0;
+	}
+}
+
+void SharedObjectCache::setBudget(size_t budget)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_budget = budget;
+	}
+	for(std::unique_ptr<Shard>& s : _shards)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		trim(*s, budget / _shards.size());
+	}
+}
+
+size_t SharedObjectCache::budget() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _budget;
+}
+
+ObjectCacheStats SharedObjectCache::stats() const
+{
+	ObjectCacheStats res = {0, 0, 0, 0, 0};
+	for(const std::unique_ptr<Shard>& s : _shards)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		res.hits += s->stats.hits;
+		res.misses += s->stats.misses;
+		res.evictions += s->stats.evictions;
+		res.count += s->stats.count;
+		res.bytes += s->stats.bytes;
+	}
+	return res;
+}
+
+
+//
+// SharedCacheDatabaseBackend
+//
+
+SharedCacheDatabaseBackend::SharedCacheDatabaseBackend(const std::string& objectsDir, SharedObjectCache& cache):
+_cache(cache),
+_domain(cache.domain(objectsDir)),
+_packs(NULL)
+{
+	Exception::git2_assert(git_odb_backend_pack(&_packs, objectsDir.c_str()));
+}
+
+SharedCacheDatabaseBackend::~SharedCacheDatabaseBackend()
+{
+	_packs->free(_packs);
+}
+
+bool SharedCacheDatabaseBackend::read(const OId& oid, DatabaseBackendObject& object)
+{
+	git_otype type = GIT_OBJ_BAD;
+	SharedObjectCache::Content content = _cache.find(_domain, oid, type);
+	if(content)
+	{
+		object.assign(type, content->data(), content->size());
+		return true;
+	}
+
+	void* data = NULL;
+	size_t size = 0;
+	int res = _packs->read(&data, &size, &type, _packs, oid.constData());
+	if(res==GIT_ENOTFOUND)
+	{
+		giterr_clear();
+		return false;
+	}
+	Exception::git2_assert(res);
+	_cache.miss(oid);
+	try
+	{
+		_cache.insert(_domain, oid, type, data, size);
+		object.assign(type, data, size);
+	}
+	catch(...)
+	{
+		std::free(data);
+		throw;
+	}
+	std::free(data);
+	return true;
+}
+
+bool SharedCacheDatabaseBackend::readPrefix(const OId& prefix, OId& oid, DatabaseBackendObject& object)
+{
+	void* data = NULL;
+	size_t size = 0;
+	git_otype type = GIT_OBJ_BAD;
+	int res = _packs->read_prefix(oid.data(), &data, &size, &type, _packs, prefix.constData(), prefix.length());
+	if(res==GIT_ENOTFOUND)
+	{
+		giterr_clear();
+		return false;
+	}
+	Exception::git2_assert(res);
+	try
+	{
+		object.assign(type, data, size);
+	}
+	catch(...)
+	{
+		std::free(data);
+		throw;
+	}
+	std::free(data);
+	return true;
+}
+
+bool SharedCacheDatabaseBackend::readHeader(const OId& oid, ObjectHeader& header)
+{
+	git_otype type = GIT_OBJ_BAD;
+	SharedObjectCache::Content content = _cache.find(_domain, oid, type);
+	if(content)
+	{
+		header = ObjectHeader(type, content->size());
+		return true;
+	}
+
+	size_t size = 0;
+	int res = _packs->read_header(&size, &type, _packs, oid.constData());
+	if(res==GIT_ENOTFOUND)
+	{
+		giterr_clear();
+		return false;
+	}
+	Exception::git2_assert(res);
+	_cache.miss(oid);
+	header = ObjectHeader(type, size);
+	return true;
+}
+
+bool SharedCacheDatabaseBackend::exists(const OId& oid)
+{
+	return _packs->exists(_packs, oid.constData())!=0;
+}
+
+void SharedCacheDatabaseBackend::refresh()
+{
+	if(_packs->refresh!=NULL)
+		Exception::git2_assert(_packs->refresh(_packs));
+}
+
+} // namespace git2
@@ -0,0 +1,186 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_SHAREDOBJECTCACHE_HPP_
+#define _GIT2PP_SHAREDOBJECTCACHE_HPP_
+
+#include <git2.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "database.hpp"
+#include "objectcache.hpp"
+#include "oid.hpp"
+#include "oidmap.hpp"
+
+namespace git2
+{
+
+/**
+ * Sharded LRU cache of inflated object contents, bounded in bytes and
+ * shared by all the handles of a process.
+ *
+ * Objects are keyed by the objects directory they come from and their
+ * id, so the handles opened on a same repository share their entries.
+ * Contents are immutable and handed out as shared buffers.
+ *
+ * Instances are safe to share between threads.
+ */
+class SharedObjectCache
+{
+public:
+	typedef std::shared_ptr<const std::vector<unsigned char>> Content;
+
+	/**
+	 * Create a cache.
+	 *
+	 * @param budget maximal size of the cached contents.
+	 * @param shardCount number of shards, rounded up to a power of two.
+	 */
+	SharedObjectCache(size_t budget, size_t shardCount = 16);
+
+	/**
+	 * The process-wide cache, with a budget of 256 MiB.
+	 */
+	static SharedObjectCache& global();
+
+	/**
+	 * Get the key of an objects directory.
+	 * Paths are resolved, so aliases of a directory get the same key.
+	 */
+	unsigned int domain(const std::string& objectsDir);
+
+	/**
+	 * Find an object.
+	 *
+	 * @param domain key of the objects directory.
+	 * @param oid full-length id of the object.
+	 * @param type set to the object type when found.
+	 * @return Content of the object, null if not found.
+	 * Objects not found are not counted as misses, see miss().
+	 */
+	Content find(unsigned int domain, const OId& oid, git_otype& type);
+
+	/**
+	 * Count a miss, for an object not found in the cache but found in
+	 * its objects directory. Objects read from other backends of a
+	 * database, like loose ones, do not count.
+	 */
+	void miss(const OId& oid);
+
+	/**
+	 * Insert an object, unless bigger than the budget of a shard.
+	 */
+	void insert(unsigned int domain, const OId& oid, git_otype type, const void* data, size_t size);
+
+	/**
+	 * Drop all cached objects, counters are kept.
+	 */
+	void clear();
+
+	/**
+	 * Change the byte budget, evicting objects if needed.
+	 */
+	void setBudget(size_t budget);
+
+	/**
+	 * Get the byte budget.
+	 */
+	size_t budget() const;
+
+	/**
+	 * Get the counters of the cache.
+	 */
+	ObjectCacheStats stats() const;
+
+private:
+	SharedObjectCache(const SharedObjectCache&) = delete;
+	SharedObjectCache& operator=(const SharedObjectCache&) = delete;
+
+	struct Entry
+	{
+		unsigned int domain;
+		OId oid;
+		git_otype type;
+		Content content;
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::list<Entry> lru;
+		std::unordered_map<unsigned int, OIdMap<std::list<Entry>::iterator>> entries;
+		ObjectCacheStats stats;
+	};
+
+	Shard& shard(const OId& oid);
+	void trim(Shard& shard, size_t budget);
+
+	mutable std::mutex _mutex;
+	size_t _budget;
+	std::map<std::string, unsigned int> _domains;
+	std::vector<std::unique_ptr<Shard>> _shards;
+};
+
+/**
+ * Read-through backend serving the packed objects of a directory from a
+ * SharedObjectCache.
+ *
+ * The backend reads the packs of the directory itself and keeps the
+ * inflated objects in the cache. Added to the databases of the handles
+ * opened on a repository with a priority higher than their pack backend,
+ * each object is inflated once for all of them.
+ * @see Repository::enableSharedObjectCache
+ */
+class SharedCacheDatabaseBackend : public CustomDatabaseBackend
+{
+public:
+	/** Priority above the default loose (2) and pack (1) backends. */
+	static const int Priority = 5;
+
+	/**
+	 * Create a backend over the packs of an objects directory.
+	 *
+	 * @param objectsDir path to the "objects" directory.
+	 * @param cache cache to use.
+	 * @throws Exception
+	 */
+	SharedCacheDatabaseBackend(const std::string& objectsDir, SharedObjectCache& cache = SharedObjectCache::global());
+	virtual ~SharedCacheDatabaseBackend();
+
+	virtual bool read(const OId& oid, DatabaseBackendObject& object);
+	virtual bool readPrefix(const OId& prefix, OId& oid, DatabaseBackendObject& object);
+	virtual bool readHeader(const OId& oid, ObjectHeader& header);
+	virtual bool exists(const OId& oid);
+	virtual void refresh();
+
+private:
+	SharedObjectCache& _cache;
+	unsigned int _domain;
+	git_odb_backend* _packs;
+};
+
+} // namespace git2
+#endif // _GIT2PP_SHAREDOBJECTCACHE_HPP_
@@ -58,6 +58,16 @@ std::string SignatureBuilder::email() const
     return std::string(_sign->email);
 }
 
+StringView SignatureBuilder::nameView() const
+{
+    return StringView(_sign->name);
+}
+
+StringView SignatureBuilder::emailView() const
+{
+    return StringView(_sign->email);
+}
+
 time_t SignatureBuilder::when() const
 {
 	return _sign->when.time;
@@ -106,6 +116,16 @@ std::string Signature::email() const
     return std::string(_sign->email);
 }
 
+StringView Signature::nameView() const
+{
+    return StringView(_sign->name);
+}
+
+StringView Signature::emailView() const
+{
+    return StringView(_sign->email);
+}
+
 time_t Signature::when() const
 {
 	return _sign->when.time;
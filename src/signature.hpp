@@ -24,6 +24,7 @@
 
 #include <string>
 
+#include "stringview.hpp"
 
 namespace git2
 {
@@ -86,6 +87,16 @@ public:
      */
     std::string email() const;
 
+    /**
+     * Return a view of the 'name' from this signature
+     */
+    StringView nameView() const;
+
+    /**
+     * Return a view of the 'email' from this signature
+     */
+    StringView emailView() const;
+
     /**
      * Return the time stamp from this signature
      */
@@ -147,6 +158,18 @@ public:
      */
     std::string email() const;
 
+    /**
+     * Return a view of the 'name' from this signature,
+     * valid as long as the underlaying signature.
+     */
+    StringView nameView() const;
+
+    /**
+     * Return a view of the 'email' from this signature,
+     * valid as long as the underlaying signature.
+     */
+    StringView emailView() const;
+
     /**
      * Return the time stamp from this signature
      */
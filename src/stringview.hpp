@@ -0,0 +1,173 @@
+/* -*- Mode: C++; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * libgit2pp
+ * Copyright (C) 2013-2014 Émilien Kia <emilien.kia@gmail.com>
+ *
+ * libgit2pp is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libgit2pp is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+#ifndef _GIT2PP_STRINGVIEW_HPP_
+#define _GIT2PP_STRINGVIEW_HPP_
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace git2
+{
+
+/**
+ * Non-owning view over a character range.
+ *
+ * Views returned by the wrapper classes point to memory owned by libgit2
+ * and stay valid as long as the object they come from (commit, tag, tree,
+ * reference...) is alive. Use str() to keep a copy.
+ */
+class StringView
+{
+public:
+	typedef const char* const_iterator;
+	typedef const_iterator iterator;
+
+	static const size_t npos = (size_t)-1;
+
+	StringView():_data(""), _size(0){}
+	StringView(const char* str):_data(str!=NULL ? str : ""), _size(str!=NULL ? std::strlen(str) : 0){}
+	StringView(const char* str, size_t size):_data(str!=NULL ? str : ""), _size(str!=NULL ? size : 0){}
+	StringView(const std::string& str):_data(str.data()), _size(str.size()){}
+
+	const char* data() const {return _data;}
+	size_t size() const {return _size;}
+	size_t length() const {return _size;}
+	bool empty() const {return _size==0;}
+
+	const_iterator begin() const {return _data;}
+	const_iterator end() const {return _data + _size;}
+
+	char operator[](size_t pos) const {return _data[pos];}
+	char front() const {return _data[0];}
+	char back() const {return _data[_size-1];}
+
+	/**
+	 * Copy the viewed characters into a string.
+	 */
+	std::string str() const {return std::string(_data, _size);}
+	operator std::string() const {return str();}
+
+	/**
+	 * View of a part of this view, clamped to its bounds.
+	 */
+	StringView substr(size_t pos, size_t count = npos) const
+	{
+		if(pos>_size)
+			pos = _size;
+		return StringView(_data + pos, count < _size - pos ? count : _size - pos);
+	}
+
+	/**
+	 * Position of the first occurrence of one of some characters, npos if none.
+	 */
+	size_t find_first_of(const char* chars, size_t pos = 0) const
+	{
+		for(; pos<_size; ++pos)
+		{
+			if(std::strchr(chars, _data[pos])!=NULL && _data[pos]!=0)
+				return pos;
+		}
+		return npos;
+	}
+
+	/**
+	 * Position of the first occurrence of a character, npos if none.
+	 */
+	size_t find(char c, size_t pos = 0) const
+	{
+		if(pos>=_size)
+			return npos;
+		const void* found = std::memchr(_data + pos, c, _size - pos);
+		return found!=NULL ? (const char*)found - _data : npos;
+	}
+
+	bool startsWith(const StringView& prefix) const
+	{
+		return prefix._size<=_size && std::memcmp(_data, prefix._data, prefix._size)==0;
+	}
+
+	int compare(const StringView& other) const
+	{
+		int cmp = std::memcmp(_data, other._data, _size < other._size ? _size : other._size);
+		if(cmp!=0)
+			return cmp;
+		return _size < other._size ? -1 : (_size > other._size ? 1 : 0);
+	}
+
+	bool operator==(const StringView& other) const {return _size==other._size && std::memcmp(_data, other._data, _size)==0;}
+	bool operator!=(const StringView& other) const {return !(*this==other);}
+	bool operator<(const StringView& other) const {return compare(other)<0;}
+
+private:
+	const char* _data;
+	size_t _size;
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const StringView& view)
+{
+	return stream.write(view.data(), view.size());
+}
+
+/**
+ * Non-owning view over a byte range, like blob contents.
+ *
+ * The view stays valid as long as the object it comes from.
+ */
+class ByteView
+{
+public:
+	typedef const unsigned char* const_iterator;
+	typedef const_iterator iterator;
+
+	ByteView():_data(NULL), _size(0){}
+	ByteView(const void* data, size_t size):_data((const unsigned char*)data), _size(data!=NULL ? size : 0){}
+
+	const unsigned char* data() const {return _data;}
+	size_t size() const {return _size;}
+	bool empty() const {return _size==0;}
+
+	const_iterator begin() const {return _data;}
+	const_iterator end() const {return _data + _size;}
+
+	unsigned char operator[](size_t pos) const {return _data[pos];}
+
+	/**
+	 * View of a part of this view, clamped to its bounds.
+	 */
+	ByteView subview(size_t pos, size_t count = (size_t)-1) const
+	{
+		if(pos>_size)
+			pos = _size;
+		return ByteView(_data + pos, count < _size - pos ? count : _size - pos);
+	}
+
+	/**
+	 * View the bytes as characters.
+	 */
+	StringView asString() const {return StringView((const char*)_data, _size);}
+
+private:
+	const unsigned char* _data;
+	size_t _size;
+};
+
+} // namespace git2
+#endif // _GIT2PP_STRINGVIEW_HPP_
@@ -70,6 +70,11 @@ std::string Tag::name() const
     return git_tag_name(data());
 }
 
+StringView Tag::nameView() const
+{
+    return StringView(git_tag_name(data()));
+}
+
 Signature Tag::tagger() const
 {
     return Signature(git_tag_tagger(data()));
@@ -80,6 +85,11 @@ std::string Tag::message()
     return git_tag_message(data());
 }
 
+StringView Tag::messageView() const
+{
+    return StringView(git_tag_message(data()));
+}
+
 Object Tag::peel()
 {
 	git_object *obj;
@@ -23,6 +23,7 @@
 #include <git2.h>
 
 #include "object.hpp"
+#include "stringview.hpp"
 
 namespace git2
 {
@@ -82,6 +83,11 @@ public:
      */
     std::string name() const;
 
+	/**
+	 * Get a view of the name of a tag, valid as long as this tag.
+	 */
+	StringView nameView() const;
+
 	/**
 	 * Get the name of a tag
 	 */
@@ -99,6 +105,11 @@ public:
      */
     std::string message();
 
+	/**
+	 * Get a view of the message of a tag, valid as long as this tag.
+	 */
+	StringView messageView() const;
+
 	/**
 	 * Recursively peel a tag until a non tag git_object is met.
 	 */
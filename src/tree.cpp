@@ -59,6 +59,11 @@ std::string TreeEntry::name() const
     return git_tree_entry_name(_entry);
 }
 
+StringView TreeEntry::nameView() const
+{
+    return StringView(git_tree_entry_name(_entry));
+}
+
 OId TreeEntry::oid() const
 {
     return OId(git_tree_entry_id(_entry));
@@ -23,6 +23,7 @@
 #include <git2.h>
 
 #include "object.hpp"
+#include "stringview.hpp"
 
 #include <string>
 
@@ -60,6 +61,12 @@ public:
      */
     std::string name() const;
 
+    /**
+     * Get a view of the filename of a tree entry,
+     * valid as long as the owning tree.
+     */
+    StringView nameView() const;
+
     /**
      * Get the id of the object pointed by the entry
      * @return the oid of the object